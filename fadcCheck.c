@@ -0,0 +1,273 @@
+/*************************************************************************
+ *
+ *  fadcCheck.c - Block structure check of the fADC250 data in the FADC
+ *                bank, right after the transfer.
+ *
+ *   Only the data type defining words (bit 31 set) are looked at.  They
+ *   are found 16 words at a time with SSE2 (the sign bits, packed and
+ *   movemask), so the sample words in between cost about as much as
+ *   reading them.
+ *
+ *   Checked, for each module block:
+ *     - block header ... block trailer pairs, no data outside of them
+ *     - the slot of the header is in the scan mask and read only once,
+ *       and the event headers and trailer have the same slot
+ *     - every slot of the scan mask has a block
+ *     - the trailer word count is the number of words in the block
+ *     - events in the header = event headers in the block = block level
+ *     - event numbers follow each other, in the block and from the last
+ *       block of the slot, and the first one is the same in all slots
+ *     - the block number is the same in all slots
+ *     - no data not valid words
+ *
+ *   Usage:
+ *
+ *     rocGo:       fadcCheckReset();
+ *     rocTrigger:  errors = fadcCheckBank(&bank[2], bank[0] - 1, blockLevel,
+ *                                         scanmask, &result);
+ *     rocEnd:      fadcCheckPrintStats();
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "fadcCheck.h"
+
+#define FADC_CHECK_NSLOT     32
+#define FADC_CHECK_LOGMAX    10	/* Bad events logged with daLogMsg */
+
+typedef struct
+{
+  FADC_CHECK_RESULT *res;
+  int blockLevel;
+  unsigned int slotmask;
+  unsigned int seen;		/* Slots with a block header */
+  int inBlock;
+  int slot;			/* Of the open block */
+  int start;			/* Offset of the block header */
+  int nevents;			/* In the block header */
+  int nevhdr;			/* Event headers so far */
+  int evnum;			/* Last event number in the block */
+  int firstEvnum;		/* Of the first block, -1 = none yet */
+  int blocknum;			/* Of the first block, -1 = none yet */
+} FADC_CHECK_STATE;
+
+/* Last event number read from each slot, -1 = none since Go */
+static int fadcCheckLastEvnum[FADC_CHECK_NSLOT];
+
+struct
+{
+  unsigned long long events;
+  unsigned long long bad;
+  unsigned long long nerr[FADC_CHECK_NERR];	/* Bad events by error */
+} fadcCheckStats;
+
+void
+fadcCheckReset()
+{
+  memset(fadcCheckLastEvnum, 0xff, sizeof(fadcCheckLastEvnum));
+  memset(&fadcCheckStats, 0, sizeof(fadcCheckStats));
+}
+
+static inline void
+fadcCheckError(FADC_CHECK_STATE *st, unsigned int err, int slot, int offset)
+{
+  if(st->res->errors == 0)
+    st->res->offset = offset;
+  st->res->errors |= err;
+  st->res->slots |= 1 << (slot & 0x1f);
+}
+
+static inline void
+fadcCheckCloseBlock(FADC_CHECK_STATE *st, int offset)
+{
+  if(st->inBlock)
+    fadcCheckError(st, FADC_CHECK_NO_TRAILER, st->slot, offset);
+  st->inBlock = 0;
+}
+
+static inline void
+fadcCheckWord(FADC_CHECK_STATE *st, uint32_t word, int offset)
+{
+  int slot = (word >> 22) & 0x1f, n;
+
+  switch((word >> 27) & 0xf)
+    {
+    case 0:			/* Block header */
+      fadcCheckCloseBlock(st, offset);
+      if(!(st->slotmask & (1 << slot)) || (st->seen & (1 << slot)))
+	fadcCheckError(st, FADC_CHECK_SLOT, slot, offset);
+      st->seen |= 1 << slot;
+
+      st->inBlock = 1;
+      st->slot = slot;
+      st->start = offset;
+      st->nevents = word & 0xff;
+      st->nevhdr = 0;
+      if(st->nevents != st->blockLevel)
+	fadcCheckError(st, FADC_CHECK_NEVENTS, slot, offset);
+
+      n = (word >> 8) & 0x3ff;
+      if(st->blocknum < 0)
+	st->blocknum = n;
+      else if(n != st->blocknum)
+	fadcCheckError(st, FADC_CHECK_BLOCKNUM, slot, offset);
+      break;
+
+    case 1:			/* Block trailer */
+      if(!st->inBlock)
+	{
+	  fadcCheckError(st, FADC_CHECK_NO_HEADER, slot, offset);
+	  break;
+	}
+      if(slot != st->slot)
+	fadcCheckError(st, FADC_CHECK_SLOT, st->slot, offset);
+      if((word & 0x3fffff) != offset - st->start + 1)
+	fadcCheckError(st, FADC_CHECK_WORDCOUNT, st->slot, offset);
+      if(st->nevhdr != st->nevents)
+	fadcCheckError(st, FADC_CHECK_NEVENTS, st->slot, offset);
+      st->inBlock = 0;
+      break;
+
+    case 2:			/* Event header */
+      if(!st->inBlock)
+	{
+	  fadcCheckError(st, FADC_CHECK_NO_HEADER, slot, offset);
+	  break;
+	}
+      if(slot != st->slot)
+	fadcCheckError(st, FADC_CHECK_SLOT, st->slot, offset);
+
+      n = word & 0x3fffff;
+      if(st->nevhdr == 0)
+	{
+	  /* First of the block: same in all slots, after the last one */
+	  if(st->firstEvnum < 0)
+	    st->firstEvnum = n;
+	  else if(n != st->firstEvnum)
+	    fadcCheckError(st, FADC_CHECK_EVNUM, st->slot, offset);
+
+	  if((fadcCheckLastEvnum[st->slot] >= 0) &&
+	     (n != ((fadcCheckLastEvnum[st->slot] + 1) & 0x3fffff)))
+	    fadcCheckError(st, FADC_CHECK_EVNUM, st->slot, offset);
+	}
+      else if(n != ((st->evnum + 1) & 0x3fffff))
+	fadcCheckError(st, FADC_CHECK_EVNUM, st->slot, offset);
+
+      st->evnum = n;
+      fadcCheckLastEvnum[st->slot] = n;
+      st->nevhdr++;
+      break;
+
+    case 14:			/* Data not valid */
+      fadcCheckError(st, FADC_CHECK_NOT_VALID, st->inBlock ? st->slot : slot, offset);
+      break;
+
+    case 15:			/* Filler, after the trailer */
+      break;
+
+    default:			/* Data */
+      if(!st->inBlock)
+	fadcCheckError(st, FADC_CHECK_NO_HEADER, slot, offset);
+      break;
+    }
+}
+
+/*
+  Check the nwords of FADC bank data at data (after the bank header),
+  read with blockLevel events per block from the slots in slotmask.
+  Returns the FADC_CHECK_* errors found (0 = good), with the slots and
+  offset of the first error in res.
+*/
+static unsigned int
+fadcCheckBank(const uint32_t *data, int nwords, int blockLevel,
+	      unsigned int slotmask, FADC_CHECK_RESULT *res)
+{
+  FADC_CHECK_STATE st;
+  unsigned int mask;
+  int ii = 0, ierr;
+
+  memset(&st, 0, sizeof(st));
+  st.res = res;
+  st.blockLevel = blockLevel;
+  st.slotmask = slotmask;
+  st.firstEvnum = -1;
+  st.blocknum = -1;
+  res->errors = 0;
+  res->slots = 0;
+  res->offset = -1;
+
+#ifdef __SSE2__
+  for(; ii + 16 <= nwords; ii += 16)
+    {
+      /* Saturating packs keep the sign bits, in order */
+      __m128i a = _mm_loadu_si128((const __m128i *) (data + ii));
+      __m128i b = _mm_loadu_si128((const __m128i *) (data + ii + 4));
+      __m128i c = _mm_loadu_si128((const __m128i *) (data + ii + 8));
+      __m128i d = _mm_loadu_si128((const __m128i *) (data + ii + 12));
+
+      mask = _mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(a, b),
+					       _mm_packs_epi32(c, d)));
+      while(mask)
+	{
+	  int jj = __builtin_ctz(mask);
+	  fadcCheckWord(&st, data[ii + jj], ii + jj);
+	  mask &= mask - 1;
+	}
+    }
+#endif
+
+  for(; ii < nwords; ii++)
+    if(data[ii] & 0x80000000)
+      fadcCheckWord(&st, data[ii], ii);
+
+  fadcCheckCloseBlock(&st, nwords);
+
+  if(slotmask & ~st.seen)
+    {
+      if(res->errors == 0)
+	res->offset = nwords;
+      res->errors |= FADC_CHECK_MISSING;
+      res->slots |= slotmask & ~st.seen;
+    }
+
+  fadcCheckStats.events++;
+  if(res->errors)
+    {
+      fadcCheckStats.bad++;
+      for(ierr = 0; ierr < FADC_CHECK_NERR; ierr++)
+	if(res->errors & (1 << ierr))
+	  fadcCheckStats.nerr[ierr]++;
+
+      if(fadcCheckStats.bad <= FADC_CHECK_LOGMAX)
+	daLogMsg("ERROR", "Bad FADC block (event %d): errors 0x%x, slots 0x%06x, word %d%s",
+		 tiGetIntCount(), res->errors, res->slots, res->offset,
+		 (fadcCheckStats.bad == FADC_CHECK_LOGMAX) ? " (no more logged)" : "");
+    }
+
+  return res->errors;
+}
+
+void
+fadcCheckPrintStats()
+{
+  const char *names[FADC_CHECK_NERR] = FADC_CHECK_NAMES;
+  int ierr;
+
+  if(fadcCheckStats.events == 0)
+    return;
+
+  printf("%s: FADC block check: %llu of %llu events bad\n",
+	 __func__, fadcCheckStats.bad, fadcCheckStats.events);
+  for(ierr = 0; ierr < FADC_CHECK_NERR; ierr++)
+    if(fadcCheckStats.nerr[ierr])
+      printf("    %-24s %llu\n", names[ierr], fadcCheckStats.nerr[ierr]);
+
+  if(fadcCheckStats.bad)
+    daLogMsg("ERROR", "%llu of %llu events with a bad FADC block",
+	     fadcCheckStats.bad, fadcCheckStats.events);
+}
@@ -0,0 +1,47 @@
+/*************************************************************************
+ *
+ *  fadcCheck.h - Block structure check of the fADC250 data in the FADC
+ *                bank (see fadcCheck.c).
+ *
+ *   An event with a bad FADC bank gets a FADC_CHECK_BANK after it:
+ *
+ *     word 0   FADC_CHECK_* bits of the errors found
+ *     word 1   mask of the slots with an error (bit = slot)
+ *     word 2   offset of the first error in the FADC bank data
+ *
+ *   and its FADC bank is left as read (no zero suppression or
+ *   compaction).
+ *
+ */
+
+#ifndef __FADCCHECK_H__
+#define __FADCCHECK_H__
+
+#include <stdint.h>
+
+#define FADC_CHECK_BANK  0x23	/* FADC_BANK (0x3) errors */
+
+#define FADC_CHECK_NO_HEADER   (1 << 0)	/* Data outside of a block */
+#define FADC_CHECK_NO_TRAILER  (1 << 1)	/* Block without a trailer */
+#define FADC_CHECK_SLOT        (1 << 2)	/* Unexpected, repeated or mismatched slot */
+#define FADC_CHECK_MISSING     (1 << 3)	/* No block from a slot in the scan mask */
+#define FADC_CHECK_WORDCOUNT   (1 << 4)	/* Trailer word count != block words */
+#define FADC_CHECK_NEVENTS     (1 << 5)	/* Events in block != block level */
+#define FADC_CHECK_EVNUM       (1 << 6)	/* Event number jump or mismatch between slots */
+#define FADC_CHECK_BLOCKNUM    (1 << 7)	/* Block number mismatch between slots */
+#define FADC_CHECK_NOT_VALID   (1 << 8)	/* Data not valid word (type 14) */
+#define FADC_CHECK_NERR        9
+
+#define FADC_CHECK_NAMES {						\
+    "data outside of a block", "missing trailer", "slot", "missing slot", \
+      "word count", "events in block", "event number", "block number", \
+      "data not valid" }
+
+typedef struct
+{
+  unsigned int errors;		/* FADC_CHECK_* */
+  unsigned int slots;		/* Slots with an error */
+  int offset;			/* Offset of the first error, -1 = none */
+} FADC_CHECK_RESULT;
+
+#endif /* __FADCCHECK_H__ */
@@ -0,0 +1,386 @@
+/*************************************************************************
+ *
+ *  fadcPack.c - Lossless compaction of the fADC250 window raw data in
+ *               the FADC bank, and the reference decoder.  The format
+ *               is in fadcPack.h.
+ *
+ *   The differences of the sample fields, their bit widths and the bit
+ *   planes are computed 8 or 16 samples at a time with SSE2 (scalar
+ *   otherwise).
+ *
+ *   Usage (rocTrigger, after the FADC bank is closed):
+ *
+ *     nout = fadcPackBank(&bank[2], bank[0] - 1, packbuf, maxwords);
+ *     if((nout > 0) && (nout < bank[0] - 1))  ... use the packed bank
+ *
+ *   and off-line:
+ *
+ *     nwords = fadcUnpackBank(&bank[2], bank[0] - 1, buf, maxwords);
+ *
+ *   The routines are static: include this file where they are used.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "fadcPack.h"
+
+#define FADC_PACK_MAXFIELD  4096	/* 2 * (0xfff + 1) / 2 */
+#define FADC_PACK_MAXGROUP  (FADC_PACK_MAXFIELD / FADC_PACK_GROUP)
+
+/* Bit width of v (0 for 0) */
+static inline int
+fadcPackWidth(unsigned int v)
+{
+  return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/*
+  Split nw sample words into 2*nw fields, and the zigzag differences
+  z[i] = field[i+1] - field[i].  Returns the OR of the sample words, to
+  check for bits outside of the two fields.
+*/
+static uint32_t
+fadcPackDiff(const uint32_t *w, int nw, uint16_t *field, uint16_t *z)
+{
+  uint32_t acc = 0;
+  int ii = 0, nf = 2 * nw;
+
+#ifdef __SSE2__
+  __m128i vacc = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi16(0x3fff);
+
+  /* Fields: swap the 16 bit halves of each word (first sample is high) */
+  for(; ii + 4 <= nw; ii += 4)
+    {
+      __m128i v = _mm_loadu_si128((const __m128i *) (w + ii));
+      vacc = _mm_or_si128(vacc, v);
+      v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xb1), 0xb1);
+      _mm_storeu_si128((__m128i *) (field + 2 * ii), _mm_and_si128(v, mask));
+    }
+  vacc = _mm_or_si128(vacc, _mm_srli_si128(vacc, 8));
+  vacc = _mm_or_si128(vacc, _mm_srli_si128(vacc, 4));
+  acc = _mm_cvtsi128_si32(vacc);
+#endif
+
+  for(; ii < nw; ii++)
+    {
+      acc |= w[ii];
+      field[2 * ii] = (w[ii] >> 16) & 0x3fff;
+      field[2 * ii + 1] = w[ii] & 0x3fff;
+    }
+
+  ii = 0;
+#ifdef __SSE2__
+  for(; ii + 8 < nf; ii += 8)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *) (field + ii));
+      __m128i b = _mm_loadu_si128((const __m128i *) (field + ii + 1));
+      __m128i d = _mm_sub_epi16(b, a);
+      d = _mm_xor_si128(_mm_slli_epi16(d, 1), _mm_srai_epi16(d, 15));
+      _mm_storeu_si128((__m128i *) (z + ii), d);
+    }
+#endif
+
+  for(; ii < nf - 1; ii++)
+    {
+      int d = (int) field[ii + 1] - (int) field[ii];
+      z[ii] = (uint16_t) ((d << 1) ^ (d >> 31));
+    }
+
+  return acc;
+}
+
+/* Bit width of the 16 zigzag differences at z */
+static inline int
+fadcPackGroupWidth(const uint16_t *z)
+{
+  unsigned int acc = 0;
+
+#ifdef __SSE2__
+  __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *) z),
+			   _mm_loadu_si128((const __m128i *) (z + 8)));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 8));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 4));
+  v = _mm_or_si128(v, _mm_srli_si128(v, 2));
+  acc = _mm_cvtsi128_si32(v) & 0xffff;
+#else
+  int ii;
+
+  for(ii = 0; ii < FADC_PACK_GROUP; ii++)
+    acc |= z[ii];
+#endif
+
+  return fadcPackWidth(acc);
+}
+
+/* Bit planes 0 .. width-1 of the 16 differences at z, into unit[] */
+static inline void
+fadcPackPlanes(const uint16_t *z, int width, uint16_t *unit)
+{
+  int ib;
+
+  if(width == 0)
+    return;
+
+#ifdef __SSE2__
+  /* Move bit width-1 to the sign bit, then the sign bits of the 16 lanes
+     (packs keeps the sign) to a mask, one bit plane at a time */
+  __m128i count = _mm_cvtsi32_si128(16 - width);
+  __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i *) z), count);
+  __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i *) (z + 8)), count);
+
+  for(ib = width - 1; ib >= 0; ib--)
+    {
+      unit[ib] = _mm_movemask_epi8(_mm_packs_epi16(a, b));
+      a = _mm_add_epi16(a, a);
+      b = _mm_add_epi16(b, b);
+    }
+#else
+  int ii;
+  unsigned int u;
+
+  for(ib = 0; ib < width; ib++)
+    {
+      u = 0;
+      for(ii = 0; ii < FADC_PACK_GROUP; ii++)
+	u |= ((z[ii] >> ib) & 1) << ii;
+      unit[ib] = u;
+    }
+#endif
+}
+
+/* The 16 differences from bit planes 0 .. width-1 in unit[], into z */
+static inline void
+fadcUnpackPlanes(const uint16_t *unit, int width, uint16_t *z)
+{
+  int ib;
+
+#ifdef __SSE2__
+  const __m128i sel0 = _mm_setr_epi16(0x1, 0x2, 0x4, 0x8,
+				      0x10, 0x20, 0x40, 0x80);
+  const __m128i sel1 = _mm_setr_epi16(0x100, 0x200, 0x400, 0x800,
+				      0x1000, 0x2000, 0x4000, (short) 0x8000);
+  __m128i a = _mm_setzero_si128(), b = _mm_setzero_si128(), p;
+
+  for(ib = width - 1; ib >= 0; ib--)
+    {
+      p = _mm_set1_epi16(unit[ib]);
+      a = _mm_add_epi16(a, a);
+      b = _mm_add_epi16(b, b);
+      /* cmpeq is -1 where bit ib of the difference is set */
+      a = _mm_sub_epi16(a, _mm_cmpeq_epi16(_mm_and_si128(p, sel0), sel0));
+      b = _mm_sub_epi16(b, _mm_cmpeq_epi16(_mm_and_si128(p, sel1), sel1));
+    }
+  _mm_storeu_si128((__m128i *) z, a);
+  _mm_storeu_si128((__m128i *) (z + 8), b);
+#else
+  int ii;
+
+  memset(z, 0, FADC_PACK_GROUP * sizeof(uint16_t));
+  for(ib = 0; ib < width; ib++)
+    for(ii = 0; ii < FADC_PACK_GROUP; ii++)
+      z[ii] |= ((unit[ib] >> ii) & 1) << ib;
+#endif
+}
+
+/*
+  Pack the nw sample words at w (nfield samples) after pack word *pw.
+  Returns the number of words written after the pack word, or -1 if that
+  would be more than maxn.
+*/
+static int
+fadcPackChannel(const uint32_t *w, int nw, int nfield, uint32_t *pw,
+		int maxn)
+{
+  uint16_t field[FADC_PACK_MAXFIELD + 8];
+  uint16_t z[FADC_PACK_MAXFIELD + FADC_PACK_GROUP];
+  uint16_t unit[FADC_PACK_MAXFIELD + 2];
+  unsigned char width[FADC_PACK_MAXGROUP + 3];
+  int nz = nfield - 1, pad = nfield & 1, ngroup, nunit, ig, ii, n;
+
+  if(fadcPackDiff(w, nw, field, z) & 0xc000c000)
+    return -1;			/* Not window raw data */
+
+  ngroup = (nz + FADC_PACK_GROUP - 1) / FADC_PACK_GROUP;
+  memset(&z[nz], 0, (ngroup * FADC_PACK_GROUP - nz) * sizeof(uint16_t));
+
+  /* Widths first, to know the size */
+  nunit = (ngroup + 3) / 4 + pad;
+  for(ig = 0; ig < ngroup; ig++)
+    {
+      width[ig] = fadcPackGroupWidth(&z[ig * FADC_PACK_GROUP]);
+      nunit += width[ig];
+    }
+  n = (nunit + 1) / 2;
+  if(n > maxn)
+    return -1;
+
+  width[ngroup] = width[ngroup + 1] = width[ngroup + 2] = 0;
+  for(ig = 0; ig < ngroup; ig += 4)
+    unit[ig / 4] = width[ig] | (width[ig + 1] << 4) | (width[ig + 2] << 8)
+      | (width[ig + 3] << 12);
+
+  nunit = (ngroup + 3) / 4;
+  if(pad)
+    unit[nunit++] = field[nfield];
+
+  for(ig = 0; ig < ngroup; ig++)
+    {
+      fadcPackPlanes(&z[ig * FADC_PACK_GROUP], width[ig], &unit[nunit]);
+      nunit += width[ig];
+    }
+  unit[nunit] = 0;
+
+  for(ii = 0; ii < n; ii++)
+    pw[1 + ii] = unit[2 * ii] | ((uint32_t) unit[2 * ii + 1] << 16);
+  *pw = (field[0] << 16) | n;
+
+  return n;
+}
+
+/*
+  Pack the nin words of FADC bank data at in (after the bank header)
+  into out.  Returns the number of words written, or -1 if they do not
+  fit in maxout.
+*/
+static int
+fadcPackBank(const uint32_t *in, int nin, uint32_t *out, int maxout)
+{
+  const uint32_t *iend = in + nin;
+  uint32_t *op = out, *oend = out + maxout;
+  int nw, n;
+
+  while(in < iend)
+    {
+      if(op >= oend)
+	return -1;
+      *op++ = *in;
+
+      if(!FADC_IS_WINDOW_RAW(*in++))
+	continue;
+
+      nw = (FADC_WINDOW_WIDTH(in[-1]) + 1) / 2;
+      if(op >= oend)
+	return -1;
+
+      /* Packed, if fewer words than the samples and room for them */
+      n = -1;
+      if((nw > 0) && (in + nw <= iend))
+	n = fadcPackChannel(in, nw, FADC_WINDOW_WIDTH(in[-1]), op,
+			    (oend - op - 1 < nw - 1) ? oend - op - 1 : nw - 1);
+
+      if(n >= 0)
+	{
+	  op += 1 + n;
+	  in += nw;
+	}
+      else
+	{
+	  /* Keep the sample words (up to the end of the bank) as they are */
+	  if(nw > iend - in)
+	    nw = iend - in;
+	  if(op + 1 + nw > oend)
+	    return -1;
+	  *op++ = FADC_PACK_RAW | nw;
+	  memcpy(op, in, nw * sizeof(uint32_t));
+	  op += nw;
+	  in += nw;
+	}
+    }
+
+  return op - out;
+}
+
+/*
+  Reference decoder: unpack the nin words of FADC_PACK_BANK data at in
+  into the original FADC bank data at out.  Returns the number of words
+  written, or -1 on a malformed bank or if they do not fit in maxout.
+*/
+static int
+fadcUnpackBank(const uint32_t *in, int nin, uint32_t *out, int maxout)
+{
+  const uint32_t *iend = in + nin;
+  uint32_t *op = out, *oend = out + maxout;
+  uint32_t pw;
+  uint16_t z[FADC_PACK_MAXFIELD + FADC_PACK_GROUP];
+  uint16_t unit[2 * 0xfff + 2];
+  int nw, n, nz, pad, ngroup, nunit, ig, ii, width;
+  unsigned int f, prev;
+
+  while(in < iend)
+    {
+      if(op >= oend)
+	return -1;
+      *op++ = *in;
+
+      if(!FADC_IS_WINDOW_RAW(*in++))
+	continue;
+
+      if(in >= iend)
+	return -1;
+      pw = *in++;
+      n = FADC_PACK_NWORDS(pw);
+      if(in + n > iend)
+	return -1;
+
+      if(pw & FADC_PACK_RAW)
+	{
+	  if(op + n > oend)
+	    return -1;
+	  memcpy(op, in, n * sizeof(uint32_t));
+	  op += n;
+	  in += n;
+	  continue;
+	}
+
+      nz = FADC_WINDOW_WIDTH(op[-1]) - 1;
+      pad = (nz + 1) & 1;
+      nw = (nz + 2) / 2;
+      if((nw == 0) || (op + nw > oend))
+	return -1;
+      ngroup = (nz + FADC_PACK_GROUP - 1) / FADC_PACK_GROUP;
+
+      for(ii = 0; ii < n; ii++)
+	{
+	  unit[2 * ii] = in[ii] & 0xffff;
+	  unit[2 * ii + 1] = in[ii] >> 16;
+	}
+
+      nunit = (ngroup + 3) / 4 + pad;
+      if(nunit > 2 * n)
+	return -1;
+
+      for(ig = 0; ig < ngroup; ig++)
+	{
+	  width = (unit[ig / 4] >> (4 * (ig & 3))) & 0xf;
+	  if(nunit + width > 2 * n)
+	    return -1;
+	  fadcUnpackPlanes(&unit[nunit], width, &z[ig * FADC_PACK_GROUP]);
+	  nunit += width;
+	}
+
+      /* Sum the differences back up to the fields */
+      prev = FADC_PACK_FIRST(pw);
+      op[0] = prev << 16;
+      for(ii = 0; ii < nz; ii++)
+	{
+	  f = z[ii];
+	  prev = (prev + ((f >> 1) ^ -(f & 1))) & 0xffff;
+	  if(ii & 1)
+	    op[(ii + 1) / 2] = prev << 16;
+	  else
+	    op[(ii + 1) / 2] |= prev;
+	}
+      if(pad)
+	op[nw - 1] |= unit[(ngroup + 3) / 4];
+
+      op += nw;
+      in += n;
+    }
+
+  return op - out;
+}
@@ -0,0 +1,49 @@
+/*************************************************************************
+ *
+ *  fadcPack.h - Lossless compaction of the fADC250 window raw data
+ *               (proc mode 1) in the FADC bank (see fadcPack.c).
+ *
+ *   The packed bank (tag FADC_PACK_BANK) holds the same word stream as
+ *   the FADC bank, except for the samples of each window raw data
+ *   channel.  After the channel header (type 4, window width W in
+ *   samples, (W+1)/2 sample words) comes one pack word:
+ *
+ *     bit  31      0
+ *     bit  30      1 = raw: the next N words are the sample words as read
+ *     bits 29-16   first sample field (not valid bit + 13 bit sample)
+ *     bits 11-0    N, the number of words that follow
+ *
+ *   When not raw, the N words hold 16 bit units (unit 2k in bits 15-0 of
+ *   word k, unit 2k+1 in bits 31-16).  The sample fields 1 .. W-1 are
+ *   stored as the difference from the previous field, zigzag encoded
+ *   ((d << 1) ^ (d >> 31)), in groups of FADC_PACK_GROUP (the last group
+ *   padded with zeros):
+ *
+ *     4 bits per group, 4 groups per unit   bit width w of the group (0-15)
+ *     1 unit, if W is odd                   the field after the last sample
+ *     then, for each group, w units         bit planes: unit b has bit b
+ *                                           of difference j in bit j
+ *
+ *   A channel that does not look like window raw data (sample words with
+ *   bits 31, 30, 15 or 14 set, or cut short) is kept raw, so that the
+ *   bank always unpacks to the original words.
+ *
+ */
+
+#ifndef __FADCPACK_H__
+#define __FADCPACK_H__
+
+#include <stdint.h>
+
+#define FADC_PACK_BANK   0x13	/* FADC_BANK (0x3), packed */
+#define FADC_PACK_GROUP  16	/* Differences per bit width */
+
+#define FADC_PACK_RAW        (1 << 30)
+#define FADC_PACK_FIRST(w)   (((w) >> 16) & 0x3fff)
+#define FADC_PACK_NWORDS(w)  ((w) & 0xfff)
+
+/* Window raw data channel header: type 4 */
+#define FADC_IS_WINDOW_RAW(w)  (((w) & 0xf8000000) == 0xa0000000)
+#define FADC_WINDOW_WIDTH(w)   ((w) & 0xfff)
+
+#endif /* __FADCPACK_H__ */
@@ -0,0 +1,346 @@
+/*************************************************************************
+ *
+ *  fadcPipeline.c - Pipelined readout of the fADC250 blocks: the block
+ *                   transfer of the next block, into the next event
+ *                   buffer, while this event is formatted and handed to
+ *                   usrtrig.
+ *
+ *   With more than one block in the modules (bufferLevel > 1), rocTrigger
+ *   starts the transfer of the next block (in the transfer thread) right
+ *   after its own block is read, and goes on with the FADC check, zero
+ *   suppression, compaction, VLD, scalers and the handoff to usrtrig.
+ *   The next rocTrigger takes the block already in its event buffer,
+ *   waiting for the end of the transfer if it is not done.
+ *
+ *   The next block is only read ahead when:
+ *     - this block is not a sync event (the modules must be empty after
+ *       it, see the sync event check in rocTrigger)
+ *     - the next event buffer of the ring is free
+ *     - the modules have the next block (one faGBlockReady scan)
+ *
+ *   The next trigger block is not read yet, so the FADC data is put
+ *   where it goes after a trigger block of the size of this one.  The
+ *   next trigger block may be longer, and would then be written over
+ *   the start of the FADC data: it is read past the FADC data instead
+ *   (room for the longest TI block is kept there), the FADC data moved
+ *   to where it goes after it if it is of another size, and the trigger
+ *   block copied in place (fadcPipelineReadTrigger).
+ *
+ *   Only one block transfer at a time: the next rocTrigger takes the
+ *   block (end of its transfer) before it reads its trigger block.
+ *
+ *   Usage:
+ *
+ *     rocGo:       fadcPipelineStart();
+ *     rocTrigger:  if(fadcPipelineTake(the_event) >= 0)   before the TI
+ *                    dCnt = fadcPipelineReadTrigger(dma_dabufp);
+ *                  ...
+ *                    nwords = fadcPipelinePlace(dma_dabufp, room);
+ *                  ...
+ *                  fadcPipelineNext(scanmask, offset, maxwords, roType);
+ *     rocEnd:      fadcPipelineStop(0);
+ *     rocPrestart, rocCleanup:  fadcPipelineStop(1);
+ *
+ */
+
+#include <pthread.h>
+
+/* Longest TI trigger block: block header and trailer, up to 8 words per event */
+#define FADC_PIPE_TI_WORDS(bl)  (8 + 8 * (bl))
+
+static struct
+{
+  pthread_t thread;
+  int started;
+  volatile int stop;
+
+  /* Transfers requested and done: the thread waits on req, rocTrigger on done */
+  volatile unsigned int req __attribute__ ((aligned(64)));
+  volatile unsigned int done __attribute__ ((aligned(64)));
+  volatile int waiting;		/* rocTrigger sleeps on done */
+
+  /* Transfer: set by rocTrigger before req */
+  DMANODE *node;
+  unsigned int *data;
+  int room;
+  int roType;
+  int tiWords;			/* Kept after the FADC data for the TI block */
+
+  /* Result: set by the thread before done */
+  int nwords;
+  int blockError;
+
+  /* Since Go */
+  unsigned long long blocks;	/* Read without a block error */
+  unsigned long long ahead;	/* Of them read ahead */
+  unsigned long long waits;	/* rocTrigger waited for the end of the transfer */
+  unsigned long long moved;	/* Trigger block of another size */
+  unsigned long long sync, noBuffer, notReady;	/* Not read ahead */
+  unsigned long long dropped;	/* Read ahead but not taken */
+} fadcPipe;
+
+void fadcPipelineStop(int reset);
+
+static void *
+fadcPipelineThread(void *arg)
+{
+  unsigned int req;
+
+  while(1)
+    {
+      req = __atomic_load_n(&fadcPipe.req, __ATOMIC_ACQUIRE);
+      if(req == fadcPipe.done)
+	{
+	  if(fadcPipe.stop)
+	    break;
+	  rocFutexWait(&fadcPipe.req, req, 100000000L);
+	  continue;
+	}
+
+      fadcPipe.nwords = faReadBlock(0, fadcPipe.data, fadcPipe.room, fadcPipe.roType);
+      fadcPipe.blockError = faGetBlockError(1);
+      if(!fadcPipe.blockError)
+	faResetToken(faSlot(0));
+
+      __atomic_store_n(&fadcPipe.done, req, __ATOMIC_SEQ_CST);
+      if(__atomic_load_n(&fadcPipe.waiting, __ATOMIC_SEQ_CST))
+	rocFutexWake(&fadcPipe.done);
+    }
+
+  return NULL;
+}
+
+void
+fadcPipelineStart()
+{
+  /* Thread of a run reset without End */
+  fadcPipelineStop(1);
+
+  memset(&fadcPipe, 0, sizeof(fadcPipe));
+
+  if(pthread_create(&fadcPipe.thread, NULL, fadcPipelineThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      daLogMsg("ERROR", "Unable to start the FADC transfer thread.  Pipelined readout disabled.");
+      return;
+    }
+  fadcPipe.started = 1;
+}
+
+/* Wait for the end of the transfer in progress, if any */
+static void
+fadcPipelineWait()
+{
+  unsigned int done;
+
+  if(__atomic_load_n(&fadcPipe.done, __ATOMIC_ACQUIRE) == fadcPipe.req)
+    return;
+
+  fadcPipe.waits++;
+  while(1)
+    {
+      __atomic_store_n(&fadcPipe.waiting, 1, __ATOMIC_SEQ_CST);
+      done = __atomic_load_n(&fadcPipe.done, __ATOMIC_SEQ_CST);
+      if(done == fadcPipe.req)
+	break;
+      rocFutexWait(&fadcPipe.done, done, 100000000L);
+    }
+  __atomic_store_n(&fadcPipe.waiting, 0, __ATOMIC_RELAXED);
+}
+
+/*
+  A block read ahead that is not taken has left the modules: the FADC
+  blocks of the next events are no longer those of their TI blocks.
+  Nothing can put the events back in sync, so the run is stopped.
+*/
+static void
+fadcPipelineDrop(const char *where)
+{
+  fadcPipe.dropped++;
+  fadcPipe.node = NULL;
+
+  daLogMsg("ERROR", "FADC block read ahead and not used (%s).  FADC and TI blocks out of sync.",
+	   where);
+  ROL_SET_ERROR;
+}
+
+/*
+  Before the trigger block of the event in node is read: the number of
+  words of its FADC block read ahead (to be placed with
+  fadcPipelinePlace), or -1 if it was not.  A block read ahead into
+  another event is a fatal readout error.
+*/
+static int
+fadcPipelineTake(DMANODE *node)
+{
+  if(fadcPipe.node == NULL)
+    return -1;
+
+  fadcPipelineWait();
+
+  if(fadcPipe.node != node)
+    {
+      fadcPipelineDrop("not the next event");
+      return -1;
+    }
+  fadcPipe.node = NULL;
+
+  return fadcPipe.nwords;
+}
+
+/*
+  With a block read ahead (fadcPipelineTake >= 0): read the trigger block
+  of the event to dst, as tiReadTriggerBlock.  It is read after the FADC
+  data (8 byte aligned for the DMA), so that a trigger block longer than
+  the last one does not write over it, and the FADC data is moved to
+  where it goes after the trigger block and the FADC bank header.
+*/
+static int
+fadcPipelineReadTrigger(unsigned int *dst)
+{
+  static unsigned int tiData[FADC_PIPE_TI_WORDS(255)];
+  unsigned int *ti, *fadc;
+  int dCnt;
+
+  ti = (unsigned int *) (((unsigned long) (fadcPipe.data + fadcPipe.nwords) + 7) & ~7UL);
+  dCnt = tiReadTriggerBlock(ti);
+  if(dCnt <= 0)
+    return dCnt;
+
+  if(dCnt > fadcPipe.tiWords)
+    {
+      daLogMsg("ERROR", "TI block of %d words, longer than the %d kept for it",
+	       dCnt, fadcPipe.tiWords);
+      ROL_SET_ERROR;
+      dCnt = fadcPipe.tiWords;
+    }
+  memcpy(tiData, ti, dCnt << 2);
+
+  fadc = dst + dCnt + 2;
+  if(fadc != fadcPipe.data)
+    {
+      memmove(fadc, fadcPipe.data, fadcPipe.nwords << 2);
+      fadcPipe.data = fadc;
+      fadcPipe.moved++;
+    }
+
+  memcpy(dst, tiData, dCnt << 2);
+
+  return dCnt;
+}
+
+/*
+  Move the block from fadcPipelineTake to dst (the FADC bank data), with
+  up to room words.  Returns the number of words, with the block error
+  in *blockError.
+*/
+static int
+fadcPipelinePlace(unsigned int *dst, int room, int *blockError)
+{
+  int nwords = fadcPipe.nwords;
+
+  if(nwords > room)
+    nwords = room;
+
+  if(dst != fadcPipe.data)
+    {
+      memmove(dst, fadcPipe.data, nwords << 2);
+      fadcPipe.moved++;
+    }
+
+  fadcPipe.ahead++;
+  *blockError = fadcPipe.blockError;
+
+  return nwords;
+}
+
+/*
+  After this event's FADC block is read (and its bank data starts
+  offset words into the event data): start the transfer of the next
+  block of the modules in scanmask, into the next event buffer, if the
+  next block is there.
+*/
+static void
+fadcPipelineNext(unsigned int scanmask, int offset, int maxwords, int roType)
+{
+  DMANODE *next;
+
+  fadcPipe.blocks++;
+
+  if(!fadcPipe.started)
+    return;
+
+  if(tiGetBlockSyncFlag() == 1)
+    {
+      fadcPipe.sync++;
+      return;
+    }
+
+  next = rocRingGetNext(&eventRing);
+  if(next == NULL)
+    {
+      fadcPipe.noBuffer++;
+      return;
+    }
+
+  if(faGBlockReady(scanmask, 1) != scanmask)
+    {
+      fadcPipe.notReady++;
+      return;
+    }
+
+  fadcPipe.node = next;
+  fadcPipe.data = rocEventData(next) + offset;
+  fadcPipe.tiWords = FADC_PIPE_TI_WORDS(blockLevel);
+  fadcPipe.room = rocEventReserveAt(next, fadcPipe.data, maxwords + fadcPipe.tiWords + 2)
+    - (fadcPipe.tiWords + 2);
+  if(fadcPipe.room <= 0)
+    {
+      fadcPipe.noBuffer++;
+      fadcPipe.node = NULL;
+      return;
+    }
+  fadcPipe.roType = roType;
+
+  __atomic_store_n(&fadcPipe.req, fadcPipe.req + 1, __ATOMIC_RELEASE);
+  rocFutexWake(&fadcPipe.req);
+}
+
+/*
+  Stop the transfer thread, after the last transfer.  reset = 1 when
+  the modules are reset after it: a block read ahead is discarded with
+  them.
+*/
+void
+fadcPipelineStop(int reset)
+{
+  if(!fadcPipe.started)
+    return;
+
+  fadcPipelineWait();
+  if(fadcPipe.node && reset)
+    fadcPipe.node = NULL;
+  else if(fadcPipe.node)
+    fadcPipelineDrop("no trigger after it");
+
+  fadcPipe.stop = 1;
+  rocFutexWake(&fadcPipe.req);
+  pthread_join(fadcPipe.thread, NULL);
+  fadcPipe.started = 0;
+}
+
+void
+fadcPipelinePrintStats()
+{
+  if(fadcPipe.blocks == 0)
+    return;
+
+  printf("%s: FADC blocks read ahead: %llu of %llu (%.1f %%), waited for %llu, moved %llu\n",
+	 __func__, fadcPipe.ahead, fadcPipe.blocks,
+	 100.0 * fadcPipe.ahead / fadcPipe.blocks, fadcPipe.waits, fadcPipe.moved);
+  printf("    not read ahead: sync event %llu, no free buffer %llu, not ready %llu\n",
+	 fadcPipe.sync, fadcPipe.noBuffer, fadcPipe.notReady);
+
+  if(fadcPipe.dropped)
+    printf("    read ahead and not used (run stopped): %llu\n", fadcPipe.dropped);
+}
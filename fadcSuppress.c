@@ -0,0 +1,280 @@
+/*************************************************************************
+ *
+ *  fadcSuppress.c - Software zero suppression of the fADC250 window raw
+ *                   data (proc mode 1) in the FADC bank.
+ *
+ *   A window raw data channel (header + sample words) is dropped when
+ *   none of its valid samples is above the threshold of its slot and
+ *   channel, pedestal + nsigma * sigma.  The max of the samples is taken
+ *   16 at a time with SSE2 (scalar otherwise), and the samples are only
+ *   looked at one by one in a channel where it is above threshold.
+ *
+ *   In place of the dropped channels of a module in an event, one hit
+ *   mask word is written (where the first dropped channel was):
+ *
+ *     bit  31      1 (data type defining)
+ *     bits 30-27   FADC_ZS_MASK_TYPE (11)
+ *     bits 26-22   slot
+ *     bits 15-0    channels kept (with data in this event)
+ *
+ *   A module/event without a dropped channel has no mask word, so the
+ *   bank never grows and is suppressed in place.
+ *
+ *   The thresholds are read from a text file, one line per slot and
+ *   channel ('*' for all), '#' starts a comment:
+ *
+ *     # slot  channel  pedestal  sigma
+ *       3     0        151.2     1.4
+ *       3     *        150       1.5
+ *
+ *   The last line that matches a channel wins.  Channels not in the
+ *   file are never dropped.
+ *
+ *   Usage:
+ *
+ *     rocPrestart:  fadcSuppressLoad(filename, nsigma);
+ *     rocTrigger:   nwords = fadcSuppressBank(&bank[2], bank[0] - 1);
+ *     rocEnd:       fadcSuppressPrintStats();
+ *
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FADC_ZS_NSLOT      22
+#define FADC_ZS_MASK_TYPE  11
+#define FADC_ZS_MASK_WORD(slot, mask)					\
+  (0x80000000 | (FADC_ZS_MASK_TYPE << 27) | ((slot) << 22) | ((mask) & 0xffff))
+
+/* Threshold of each slot and channel, -1 = never drop */
+static int16_t fadcZsThreshold[FADC_ZS_NSLOT][16];
+
+struct
+{
+  unsigned long long events;
+  unsigned long long channels;
+  unsigned long long dropped;
+  unsigned long long wordsIn;
+  unsigned long long wordsOut;
+} fadcZsStats;
+
+/*
+  Read the pedestals and sigmas in filename, and set the thresholds to
+  pedestal + nsigma * sigma.  Returns the number of channels with a
+  threshold, or ERROR.
+*/
+int
+fadcSuppressLoad(const char *filename, double nsigma)
+{
+  FILE *f;
+  char line[256], sslot[16], schan[16];
+  double ped, sigma;
+  int islot, ichan, slot, chan, nline = 0, nset = 0, thr;
+
+  memset(fadcZsThreshold, 0xff, sizeof(fadcZsThreshold));
+
+  f = fopen(filename, "r");
+  if(f == NULL)
+    {
+      perror("fopen");
+      daLogMsg("ERROR", "Unable to open FADC threshold file %s", filename);
+      return ERROR;
+    }
+
+  while(fgets(line, sizeof(line), f))
+    {
+      char *comment = strchr(line, '#');
+      nline++;
+      if(comment)
+	*comment = '\0';
+
+      if(sscanf(line, "%15s %15s %lf %lf", sslot, schan, &ped, &sigma) != 4)
+	{
+	  if(strspn(line, " \t\r\n") != strlen(line))
+	    printf("%s: WARN: %s:%d: expected slot channel pedestal sigma\n",
+		   __func__, filename, nline);
+	  continue;
+	}
+
+      thr = (int) ceil(ped + nsigma * sigma);
+      if(thr < 0)
+	thr = 0;
+      if(thr > 0x1fff)
+	thr = 0x1fff;
+
+      slot = (sslot[0] == '*') ? -1 : atoi(sslot);
+      chan = (schan[0] == '*') ? -1 : atoi(schan);
+      for(islot = 0; islot < FADC_ZS_NSLOT; islot++)
+	for(ichan = 0; ichan < 16; ichan++)
+	  if(((slot < 0) || (slot == islot)) && ((chan < 0) || (chan == ichan)))
+	    fadcZsThreshold[islot][ichan] = thr;
+    }
+  fclose(f);
+
+  for(islot = 0; islot < FADC_ZS_NSLOT; islot++)
+    for(ichan = 0; ichan < 16; ichan++)
+      if(fadcZsThreshold[islot][ichan] >= 0)
+	nset++;
+
+  printf("%s: %d channels with a threshold (pedestal + %.1f sigma) from %s\n",
+	 __func__, nset, nsigma, filename);
+
+  return nset;
+}
+
+/* 1 if a valid sample of the nw sample words at w is above thr */
+static inline int
+fadcSuppressAbove(const uint32_t *w, int nw, int thr)
+{
+  int ii = 0;
+
+#ifdef __SSE2__
+  const __m128i field = _mm_set1_epi16(0x3fff);
+  const __m128i sample = _mm_set1_epi16(0x1fff);
+  const __m128i invalid = _mm_set1_epi16(0x2000);
+  const __m128i vthr = _mm_set1_epi16(thr);
+  __m128i v, bad, vmax = _mm_setzero_si128();
+
+  /* Max of the sample fields, not valid bit included, 16 at a time:
+     nothing above thr is the common case of a channel to drop */
+  for(; ii + 8 <= nw; ii += 8)
+    {
+      vmax = _mm_max_epi16(vmax,
+			   _mm_and_si128(_mm_loadu_si128((const __m128i *) (w + ii)),
+					 field));
+      vmax = _mm_max_epi16(vmax,
+			   _mm_and_si128(_mm_loadu_si128((const __m128i *) (w + ii + 4)),
+					 field));
+    }
+  if(ii + 4 <= nw)
+    {
+      vmax = _mm_max_epi16(vmax,
+			   _mm_and_si128(_mm_loadu_si128((const __m128i *) (w + ii)),
+					 field));
+      ii += 4;
+    }
+
+  if(_mm_movemask_epi8(_mm_cmpgt_epi16(vmax, vthr)))
+    {
+      /* Something is, again with the not valid samples as 0 */
+      for(ii = 0; ii + 4 <= nw; ii += 4)
+	{
+	  v = _mm_loadu_si128((const __m128i *) (w + ii));
+	  bad = _mm_cmpeq_epi16(_mm_and_si128(v, invalid), invalid);
+	  v = _mm_andnot_si128(bad, _mm_and_si128(v, sample));
+	  if(_mm_movemask_epi8(_mm_cmpgt_epi16(v, vthr)))
+	    return 1;
+	}
+    }
+#endif
+
+  for(; ii < nw; ii++)
+    {
+      if(!(w[ii] & 0x20000000) && (int) ((w[ii] >> 16) & 0x1fff) > thr)
+	return 1;
+      if(!(w[ii] & 0x2000) && (int) (w[ii] & 0x1fff) > thr)
+	return 1;
+    }
+
+  return 0;
+}
+
+/*
+  Drop the window raw data channels below threshold from the nwords of
+  FADC bank data at data (after the bank header), in place.  Returns the
+  new number of words.
+*/
+static int
+fadcSuppressBank(uint32_t *data, int nwords)
+{
+  uint32_t *in = data, *end = data + nwords, *out = data;
+  uint32_t *maskWord = NULL, word;
+  unsigned int kept = 0;
+  int slot = 0, chan, nw;
+
+  fadcZsStats.events++;
+  fadcZsStats.wordsIn += nwords;
+
+  while(in < end)
+    {
+      word = *in;
+
+      if((word & FA_DATA_TYPE_DEFINE) &&
+	 ((word & FA_DATA_TYPE_MASK) != FA_DATA_WINDOW_RAW))
+	{
+	  /* End of the channels of the last module/event */
+	  if(maskWord)
+	    *maskWord = FADC_ZS_MASK_WORD(slot, kept);
+	  maskWord = NULL;
+	  kept = 0;
+
+	  if(((word & FA_DATA_TYPE_MASK) == FA_DATA_BLOCK_HEADER) ||
+	     ((word & FA_DATA_TYPE_MASK) == FA_DATA_EVENT_HEADER))
+	    slot = (word >> 22) & 0x1f;
+
+	  *out++ = *in++;
+	  continue;
+	}
+
+      if(!(word & FA_DATA_TYPE_DEFINE))
+	{
+	  *out++ = *in++;	/* Continuation word */
+	  continue;
+	}
+
+      /* Window raw data channel */
+      chan = (word >> 23) & 0xf;
+      nw = ((word & 0xfff) + 1) / 2;
+      if(nw > end - in - 1)
+	nw = end - in - 1;
+      fadcZsStats.channels++;
+
+      if((slot >= FADC_ZS_NSLOT) || (fadcZsThreshold[slot][chan] < 0) ||
+	 fadcSuppressAbove(in + 1, nw, fadcZsThreshold[slot][chan]))
+	{
+	  kept |= 1 << chan;
+	  if(out != in)
+	    memmove(out, in, (1 + nw) * sizeof(uint32_t));
+	  out += 1 + nw;
+	}
+      else
+	{
+	  fadcZsStats.dropped++;
+	  if(maskWord == NULL)
+	    maskWord = out++;
+	}
+      in += 1 + nw;
+    }
+
+  if(maskWord)
+    *maskWord = FADC_ZS_MASK_WORD(slot, kept);
+
+  fadcZsStats.wordsOut += out - data;
+
+  return out - data;
+}
+
+void
+fadcSuppressPrintStats()
+{
+  if(fadcZsStats.events == 0)
+    return;
+
+  printf("%s: FADC zero suppression: %llu of %llu channels dropped (%.1f %%)\n",
+	 __func__, fadcZsStats.dropped, fadcZsStats.channels,
+	 fadcZsStats.channels ? 100.0 * fadcZsStats.dropped / fadcZsStats.channels : 0);
+  printf("    words in %llu  out %llu  (%.2f : 1)\n",
+	 fadcZsStats.wordsIn, fadcZsStats.wordsOut,
+	 fadcZsStats.wordsOut ?
+	 (double) fadcZsStats.wordsIn / fadcZsStats.wordsOut : 0);
+
+  daLogMsg("INFO", "FADC zero suppression dropped %.1f %% of the channels, bank %.2f : 1",
+	   fadcZsStats.channels ? 100.0 * fadcZsStats.dropped / fadcZsStats.channels : 0,
+	   fadcZsStats.wordsOut ?
+	   (double) fadcZsStats.wordsIn / fadcZsStats.wordsOut : 0);
+}
@@ -6,7 +6,8 @@
  *
  */
 
-/* Event Buffer definitions */
+/* Event Buffer definitions
+   Initial size, resized in rocGo for the FADC250 settings (event_pool_depth) */
 #define MAX_EVENT_POOL     10
 
 /* Size in Bytes Original size -  Use setrf.tcl if greater than 60kB  */
@@ -50,10 +51,33 @@
 /* Routines to add string buffers to banks */
 #include "rocUtils.c"
 
+/* Per-stage readout latency histograms (compile with -DROC_TIMING) */
+#include "rocTiming.c"
+
+/* Lossless compaction of the FADC window raw data */
+#include "fadcPack.c"
+
+/* Block structure check of the FADC data */
+#include "fadcCheck.c"
+
+/* Software zero suppression of the FADC window raw data */
+#include "fadcSuppress.c"
+
+/* Pipelined FADC block transfer */
+#include "fadcPipeline.c"
+
+/* blockLevel/bufferLevel from a trigger rate target */
+#include "rocTune.c"
+
 #define BLOCKLEVEL  1
 #define BUFFERLEVEL 5
 
 void writeConfigToFile();
+void faReadyPrintStats();
+void fadcPackPrintStats();
+void fadcSuppressPrintStats();
+void fadcCheckPrintStats();
+void configWriterWait();
 
 /* FADC Library Variables */
 extern int fadcA32Base, nfadc;
@@ -83,6 +107,66 @@ char fa250_config_file[256];
 /* for the calculation of maximum data words in the block transfer */
 unsigned int MAXFADCWORDS=0;
 
+/* Event buffers (usrString pool=<N>), 0 = MAX_EVENT_POOL.
+   usrString hugepages: page aligned event buffers (rocEventPageAlign) */
+int event_pool_depth = 0;
+
+/* Wait for fADC250 block ready (faWaitBlockReady)
+     fa_ready_timeout_us : give up after this long, 0 = from the window settings
+                           (usrString fareadytimeout=<us>)
+*/
+int fa_ready_timeout_us = 0;
+static unsigned long long faReadyExpectNs = 0;	/* Expected conversion time */
+static unsigned long long faReadyTimeoutNs = 1000000;
+
+#define FA_READY_SPIN   2	/* Scans before backing off */
+#define FA_READY_NHIST  16
+
+struct
+{
+  unsigned long long events;
+  unsigned long long timeouts;
+  unsigned long long scans;
+  unsigned long long waitNs;
+  unsigned long long maxWaitNs;
+  unsigned long long nscan[FA_READY_NHIST];	/* Events by number of scans, last = more */
+} faReadyStats;
+
+/* FADC bank compaction (usrString fadcpack)
+     fadc_pack : 0 = off
+                 1 = write the FADC bank as FADC_PACK_BANK, when smaller
+                 2 = same, and unpack each bank to check it
+*/
+int fadc_pack = 0;
+static unsigned int *fadcPackBuf = NULL, *fadcPackCheckBuf = NULL;
+
+struct
+{
+  unsigned long long events;
+  unsigned long long packed;	/* Events written as FADC_PACK_BANK */
+  unsigned long long wordsIn;
+  unsigned long long wordsOut;
+  unsigned long long checkErrors;
+} fadcPackStats;
+
+/* FADC block check (usrString fadccheck, on by default)
+     Events with a bad FADC block get a FADC_CHECK_BANK, see fadcCheck.h
+*/
+int fadc_check = 1;
+
+/* FADC software zero suppression (usrString fadczs=<threshold file>)
+     Channels with no sample above pedestal + fadc_zs_nsigma * sigma
+     (usrString fadczsnsigma) are dropped, see fadcSuppress.c
+*/
+char fadc_zs_file[256];
+double fadc_zs_nsigma = 5.0;
+int fadc_zs = 0;
+
+/* Pipelined FADC readout (usrString fapipeline): the next block is read
+   into the next event buffer while this event is formatted, see
+   fadcPipeline.c.  Only with bufferLevel > 1. */
+int fa_pipeline = 0;
+
 /* SD variables */
 static unsigned int sdScanMask = 0;
 
@@ -91,9 +175,133 @@ static unsigned int sdScanMask = 0;
 // Define this to include scaler data in coda events
 #define FADC_SCALER_BANKS
 int scaler_period=2;
-struct timespec last_time;
 #include "scale32LibNew.c"
 #include "linuxScalerLib.c"
+
+/*
+  Scaler sampler thread
+    Reads the FADC and TI scalers every scaler_period seconds (holding the
+    vmeBus lock) into the back half of a double buffer, then makes it the
+    front half.  rocTrigger copies the front half into banks 9250 / 9001
+    in the next event.
+*/
+#define SCALER_MAX_WORDS  (NFADC * 18 + 256)
+
+static struct
+{
+  pthread_t thread;
+  int started;
+  int stop;
+  pthread_mutex_t lock;		/* front, ready and the front buffer */
+  pthread_cond_t stop_cv;
+  int front;			/* Buffer with the latest snapshot */
+  volatile int ready;		/* Snapshot in front not yet in an event */
+  unsigned int fadc[2][SCALER_MAX_WORDS];
+  unsigned int ti[2][SCALER_MAX_WORDS];
+  int nfadc_words[2];
+  int nti_words[2];
+  unsigned int nsamples;
+  unsigned int ninserted;
+} scalerSampler =
+  {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .stop_cv = PTHREAD_COND_INITIALIZER
+  };
+
+static void *
+scalerSamplerThread(void *arg)
+{
+  struct timespec next;
+  unsigned int *dp;
+  int back, stop = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(1)
+    {
+      next.tv_sec += scaler_period;
+
+      pthread_mutex_lock(&scalerSampler.lock);
+      while(!scalerSampler.stop &&
+	    (pthread_cond_timedwait(&scalerSampler.stop_cv, &scalerSampler.lock, &next) == 0))
+	;
+      stop = scalerSampler.stop;
+      back = 1 - scalerSampler.front;
+      pthread_mutex_unlock(&scalerSampler.lock);
+
+      if(stop)
+	break;
+
+      vmeBusLock();
+#ifdef FADC_SCALER_BANKS
+      dp = scalerSampler.fadc[back];
+      read_fadc_scalers(&dp,0);
+      scalerSampler.nfadc_words[back] = dp - scalerSampler.fadc[back];
+
+      dp = scalerSampler.ti[back];
+      read_ti_scalers(&dp,0);
+      scalerSampler.nti_words[back] = dp - scalerSampler.ti[back];
+#else
+      read_fadc_scalers(0,0);
+      read_ti_scalers(0,0);
+#endif
+      read_clock_channels();
+      vmeBusUnlock();
+
+      pthread_mutex_lock(&scalerSampler.lock);
+      scalerSampler.front = back;
+      scalerSampler.ready = 1;
+      scalerSampler.nsamples++;
+      pthread_mutex_unlock(&scalerSampler.lock);
+    }
+
+  return NULL;
+}
+
+void
+scalerSamplerStart()
+{
+  pthread_condattr_t attr;
+
+  if(scalerSampler.started || (scaler_period <= 0))
+    return;
+
+  /* Periods on the monotonic clock */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&scalerSampler.stop_cv, &attr);
+  pthread_condattr_destroy(&attr);
+
+  scalerSampler.stop = 0;
+  scalerSampler.ready = 0;
+  scalerSampler.nsamples = scalerSampler.ninserted = 0;
+
+  if(pthread_create(&scalerSampler.thread, NULL, scalerSamplerThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      daLogMsg("ERROR","Unable to start scaler sampler thread");
+      return;
+    }
+  scalerSampler.started = 1;
+}
+
+void
+scalerSamplerStop()
+{
+  if(!scalerSampler.started)
+    return;
+
+  pthread_mutex_lock(&scalerSampler.lock);
+  scalerSampler.stop = 1;
+  pthread_cond_signal(&scalerSampler.stop_cv);
+  pthread_mutex_unlock(&scalerSampler.lock);
+
+  pthread_join(scalerSampler.thread, NULL);
+  scalerSampler.started = 0;
+
+  printf("%s: %d scaler samples, %d inserted in events\n",
+	 __func__, scalerSampler.nsamples, scalerSampler.ninserted);
+}
 #endif
 
 #define VLD_READOUT
@@ -138,6 +346,11 @@ TI_SLAVE_MAP tiSlaveConfig[nSlaves] =
 /* TI VTP configuration */
 int enable_vtp = 0;
 
+/* Capture of event buffers for replay (rocsim -P)
+     capture=<directory>  capturemax=<MB> */
+char capture_dir[256];
+int capture_max_mb = 1024;
+
 /*
   Read the user flags/configuration file.
   10sept21 - BM
@@ -224,6 +437,106 @@ readUserFlags()
   else
     printf("\tDISABLED\n");
 
+  /* Event buffer capture */
+  capture_dir[0] = '\0';
+  if(getflag("capture") == 2)
+    strncpy(capture_dir, getvalue("capture"), sizeof(capture_dir) - 1);
+
+  capture_max_mb = 1024;
+  if(getflag("capturemax") == 2)
+    capture_max_mb = getint("capturemax");
+
+  event_pool_depth = 0;
+  if(getflag("pool") == 2)
+    event_pool_depth = getint("pool");
+
+  /* Event buffers laid out for huge page backed memory: 'hugepages' */
+  rocEventPageAlign(getflag("hugepages") != 0);
+  if(getflag("hugepages"))
+    printf("%s\n Event buffers page aligned, for huge pages\n", __func__);
+
+  /* Readout (asyncTrigger) and CODA (usrtrig) threads, CPU list as 2:3 or 2-3:
+       'readoutcpu=<CPU list>', 'readoutprio=<SCHED_FIFO priority>',
+       'codacpu=<CPU list>', 'codaprio=<SCHED_FIFO priority>' */
+  rocSchedConfig(ROC_SCHED_READOUT,
+		 (getflag("readoutcpu") == 2) ? getvalue("readoutcpu") : NULL,
+		 (getflag("readoutprio") == 2) ? getint("readoutprio") : 0);
+  rocSchedConfig(ROC_SCHED_CODA,
+		 (getflag("codacpu") == 2) ? getvalue("codacpu") : NULL,
+		 (getflag("codaprio") == 2) ? getint("codaprio") : 0);
+
+  /* Events copied out by each call of usrtrig: 'outbatch=<N>',
+     up to 'outbatchkb=<KB>' of data (default one event buffer).
+     Only with -DROC_OUTPUT_BATCH, see rocSetOutputBatch */
+  rocSetOutputBatch((getflag("outbatch") == 2) ? getint("outbatch") : 1,
+		    (getflag("outbatchkb") == 2) ? getint("outbatchkb") : 0);
+
+  /* CODA thread sleeps on the event ring instead of polling it: 'codawait',
+     after spinning up to 'codawait=<us>' (default 20 us) */
+  flag = getflag("codawait");
+  rocSetCodaWait((flag == 2) ? getint("codawait") : (flag ? 20 : -1));
+
+  /* Longest wait of End for the TI to be read out: 'endtimeout=<ms>' */
+  rocSetEndTimeout((getflag("endtimeout") == 2) ? getint("endtimeout") : 0);
+
+  /* Block and buffer levels from the TI master for a trigger rate:
+       'ratetarget=<Hz>', blocks filled in 'maxblocklatency=<us>' at most */
+  rocTuneConfig((getflag("ratetarget") == 2) ? atof(getvalue("ratetarget")) : 0,
+		(getflag("maxblocklatency") == 2) ? getint("maxblocklatency") : 0);
+
+  fa_ready_timeout_us = 0;
+  if(getflag("fareadytimeout") == 2)
+    fa_ready_timeout_us = getint("fareadytimeout");
+
+  /* FADC bank compaction: 'fadcpack', 'fadcpack=1', check with 'fadcpack=2' */
+  fadc_pack = 0;
+  flag = getflag("fadcpack");
+  if(flag)
+    {
+      fadc_pack = 1;
+
+      if(flag > 1)
+	fadc_pack = getint("fadcpack");
+    }
+  if(fadc_pack)
+    printf("%s\n FADC bank compaction ENABLED%s\n",
+	   __func__, (fadc_pack > 1) ? " (with check)" : "");
+
+  /* FADC block check: off with 'fadccheck=0' */
+  fadc_check = 1;
+  if(getflag("fadccheck") == 2)
+    fadc_check = getint("fadccheck");
+  if(!fadc_check)
+    printf("%s\n FADC block check DISABLED\n", __func__);
+
+  /* FADC zero suppression: 'fadczs=<file>', 'fadczsnsigma=<N>' */
+  memset(fadc_zs_file, 0, sizeof(fadc_zs_file));
+  fadc_zs_nsigma = 5.0;
+  if(getflag("fadczs") == 2)
+    strncpy(fadc_zs_file, getvalue("fadczs"), sizeof(fadc_zs_file) - 1);
+
+  if(getflag("fadczsnsigma") == 2)
+    fadc_zs_nsigma = atof(getvalue("fadczsnsigma"));
+
+  if(fadc_zs_file[0])
+    printf("%s\n FADC zero suppression ENABLED: %s, pedestal + %.1f sigma\n",
+	   __func__, fadc_zs_file, fadc_zs_nsigma);
+
+  /* Pipelined FADC readout: 'fapipeline' */
+  fa_pipeline = 0;
+  if(getflag("fapipeline"))
+    {
+      fa_pipeline = 1;
+      if(getflag("fapipeline") == 2)
+	fa_pipeline = getint("fapipeline");
+    }
+  if(fa_pipeline)
+    printf("%s\n Pipelined FADC readout ENABLED\n", __func__);
+
+  if(capture_dir[0])
+    printf("%s\n Capture event buffers to %s (max %d MB)\n",
+	   __func__, capture_dir, capture_max_mb);
+
   /* Configfile type
     - modify the path of the config file path, based on the configtype string
 
@@ -253,7 +566,7 @@ readUserFlags()
       flag = getflag("configtype");
       if(flag)
 	{
-	  char *configfile_type = getstr("configtype");
+	  const char *configfile_type = getvalue("configtype");
 	  if(configfile_type != NULL)
 	    {
 	      printf("%s: configtype = %s\n",
@@ -267,8 +580,6 @@ readUserFlags()
 	      daLogMsg("WARN",
 		       "configtype = %s, updated config file path",
 		       configfile_type);
-
-	      free(configfile_type);
 	    }
 	  else
 	    {
@@ -432,6 +743,8 @@ rocDownload()
   printf("block level = %d  \n", blockLevel);
   printf("Fiber latency 0x%x\n",FIBER_LATENCY_OFFSET);
 
+  ROC_TIMING_INIT;
+
   printf("rocDownload: (a) User Download Executed\n");
 
 }
@@ -444,11 +757,14 @@ rocPrestart()
 #ifdef FADC_SCALERS
   /* Suspend scaler task */
   set_runstatus(1);
-  clock_gettime(CLOCK_REALTIME, &last_time);
 #endif
 
   rocTriggerSource = 0;
 
+  /* Transfer thread of a run reset without End: its block goes with
+     the module init below */
+  fadcPipelineStop(1);
+
   /* Read User Flags with usrstringutils
      What's set
      - TI Slave Ports
@@ -457,6 +773,11 @@ rocPrestart()
    */
   readUserFlags();
 
+  /* FADC zero suppression thresholds */
+  fadc_zs = 0;
+  if(fadc_zs_file[0])
+    fadc_zs = (fadcSuppressLoad(fadc_zs_file, fadc_zs_nsigma) > 0);
+
   /* Program/Init VME Modules Here */
 
 
@@ -513,9 +834,15 @@ rocPrestart()
 #endif
 
 #ifdef TI_MASTER
+  /* Levels for the rate target (usrString ratetarget), or the defaults */
+  int bufferLevel = BUFFERLEVEL;
+  blockLevel = BLOCKLEVEL;
+  rocTuneLevels(&blockLevel, &bufferLevel);
+
   /* Set number of events per block (broadcasted to all connected TI Slaves)*/
   tiSetBlockLevel(blockLevel);
-  printf("rocPrestart: Block Level set to %d\n",blockLevel);
+  tiSetBlockBufferLevel(bufferLevel);
+  printf("rocPrestart: Block Level set to %d, Buffer Level %d\n",blockLevel,bufferLevel);
 #endif
   tiSetTriggerPulse(1,25,3,0); // delay is second argument in units of 16ns
 
@@ -532,6 +859,8 @@ rocPrestart()
   /* Write the current hardware configuration to evtype 137 and file */
   writeConfigToFile();
 
+  ROC_TIMING_RESET;
+
   printf("rocPrestart: User Prestart Executed\n");
 
 }
@@ -570,27 +899,30 @@ rocGo()
   if(enable_vtp)
     tiRocEnable(2);
 
-/* #ifdef TI_SLAVE */
-/*   /\* In case of slave, set TI busy to be enabled for full buffer level *\/ */
-
-/*   /\* Check first for valid blockLevel and bufferLevel *\/ */
-/*   if((bufferLevel > 10) || (blockLevel > 1)) */
-/*     { */
-/*       daLogMsg("ERROR","Invalid blockLevel / bufferLevel received: %d / %d", */
-/* 	       blockLevel, bufferLevel); */
-/*       tiUseBroadcastBufferLevel(0); */
-/*       tiSetBlockBufferLevel(1); */
-
-/*       /\* Cannot help the TI blockLevel with the current library. */
-/* 	 modules can be spared, though */
-/*       *\/ */
-/*       blockLevel = 1; */
-/*     } */
-/*   else */
-/*     { */
-/*       tiUseBroadcastBufferLevel(1); */
-/*     } */
-/* #endif */
+#ifdef TI_SLAVE
+  /* In case of slave, set TI busy to be enabled for full buffer level */
+
+  /* Check first for valid blockLevel and bufferLevel */
+  if((bufferLevel < 1) || (bufferLevel > ROC_TUNE_MAX_BUFFERLEVEL) ||
+     (blockLevel < 1) || (blockLevel > ROC_TUNE_MAX_BLOCKLEVEL))
+    {
+      daLogMsg("ERROR","Invalid blockLevel / bufferLevel received: %d / %d",
+	       blockLevel, bufferLevel);
+      tiUseBroadcastBufferLevel(0);
+      tiSetBlockBufferLevel(1);
+      bufferLevel = 1;
+
+      /* Cannot help the TI blockLevel with the current library.
+	 modules can be spared, though
+      */
+      if((blockLevel < 1) || (blockLevel > ROC_TUNE_MAX_BLOCKLEVEL))
+	blockLevel = 1;
+    }
+  else
+    {
+      tiUseBroadcastBufferLevel(1);
+    }
+#endif
 
   faGSetBlockLevel(blockLevel);
 
@@ -607,9 +939,71 @@ rocGo()
    */
   MAXFADCWORDS = nfadc * (4 + blockLevel * (4 + 16 * (1 + (ptw / 2))) + 18);
 
+  /* Size the event buffers for the largest event (bytes)
+     TI trigger bank (header + 8 words per event)
+     + FADC bank + VLD bank + FADC and TI scaler banks,
+     each bank with a 2 word header
+  */
+  int max_event_words = (2 + 8 + 8 * blockLevel)
+    + (2 + MAXFADCWORDS)
+#ifdef VLD_READOUT
+    + (2 + 256)
+#endif
+#ifdef FADC_SCALERS
+    + (2 + nfadc * 18) + (2 + 256)
+#endif
+    ;
+  /* Depth for the levels (with usrString ratetarget) unless set with 'pool' */
+  rocSetEventPool(max_event_words << 2,
+		  event_pool_depth ? event_pool_depth
+		  : rocTunePoolDepth(max_event_words << 2, bufferLevel));
+  rocTuneStart(blockLevel, bufferLevel);
+
+  /* Expected time for the fADC250 to have the block ready after the trigger:
+     window and pulse integration (4ns / sample)
+     + building the block, about 4ns per word per module
+  */
+  faReadyExpectNs = 4 * (ptw + nsa + nsb) + 4 * blockLevel * (4 + 16 * (1 + (ptw / 2)));
+  if(fa_ready_timeout_us > 0)
+    faReadyTimeoutNs = (unsigned long long) fa_ready_timeout_us * 1000;
+  else
+    faReadyTimeoutNs = (100 * faReadyExpectNs > 1000000) ? 100 * faReadyExpectNs : 1000000;
+  printf("%s: fADC250 block ready expected in %llu ns, timeout %llu us\n",
+	 __func__, faReadyExpectNs, faReadyTimeoutNs / 1000);
+  memset(&faReadyStats, 0, sizeof(faReadyStats));
+
+  /* Buffers for the packed (and check) FADC bank */
+  memset(&fadcPackStats, 0, sizeof(fadcPackStats));
+  memset(&fadcZsStats, 0, sizeof(fadcZsStats));
+  fadcCheckReset();
+  if(fadcPackBuf)
+    free(fadcPackBuf);
+  if(fadcPackCheckBuf)
+    free(fadcPackCheckBuf);
+  fadcPackBuf = fadcPackCheckBuf = NULL;
+  if(fadc_pack)
+    {
+      fadcPackBuf = malloc(MAXFADCWORDS * sizeof(unsigned int));
+      fadcPackCheckBuf = malloc(MAXFADCWORDS * sizeof(unsigned int));
+      if((fadcPackBuf == NULL) || (fadcPackCheckBuf == NULL))
+	{
+	  daLogMsg("ERROR", "Out of memory for the FADC bank compaction. Disabled.");
+	  fadc_pack = 0;
+	}
+    }
+
   /*  Enable FADC */
   faGEnable(0, 0);
 
+  if(fa_pipeline)
+    {
+      if(bufferLevel > 1)
+	fadcPipelineStart();
+      else
+	printf("%s: Buffer Level %d: no FADC block to read ahead.  Pipelined readout off.\n",
+	       __func__, bufferLevel);
+    }
+
 
 #ifdef TI_MASTER
   if(rocTriggerSource != 0)
@@ -645,8 +1039,18 @@ rocGo()
   set_runstatus(1);
   printf("fadc scalers cleared\n");
   enable_scalers();
+  scalerSamplerStart();
 #endif
 
+  if(capture_dir[0])
+    {
+      char capture_file[512];
+      snprintf(capture_file, sizeof(capture_file), "%s/roc%d_run%06d.cap",
+	       capture_dir, ROCID, rol->runNumber);
+      rocCaptureOpen(capture_file, ROCID, rol->runNumber, blockLevel,
+		     (size_t) capture_max_mb << 20);
+    }
+
 }
 
 void
@@ -668,6 +1072,9 @@ rocEnd()
 
 #endif
 
+  /* Transfer thread stopped before the modules */
+  fadcPipelineStop(0);
+
   /* FADC Disable */
   faGDisable(0);
 
@@ -683,24 +1090,199 @@ rocEnd()
 
 #ifdef FADC_SCALERS
   /* Resume stand alone scaler server */
+  scalerSamplerStop();
   disable_scalers();
   set_runstatus(0);		/* Tell Stand alone scaler task to resume  */
 #endif
 
+  faReadyPrintStats();
+  fadcCheckPrintStats();
+  fadcSuppressPrintStats();
+  fadcPackPrintStats();
+  fadcPipelinePrintStats();
+  rocTuneEnd();
+
   printf("rocEnd: Ended after %d events\n",tiGetIntCount());
 
 }
 
+static inline unsigned long long
+faReadyNow()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+  Wait for the modules in scanmask to have a block ready.
+  Scan FA_READY_SPIN times back to back, then back off between scans:
+  starting at 1/8 of the expected conversion time, doubling up to the
+  expected conversion time.  Give up after faReadyTimeoutNs.
+  Returns the mask of modules with a block ready.
+*/
+unsigned int
+faWaitBlockReady(unsigned int scanmask)
+{
+  unsigned long long t0, now, next, delay, wait;
+  unsigned int datascan;
+  int nscan = 0;
+
+  t0 = now = faReadyNow();
+  delay = faReadyExpectNs / 8;
+  if(delay < 200)
+    delay = 200;
+
+  while(1)
+    {
+      datascan = faGBlockReady(scanmask, 1);
+      nscan++;
+      if(datascan == scanmask)
+	break;
+
+      now = faReadyNow();
+      if(now - t0 >= faReadyTimeoutNs)
+	{
+	  faReadyStats.timeouts++;
+	  break;
+	}
+
+      if(nscan >= FA_READY_SPIN)
+	{
+	  /* Back off, without VME accesses */
+	  next = now + delay;
+	  while(now < next)
+	    now = faReadyNow();
+
+	  delay *= 2;
+	  if(delay > faReadyExpectNs)
+	    delay = (faReadyExpectNs > 200) ? faReadyExpectNs : 200;
+	}
+    }
+
+  wait = faReadyNow() - t0;
+  faReadyStats.events++;
+  faReadyStats.scans += nscan;
+  faReadyStats.waitNs += wait;
+  if(wait > faReadyStats.maxWaitNs)
+    faReadyStats.maxWaitNs = wait;
+  faReadyStats.nscan[(nscan < FA_READY_NHIST) ? nscan - 1 : FA_READY_NHIST - 1]++;
+
+  return datascan;
+}
+
+void
+faReadyPrintStats()
+{
+  int ii;
+
+  if(faReadyStats.events == 0)
+    return;
+
+  printf("%s: fADC250 block ready wait: %llu events, %llu timeouts\n",
+	 __func__, faReadyStats.events, faReadyStats.timeouts);
+  printf("    scans/event %.2f   wait avg %.2f us  max %.2f us\n",
+	 (double) faReadyStats.scans / faReadyStats.events,
+	 1e-3 * faReadyStats.waitNs / faReadyStats.events,
+	 1e-3 * faReadyStats.maxWaitNs);
+  printf("    scans:");
+  for(ii = 0; ii < FA_READY_NHIST; ii++)
+    if(faReadyStats.nscan[ii])
+      printf("  %d%s:%llu", ii + 1, (ii == FA_READY_NHIST - 1) ? "+" : "",
+	     faReadyStats.nscan[ii]);
+  printf("\n");
+
+  if(faReadyStats.timeouts)
+    daLogMsg("WARN", "fADC250 block ready timed out in %llu events",
+	     faReadyStats.timeouts);
+}
+
+/*
+  Rewrite the closed FADC bank at bank as FADC_PACK_BANK, if that makes
+  it smaller (fadc_pack = 2: and if it unpacks to the same words).
+  Returns the end of the bank.
+*/
+static unsigned int *
+fadcPackEvent(unsigned int *bank)
+{
+  int nin = bank[0] - 1, nout, ncheck;
+
+  fadcPackStats.events++;
+  fadcPackStats.wordsIn += nin;
+
+  nout = fadcPackBank(&bank[2], nin, fadcPackBuf, nin - 1);
+
+  if((nout > 0) && (fadc_pack > 1))
+    {
+      ncheck = fadcUnpackBank(fadcPackBuf, nout, fadcPackCheckBuf, nin);
+      if((ncheck != nin) ||
+	 (memcmp(fadcPackCheckBuf, &bank[2], nin * sizeof(unsigned int)) != 0))
+	{
+	  if(fadcPackStats.checkErrors++ == 0)
+	    daLogMsg("ERROR", "Packed FADC bank does not unpack to the FADC bank (event %d)",
+		     tiGetIntCount());
+	  nout = -1;
+	}
+    }
+
+  if(nout <= 0)
+    {
+      fadcPackStats.wordsOut += nin;
+      return &bank[2 + nin];
+    }
+
+  memcpy(&bank[2], fadcPackBuf, nout * sizeof(unsigned int));
+  bank[0] = nout + 1;
+  bank[1] = (FADC_PACK_BANK << 16) | (bank[1] & 0xffff);
+
+  fadcPackStats.packed++;
+  fadcPackStats.wordsOut += nout;
+
+  return &bank[2 + nout];
+}
+
+void
+fadcPackPrintStats()
+{
+  if(fadcPackStats.events == 0)
+    return;
+
+  printf("%s: FADC bank compaction: %llu of %llu events packed\n",
+	 __func__, fadcPackStats.packed, fadcPackStats.events);
+  printf("    words in %llu  out %llu  (%.2f : 1)\n",
+	 fadcPackStats.wordsIn, fadcPackStats.wordsOut,
+	 fadcPackStats.wordsOut ?
+	 (double) fadcPackStats.wordsIn / fadcPackStats.wordsOut : 0);
+
+  if(fadcPackStats.checkErrors)
+    daLogMsg("ERROR", "Packed FADC bank check failed in %llu events",
+	     fadcPackStats.checkErrors);
+}
+
 void
 rocTrigger(int arg)
 {
-  int ifa = 0, stat, nwords, dCnt;
+  int ifa = 0, stat, nwords, dCnt, room;
   unsigned int datascan, scanmask;
   int roType = 2, roCount = 0, blockError = 0;
-  int ii, islot;
+  int ii, islot, faAhead;
+  unsigned int fadcErrors = 0;
+  FADC_CHECK_RESULT fadcCheck;
+  unsigned long long t0 = 0;
+
+  ROC_TIMING_START;
+
+  /* Readout time of the block, for the levels of a rate target only */
+  if(rocTune.rate)
+    t0 = rocRingClock();
 
   roCount = tiGetIntCount();
 
+  /* FADC block read ahead into this event buffer (fapipeline): end of
+     its transfer, before the TI block transfer */
+  faAhead = fadcPipelineTake(the_event);
+
   /* Setup Address and data modes for DMA transfers
    *
    *  vmeDmaConfig(addrType, dataType, sstMode);
@@ -711,74 +1293,148 @@ rocTrigger(int arg)
    */
   vmeDmaConfig(2,5,1);
 
-  dCnt = tiReadTriggerBlock(dma_dabufp);
+  if(faAhead >= 0)
+    dCnt = fadcPipelineReadTrigger(dma_dabufp);
+  else
+    dCnt = tiReadTriggerBlock(dma_dabufp);
   if(dCnt<=0)
     {
       daLogMsg("ERROR","No TI Trigger data or error.  dCnt = %d\n",dCnt);
+      rocStatusError(roCount, dCnt, "No TI trigger data (dCnt = %d)", dCnt);
     }
   else
     {
-      dma_dabufp += dCnt;
+      rocEventCommit(dCnt);
     }
+  ROC_TIMING_MARK(ROC_STAGE_TI);
 
   /* fADC250 Readout */
+  unsigned int *fadcBank = dma_dabufp;
   BANKOPEN(FADC_BANK, BT_UI4, blockLevel);
 
   /* Mask of initialized modules */
   scanmask = faScanMask();
-  /* Check scanmask for block ready up to 100 times */
-  datascan = faGBlockReady(scanmask, 100);
+  if(faAhead >= 0)
+    datascan = scanmask;	/* Was ready when read ahead */
+  else
+    /* Wait for block ready, up to faReadyTimeoutNs */
+    datascan = faWaitBlockReady(scanmask);
   stat = (datascan == scanmask);
+  ROC_TIMING_MARK(ROC_STAGE_FA_READY);
+
+  if(nfadc == 1)
+    roType = 1;   /* otherwise roType = 2   multiboard reaodut with token passing */
 
   if(stat)
     {
-      if(nfadc == 1)
-	roType = 1;   /* otherwise roType = 2   multiboard reaodut with token passing */
-      nwords = faReadBlock(0, dma_dabufp, MAXFADCWORDS, roType);
+      /* Up to the room left in the event buffer */
+      room = rocEventReserve(MAXFADCWORDS);
+      if(faAhead >= 0)
+	{
+	  /* Token already reset by the transfer thread */
+	  nwords = fadcPipelinePlace(dma_dabufp, room, &blockError);
+	}
+      else
+	{
+	  nwords = faReadBlock(0, dma_dabufp, room, roType);
 
-      /* Check for ERROR in block read */
-      blockError = faGetBlockError(1);
+	  /* Check for ERROR in block read */
+	  blockError = faGetBlockError(1);
+	}
 
       if(blockError)
 	{
 	  daLogMsg("ERROR","fadc Slot %d: in transfer (event = %d), nwords = 0x%x\n",
 		 faSlot(ifa), roCount, nwords);
+	  rocStatusError(roCount, blockError, "fADC250 block error %d, nwords = 0x%x",
+			 blockError, nwords);
 
 	  for(ifa = 0; ifa < nfadc; ifa++)
 	    faResetToken(faSlot(ifa));
 
-	  if(nwords > 0)
-	    dma_dabufp += nwords;
+	  rocEventCommit(nwords);
+	  if(nwords >= room)
+	    rocEventTruncate();	/* Terminated by the word count */
 	}
       else
 	{
-	  dma_dabufp += nwords;
-	  faResetToken(faSlot(0));
+	  rocEventCommit(nwords);
+	  if(faAhead < 0)
+	    faResetToken(faSlot(0));
+	  if((faAhead >= 0) && (nwords >= room))
+	    rocEventTruncate();
 	}
     }
   else
     {
       daLogMsg("ERROR","Event %d: fadc Datascan != Scanmask  (0x%08x != 0x%08x)\n",
 	     roCount, datascan, scanmask);
+      rocStatusError(roCount, scanmask & ~datascan,
+		     "fADC250 not ready (datascan 0x%08x, scanmask 0x%08x)",
+		     datascan, scanmask);
     }
   BANKCLOSE;
+  ROC_TIMING_MARK(ROC_STAGE_FA_READ);
+
+  /* Next block, into the next event buffer, while this one is formatted */
+  if(fa_pipeline && stat && !blockError)
+    fadcPipelineNext(scanmask, (fadcBank + 2) - rocEventData(the_event),
+		     MAXFADCWORDS, roType);
+
+  /* A bad FADC bank is tagged, and left as read */
+  fadcErrors = 0;
+  if(fadc_check && stat)
+    {
+      fadcErrors = fadcCheckBank(&fadcBank[2], fadcBank[0] - 1, blockLevel,
+				 scanmask, &fadcCheck);
+      if(fadcErrors)
+	rocStatusError(roCount, fadcErrors,
+		       "Bad FADC block: errors 0x%x, slots 0x%06x, word %d",
+		       fadcCheck.errors, fadcCheck.slots, fadcCheck.offset);
+      ROC_TIMING_MARK(ROC_STAGE_FA_CHECK);
+    }
+
+  if(fadc_zs && !fadcErrors)
+    {
+      nwords = fadcSuppressBank(&fadcBank[2], fadcBank[0] - 1);
+      fadcBank[0] = nwords + 1;
+      dma_dabufp = &fadcBank[2 + nwords];
+      ROC_TIMING_MARK(ROC_STAGE_FA_ZS);
+    }
+
+  if(fadc_pack && !fadcErrors)
+    {
+      dma_dabufp = fadcPackEvent(fadcBank);
+      ROC_TIMING_MARK(ROC_STAGE_FA_PACK);
+    }
+
+  if(fadcErrors && (rocEventReserve(3) == 3))
+    {
+      BANKOPEN(FADC_CHECK_BANK, BT_UI4, 0);
+      *dma_dabufp++ = fadcCheck.errors;
+      *dma_dabufp++ = fadcCheck.slots;
+      *dma_dabufp++ = fadcCheck.offset;
+      BANKCLOSE;
+    }
 
 #ifdef VLD_READOUT
   if(vldGetNVLD() > 0)
     {
       BANKOPEN(VLD_BANK, BT_UI4, 0);
 
-      nwords = vldShmReadBlock(dma_dabufp, 256);
+      nwords = vldShmReadBlock(dma_dabufp, rocEventReserve(256));
       if(nwords > 0)
 	{
-	  dma_dabufp += nwords;
+	  rocEventCommit(nwords);
 	}
       else
 	{
 	  daLogMsg("ERROR","Event %d: Error in VLD readout\n", roCount);
+	  rocStatusError(roCount, nwords, "VLD readout error (%d)", nwords);
 	}
 
       BANKCLOSE;
+      ROC_TIMING_MARK(ROC_STAGE_VLD);
     }
 #endif
 
@@ -815,35 +1471,41 @@ rocTrigger(int arg)
 		}
 	    }
 	}
-
+      ROC_TIMING_MARK(ROC_STAGE_SYNC);
 
     }
 #ifdef FADC_SCALERS
-  if (scaler_period > 0) {
-    struct timespec now;
-    clock_gettime(CLOCK_REALTIME, &now);
-    if((scaler_period>0 &&
-	((now.tv_sec - last_time.tv_sec
-	  + ((double)now.tv_nsec - (double)last_time.tv_nsec)/1000000000L) >= scaler_period))) {
-#define FADC_SCALER_BANKS
+  /* Latest snapshot from the scaler sampler thread */
+  if(scalerSampler.ready)
+    {
+      pthread_mutex_lock(&scalerSampler.lock);
 #ifdef FADC_SCALER_BANKS
+      int front = scalerSampler.front;
       BANKOPEN(9250,BT_UI4,0);
-      read_fadc_scalers(&dma_dabufp,0);
+      nwords = rocEventReserve(scalerSampler.nfadc_words[front]);
+      memcpy(dma_dabufp, scalerSampler.fadc[front], nwords << 2);
+      rocEventCommit(nwords);
+      if(nwords < scalerSampler.nfadc_words[front])
+	rocEventTruncate();
       BANKCLOSE;
       BANKOPEN(9001,BT_UI4,syncFlag);
-      read_ti_scalers(&dma_dabufp,0);
+      nwords = rocEventReserve(scalerSampler.nti_words[front]);
+      memcpy(dma_dabufp, scalerSampler.ti[front], nwords << 2);
+      rocEventCommit(nwords);
+      if(nwords < scalerSampler.nti_words[front])
+	rocEventTruncate();
       BANKCLOSE;
-#else
-      read_fadc_scalers(0,0);
-      read_ti_scalers(0,0);
 #endif
-      last_time = now;
-      read_clock_channels();
+      scalerSampler.ready = 0;
+      scalerSampler.ninserted++;
+      pthread_mutex_unlock(&scalerSampler.lock);
+      ROC_TIMING_MARK(ROC_STAGE_SCALER);
     }
-  }
 #endif
 
-
+  if(rocTune.rate)
+    rocTuneBlock(rocRingClock() - t0);
+  ROC_TIMING_STOP;
 }
 
 void
@@ -856,9 +1518,14 @@ void
 rocCleanup()
 {
 
+  fadcPipelineStop(1);
+
   printf("%s: Reset all FADCs\n",__FUNCTION__);
   faGReset(1);
 
+  /* Let a configuration file write finish before unloading */
+  configWriterWait();
+
 #ifdef TI_MASTER
   tiResetSlaveConfig();
 #endif
@@ -897,19 +1564,183 @@ rocSetTriggerSource(int source)
 #endif
 }
 
+/*
+  Configuration dump to file
+    The file is written by a writer thread, so that a slow NFS server
+    does not stall Prestart.  The thread is joined by the next one and by
+    rocCleanup (configWriterWait).  A dump with the same content as the
+    last one queued is not written again.  If a write is still in
+    progress, only the most recent dump is kept for the next write.
+*/
+static struct
+{
+  pthread_mutex_t lock;
+  int busy;			/* Writer thread running */
+  int started;			/* Writer thread not joined yet */
+  pthread_t thread;
+  char *pending;		/* File content to write (malloc'd), or NULL */
+  size_t pending_len;
+  char pending_file[256];
+  unsigned long long pending_hash;
+  unsigned long long queued_hash;	/* Last dump queued (0 = none / failed) */
+} configWriter = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* 64 bit FNV-1a */
+static unsigned long long
+configHash(unsigned long long h, const char *s)
+{
+  if(h == 0)
+    h = 0xcbf29ce484222325ULL;
+
+  while(*s)
+    {
+      h ^= (unsigned char) *s++;
+      h *= 0x100000001b3ULL;
+    }
+
+  return h;
+}
+
+static void *
+configWriterThread(void *arg)
+{
+  char *buf, filename[256];
+  size_t len;
+  unsigned long long hash;
+  FILE *out_fd;
+
+  while(1)
+    {
+      pthread_mutex_lock(&configWriter.lock);
+      buf = configWriter.pending;
+      if(buf == NULL)
+	{
+	  configWriter.busy = 0;
+	  pthread_mutex_unlock(&configWriter.lock);
+	  break;
+	}
+      len = configWriter.pending_len;
+      hash = configWriter.pending_hash;
+      strcpy(filename, configWriter.pending_file);
+      configWriter.pending = NULL;
+      pthread_mutex_unlock(&configWriter.lock);
+
+      out_fd = fopen(filename, "w+");
+      if((out_fd == NULL) || (fwrite(buf, 1, len, out_fd) != len))
+	{
+	  perror("configWriterThread");
+	  daLogMsg("WARN", "Unable to write configuration to %s", filename);
+
+	  /* Try again at the next Prestart */
+	  pthread_mutex_lock(&configWriter.lock);
+	  if(configWriter.queued_hash == hash)
+	    configWriter.queued_hash = 0;
+	  pthread_mutex_unlock(&configWriter.lock);
+	}
+
+      if(out_fd != NULL)
+	fclose(out_fd);
+      free(buf);
+    }
+
+  return NULL;
+}
+
+/* Queue buf (malloc'd, taken over) to be written to filename */
+static void
+configWriterQueue(const char *filename, char *buf, size_t len, unsigned long long hash)
+{
+  pthread_mutex_lock(&configWriter.lock);
+
+  if(hash == configWriter.queued_hash)
+    {
+      pthread_mutex_unlock(&configWriter.lock);
+      printf("%s: Configuration unchanged, %s not rewritten\n", __func__, filename);
+      free(buf);
+      return;
+    }
+
+  if(configWriter.pending != NULL)
+    free(configWriter.pending);
+
+  configWriter.pending = buf;
+  configWriter.pending_len = len;
+  configWriter.pending_hash = hash;
+  configWriter.queued_hash = hash;
+  snprintf(configWriter.pending_file, sizeof(configWriter.pending_file), "%s", filename);
+
+  if(!configWriter.busy)
+    {
+      /* The last writer has cleared busy and is only returning */
+      if(configWriter.started)
+	pthread_join(configWriter.thread, NULL);
+      configWriter.started = 0;
+
+      if(pthread_create(&configWriter.thread, NULL, configWriterThread, NULL) == 0)
+	{
+	  configWriter.started = 1;
+	  configWriter.busy = 1;
+	}
+      else
+	{
+	  perror("pthread_create");
+	  free(configWriter.pending);
+	  configWriter.pending = NULL;
+	  configWriter.queued_hash = 0;
+	}
+    }
+
+  pthread_mutex_unlock(&configWriter.lock);
+}
+
+/* Wait for the writer thread to finish, however long the write takes */
+void
+configWriterWait()
+{
+  int started, busy;
+
+  pthread_mutex_lock(&configWriter.lock);
+  started = configWriter.started;
+  busy = configWriter.busy;
+  configWriter.started = 0;
+  pthread_mutex_unlock(&configWriter.lock);
+
+  if(busy)
+    printf("%s: Waiting for the configuration file write\n", __func__);
+
+  if(started)
+    pthread_join(configWriter.thread, NULL);
+}
+
 void
 writeConfigToFile()
 {
-  int maxsize = 30000;
-  char *str;
+  int maxsize = 32768, len;
+  char *str, *buf;
 
-  str = malloc(maxsize * sizeof(char));
-  if(str == NULL)
+  /* Grow the buffer until the configuration fits (up to 4 MB, the limit
+     of rocBuffer2Bank) */
+  while(1)
     {
-      printf("%s: ERROR: Out of Memory\n", __func__);
-      return;
+      str = malloc(maxsize * sizeof(char));
+      if(str == NULL)
+	{
+	  printf("%s: ERROR: Out of Memory\n", __func__);
+	  return;
+	}
+      str[0] = '\0';
+      fadc250UploadAll(str, maxsize);
+
+      len = strlen(str);
+      if((len < maxsize - 1) || (maxsize >= 4 * 1024 * 1024))
+	break;
+
+      free(str);
+      maxsize *= 2;
     }
-  fadc250UploadAll(str, maxsize);
+
+  if(len >= maxsize - 1)
+    daLogMsg("WARN", "Configuration truncated at %d bytes", len);
 
   /* Add configuration files to user event type 137 */
 
@@ -946,27 +1777,41 @@ writeConfigToFile()
   strcat(out_config_filename, host);
   strcat(out_config_filename, ".dat");
 
-  FILE *out_fd = fopen(out_config_filename, "w+");
-
-  if(out_fd != NULL)
-    {
-      /* This is who we are */
-      fprintf(out_fd, "# host: %s\n", host);
-      fprintf(out_fd, "# ROCID: %d\n", ROCID);
-      fprintf(out_fd, "# Runnumber: %d\n", rol->runNumber);
-      fprintf(out_fd, "# RunType: %d\n", rol->runType);
-      fprintf(out_fd, "# usrString: %s\n", rol->usrString);
-      fprintf(out_fd, "# usrConfig: %s\n", rol->usrConfig);
-      fprintf(out_fd, "# FA250 Config: %s\n", fa250_config_file);
-      fprintf(out_fd, "%s\n", str);
-
-      fclose(out_fd);
-    }
-  else
+  /* File content: who we are, then the configuration */
+  int bufsize = len + 4096;
+  buf = malloc(bufsize);
+  if(buf == NULL)
     {
-      perror("fopen");
+      printf("%s: ERROR: Out of Memory\n", __func__);
+      free(str);
+      return;
     }
 
+  int buflen = snprintf(buf, bufsize,
+			"# host: %s\n"
+			"# ROCID: %d\n"
+			"# Runnumber: %d\n"
+			"# RunType: %d\n"
+			"# usrString: %.1000s\n"
+			"# usrConfig: %.1000s\n"
+			"# FA250 Config: %s\n"
+			"%s\n",
+			host, ROCID, rol->runNumber, rol->runType,
+			rol->usrString, rol->usrConfig, fa250_config_file, str);
+  if(buflen >= bufsize)
+    buflen = bufsize - 1;
+
+  /* Content hash, without the run number */
+  unsigned long long hash = configHash(0, str);
+  hash = configHash(hash, rol->usrString);
+  hash = configHash(hash, rol->usrConfig);
+  hash = configHash(hash, fa250_config_file);
+  hash = configHash(hash, out_config_filename);
+  if(hash == 0)
+    hash = 1;
+
+  configWriterQueue(out_config_filename, buf, buflen, hash);
+
   free(str);
 }
 
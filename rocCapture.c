@@ -0,0 +1,157 @@
+/*************************************************************************
+ *
+ *  rocCapture.c - Capture the event buffers handed from asyncTrigger to
+ *                 usrtrig into a memory mapped file (see rocCapture.h),
+ *                 for replay off-line with rocsim -P.
+ *
+ *   The disk space of the file (maxbytes) is allocated when opened, so
+ *   that a full file system fails at Go and not in the readout thread
+ *   (SIGBUS on a store to the mapping).  The file is mapped with its
+ *   pages faulted in, and filled by the readout thread with a memcpy
+ *   per event.  When it is full, capturing stops for the rest of the
+ *   run.  It is trimmed to the captured length when closed.
+ *
+ *   Usage:
+ *
+ *     rocGo:         rocCaptureOpen(filename, ROCID, runNumber, blockLevel, maxbytes);
+ *     asyncTrigger:  rocCaptureEvent(the_event);
+ *     __end:         rocCaptureClose();   (after tiIntDisable)
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rocCapture.h"
+
+static struct
+{
+  int fd;
+  char *map;			/* Mapped file */
+  size_t size;			/* Size of the mapping */
+  size_t used;			/* Bytes written, header included */
+  ROC_CAPTURE_HEADER *hdr;
+  int full;
+} rocCap = { -1, NULL, 0, 0, NULL, 0 };
+
+int rocCaptureClose();
+
+int
+rocCaptureOpen(const char *filename, int rocid, int runNumber,
+	       int blockLevel, size_t maxbytes)
+{
+  if(rocCap.map != NULL)
+    rocCaptureClose();
+
+  if(maxbytes < sizeof(ROC_CAPTURE_HEADER))
+    return ERROR;
+
+  rocCap.fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(rocCap.fd < 0)
+    {
+      perror("open");
+      daLogMsg("ERROR", "Unable to open capture file %s", filename);
+      return ERROR;
+    }
+
+  /* posix_fallocate returns the error, errno is not set */
+  errno = posix_fallocate(rocCap.fd, 0, maxbytes);
+  if(errno != 0)
+    {
+      perror("posix_fallocate");
+      daLogMsg("ERROR", "Unable to allocate %lu MB for capture file %s",
+	       (unsigned long) (maxbytes >> 20), filename);
+      close(rocCap.fd);
+      unlink(filename);
+      rocCap.fd = -1;
+      return ERROR;
+    }
+
+  rocCap.map = mmap(NULL, maxbytes, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, rocCap.fd, 0);
+  if(rocCap.map == MAP_FAILED)
+    {
+      perror("mmap");
+      close(rocCap.fd);
+      rocCap.fd = -1;
+      rocCap.map = NULL;
+      return ERROR;
+    }
+
+  rocCap.size = maxbytes;
+  rocCap.used = sizeof(ROC_CAPTURE_HEADER);
+  rocCap.full = 0;
+
+  rocCap.hdr = (ROC_CAPTURE_HEADER *) rocCap.map;
+  memset(rocCap.hdr, 0, sizeof(ROC_CAPTURE_HEADER));
+  rocCap.hdr->magic = ROC_CAPTURE_MAGIC;
+  rocCap.hdr->version = ROC_CAPTURE_VERSION;
+  rocCap.hdr->rocid = rocid;
+  rocCap.hdr->runNumber = runNumber;
+  rocCap.hdr->blockLevel = blockLevel;
+  rocCap.hdr->headerBytes = sizeof(ROC_CAPTURE_HEADER);
+  rocCap.hdr->startTime = time(NULL);
+
+  daLogMsg("INFO", "Capturing event buffers to %s (max %lu MB)", filename,
+	   (unsigned long) (maxbytes >> 20));
+
+  return OK;
+}
+
+/* Append the event in node ev (length already set) */
+static inline void
+rocCaptureEvent(DMANODE *ev)
+{
+  ROC_CAPTURE_RECORD *rec;
+  size_t nbytes;
+
+  if((rocCap.map == NULL) || rocCap.full)
+    return;
+
+  nbytes = sizeof(ROC_CAPTURE_RECORD) + ev->length * sizeof(uint32_t);
+  if(rocCap.used + nbytes > rocCap.size)
+    {
+      rocCap.full = 1;
+      daLogMsg("WARN", "Capture file full after %llu events",
+	       (unsigned long long) rocCap.hdr->nrecords);
+      return;
+    }
+
+  rec = (ROC_CAPTURE_RECORD *) (rocCap.map + rocCap.used);
+  rec->nwords = ev->length;
+  rec->type = ev->type;
+  rec->nevent = ev->nevent;
+  rec->reserved = 0;
+  memcpy(rec + 1, rocEventData(ev), ev->length * sizeof(uint32_t));
+
+  rocCap.used += nbytes;
+  rocCap.hdr->nrecords++;
+  rocCap.hdr->nbytes = rocCap.used - sizeof(ROC_CAPTURE_HEADER);
+}
+
+int
+rocCaptureClose()
+{
+  unsigned long long nrecords;
+
+  if(rocCap.map == NULL)
+    return OK;
+
+  nrecords = rocCap.hdr->nrecords;
+
+  munmap(rocCap.map, rocCap.size);
+  if(ftruncate(rocCap.fd, rocCap.used) < 0)
+    perror("ftruncate");
+  close(rocCap.fd);
+
+  daLogMsg("INFO", "Captured %llu event buffers (%lu MB)", nrecords,
+	   (unsigned long) (rocCap.used >> 20));
+
+  rocCap.fd = -1;
+  rocCap.map = NULL;
+  rocCap.hdr = NULL;
+  rocCap.size = rocCap.used = 0;
+
+  return OK;
+}
@@ -0,0 +1,48 @@
+/*************************************************************************
+ *
+ *  rocCapture.h - Layout of the event capture file written by the
+ *                 readout list (rocCapture.c) and replayed by rocsim -P.
+ *
+ *   The file is a ROC_CAPTURE_HEADER, followed by one record for each
+ *   event buffer handed to usrtrig:
+ *
+ *      ROC_CAPTURE_RECORD    nwords, type (sync flag), nevent
+ *      nwords x uint32       the event buffer (DMANODE data), i.e. the
+ *                            TI trigger bank, FADC bank, VLD bank, ...
+ *
+ *   Words are in host byte order.  nbytes in the header is the length of
+ *   the records; a file cut short by a crash can be read up to there.
+ *
+ */
+
+#ifndef __ROCCAPTURE_H__
+#define __ROCCAPTURE_H__
+
+#include <stdint.h>
+
+#define ROC_CAPTURE_MAGIC    0x524f4343	/* "ROCC" */
+#define ROC_CAPTURE_VERSION  1
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t rocid;
+  int32_t runNumber;
+  int32_t blockLevel;
+  uint32_t headerBytes;		/* sizeof(ROC_CAPTURE_HEADER) */
+  volatile uint64_t nbytes;	/* Bytes of records after the header */
+  volatile uint64_t nrecords;	/* Number of records */
+  uint64_t startTime;		/* Time the capture was opened (s since epoch) */
+  uint32_t reserved[6];
+} ROC_CAPTURE_HEADER;
+
+typedef struct
+{
+  uint32_t nwords;		/* Words of event data after this record */
+  uint32_t type;		/* Sync flag of the event */
+  uint32_t nevent;		/* TI interrupt count */
+  uint32_t reserved;
+} ROC_CAPTURE_RECORD;
+
+#endif /* __ROCCAPTURE_H__ */
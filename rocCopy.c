@@ -0,0 +1,80 @@
+/*************************************************************************
+ *
+ *  rocCopy.c - Bulk copy of event data into the ROC output buffer
+ *
+ *   Events smaller than rocCopyStreamWords are copied with memcpy.
+ *   Larger events are copied with SSE2 non-temporal (streaming) stores,
+ *   so that a large block does not evict the rest of the cache on its
+ *   way to the output buffer.
+ *
+ *   Usage:
+ *
+ *     rol->dabufp = rocCopyWords(rol->dabufp, rocEventData(outEvent), len);
+ *
+ *   Included by the primary (tiprimary_list.c) and secondary
+ *   (event_list.crl) readout lists, each with its own copy.
+ *
+ */
+
+#include <string.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Event size (words) from which streaming stores are used.  0 = never */
+static unsigned int rocCopyStreamWords = 256 * 1024;
+
+#ifdef __SSE2__
+static unsigned int *
+rocCopyStream(unsigned int *dst, const unsigned int *src, int nwords)
+{
+  /* Align the destination to 16 bytes */
+  while((nwords > 0) && (((uintptr_t) dst) & 0xf))
+    {
+      *dst++ = *src++;
+      nwords--;
+    }
+
+  /* 64 bytes per iteration */
+  while(nwords >= 16)
+    {
+      __m128i r0 = _mm_loadu_si128((const __m128i *) (src));
+      __m128i r1 = _mm_loadu_si128((const __m128i *) (src + 4));
+      __m128i r2 = _mm_loadu_si128((const __m128i *) (src + 8));
+      __m128i r3 = _mm_loadu_si128((const __m128i *) (src + 12));
+      _mm_stream_si128((__m128i *) (dst), r0);
+      _mm_stream_si128((__m128i *) (dst + 4), r1);
+      _mm_stream_si128((__m128i *) (dst + 8), r2);
+      _mm_stream_si128((__m128i *) (dst + 12), r3);
+      src += 16;
+      dst += 16;
+      nwords -= 16;
+    }
+
+  while(nwords-- > 0)
+    *dst++ = *src++;
+
+  /* Make the streamed data visible before the bank is closed */
+  _mm_sfence();
+
+  return dst;
+}
+#endif
+
+/* Copy nwords from src to dst.  Returns the dst word after the copy. */
+static inline unsigned int *
+rocCopyWords(unsigned int *dst, const volatile unsigned int *src, int nwords)
+{
+  if(nwords <= 0)
+    return dst;
+
+#ifdef __SSE2__
+  if(rocCopyStreamWords && (nwords >= rocCopyStreamWords))
+    return rocCopyStream(dst, (const unsigned int *) src, nwords);
+#endif
+
+  memcpy(dst, (const void *) src, nwords << 2);
+
+  return dst + nwords;
+}
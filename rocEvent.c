@@ -0,0 +1,221 @@
+/*************************************************************************
+ *
+ *  rocEvent.c - Bounds of the event buffer filled by rocTrigger: a guard
+ *               page at the end of each event buffer, and the room left
+ *               for each bank (reserve / commit).
+ *
+ *   The last whole page of each node of the event ring is made
+ *   inaccessible (mprotect), so that a write past the end of an event
+ *   buffer faults instead of overwriting the next node.  The guard page
+ *   only stops the CPU: block transfers are bounded by the room given
+ *   to faReadBlock / vldShmReadBlock.
+ *
+ *   rocTrigger asks for the room of each bank before it is filled, and
+ *   moves dma_dabufp with the words written.  A readout that did not fit
+ *   is cut to the room left, and the event gets a ROC_TRUNC_BANK at its
+ *   end (asyncTrigger):
+ *
+ *     word 0   number of readouts cut short in the event
+ *     word 1   event buffer size (words)
+ *
+ *   ROC_EVENT_SLACK words at the end of the buffer are kept out of the
+ *   room, for bank headers, small fixed banks and the ROC_TRUNC_BANK.
+ *
+ *   The event data starts at rocEventData(node), aligned to a cache line
+ *   (or a page, rocEventPageAlign) after the node header.
+ *
+ *   Usage:
+ *
+ *     Prestart, after rocRingInit:    rocEventGuard(&eventRing, 1);
+ *     Before the nodes are freed:     rocEventGuard(&eventRing, 0);
+ *
+ *     asyncTrigger:  dma_dabufp = rocEventData(the_event);
+ *                    rocEventBegin(the_event);
+ *                      rocTrigger();
+ *                    rocEventEnd(the_event);
+ *
+ *     rocTrigger:    room = rocEventReserve(maxwords);
+ *                    nwords = xxReadBlock(dma_dabufp, room);
+ *                    rocEventCommit(nwords);
+ *                    if(readout was cut short) rocEventTruncate();
+ *
+ */
+
+#include <sys/mman.h>
+
+#define ROC_TRUNC_BANK    0xff0	/* Event cut to the event buffer size */
+#define ROC_EVENT_SLACK   32	/* Words kept for bank headers and ROC_TRUNC_BANK */
+#define ROC_EVENT_ALIGN   64	/* Alignment of the event data in a node (bytes) */
+
+/* Bytes added to each event buffer: the guard page (and its alignment),
+   the alignment of the event data and the slack */
+#define ROC_EVENT_EXTRA_BYTES						\
+  (2 * sysconf(_SC_PAGESIZE) + rocEvt.align + 4 * ROC_EVENT_SLACK)
+
+static struct
+{
+  int guarded;			/* Guard pages set */
+  unsigned long align;		/* Of the event data: ROC_EVENT_ALIGN or a page */
+  unsigned int *limit;		/* End of the room in the event being filled */
+  int truncated;		/* Readouts cut short in this event */
+  unsigned long long ntruncated;	/* Events cut short since Go */
+} rocEvt = { 0, ROC_EVENT_ALIGN, NULL, 0, 0 };
+
+/*
+  Layout of the event buffers for huge page backed memory (on = 1): the
+  event data starts on a page and the buffers are a whole number of
+  pages, without guard pages (mprotect of one page would split the huge
+  page, or fail).  Takes effect with the next rocSetEventPool.
+*/
+void
+rocEventPageAlign(int on)
+{
+  rocEvt.align = on ? sysconf(_SC_PAGESIZE) : ROC_EVENT_ALIGN;
+}
+
+/* Start of the event data in node */
+static inline unsigned int *
+rocEventData(DMANODE *node)
+{
+  return (unsigned int *) (((unsigned long) &node->data[0] + rocEvt.align - 1)
+			   & ~(rocEvt.align - 1));
+}
+
+/* The guard page of node: its last whole page, NULL if none */
+static char *
+rocEventGuardPage(DMANODE *node)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned long end = (unsigned long) node + node->part->size;
+  char *guard = (char *) ((end & ~(page - 1)) - page);
+
+  if(guard < (char *) &node->data[0])
+    return NULL;
+
+  return guard;
+}
+
+/* End of the data of node: its guard page, or the end of the node */
+static unsigned int *
+rocEventNodeEnd(DMANODE *node)
+{
+  char *guard = rocEventGuardPage(node);
+
+  if(rocEvt.guarded && guard)
+    return (unsigned int *) guard;
+
+  return (unsigned int *) ((char *) node + node->part->size);
+}
+
+/*
+  Protect (on = 1) or unprotect (on = 0) the guard page of each node of
+  the ring.  Must be unprotected before the nodes are freed.
+*/
+int
+rocEventGuard(ROC_RING *r, int on)
+{
+  long page = sysconf(_SC_PAGESIZE);
+  unsigned int inode, nguard = 0;
+  char *guard;
+
+  if(!on && !rocEvt.guarded)
+    return OK;
+
+  /* No guard pages in huge pages */
+  if(on && (rocEvt.align > ROC_EVENT_ALIGN))
+    return OK;
+
+  for(inode = 0; inode < r->nnode; inode++)
+    {
+      guard = rocEventGuardPage(r->node[inode]);
+      if(guard == NULL)
+	continue;
+
+      if(mprotect(guard, page, on ? PROT_NONE : (PROT_READ | PROT_WRITE)) < 0)
+	{
+	  perror("mprotect");
+	  if(on)
+	    {
+	      daLogMsg("WARN", "Unable to set the event buffer guard pages");
+	      rocEventGuard(r, 0);
+	      return ERROR;
+	    }
+	}
+      nguard++;
+    }
+
+  rocEvt.guarded = on && (nguard > 0);
+
+  return OK;
+}
+
+static inline void
+rocEventBegin(DMANODE *node)
+{
+  rocEvt.limit = rocEventNodeEnd(node) - ROC_EVENT_SLACK;
+  rocEvt.truncated = 0;
+}
+
+/* Words that may be written at dma_dabufp for a readout of up to maxwords */
+static inline int
+rocEventReserve(int maxwords)
+{
+  long room = rocEvt.limit - dma_dabufp;
+
+  if(room < 0)
+    room = 0;
+
+  return (maxwords < room) ? maxwords : room;
+}
+
+/* Words that may be written at data in node, for up to maxwords (a
+   readout into the next event's buffer, before rocEventBegin) */
+static inline int
+rocEventReserveAt(DMANODE *node, unsigned int *data, int maxwords)
+{
+  long room = (rocEventNodeEnd(node) - ROC_EVENT_SLACK) - data;
+
+  if(room < 0)
+    room = 0;
+
+  return (maxwords < room) ? maxwords : room;
+}
+
+/* Readout cut short to the room given */
+static inline void
+rocEventTruncate()
+{
+  rocEvt.truncated++;
+}
+
+/* nwords written at dma_dabufp.  More than the room is cut short */
+static inline void
+rocEventCommit(int nwords)
+{
+  if(nwords <= 0)
+    return;
+
+  dma_dabufp += nwords;
+  if(dma_dabufp > rocEvt.limit)
+    {
+      dma_dabufp = rocEvt.limit;
+      rocEventTruncate();
+    }
+}
+
+static inline void
+rocEventEnd(DMANODE *node)
+{
+  if(rocEvt.truncated == 0)
+    return;
+
+  if(rocEvt.ntruncated++ == 0)
+    daLogMsg("ERROR", "Event %ld cut to the event buffer size (%ld words)",
+	     node->nevent,
+	     (long) (rocEventNodeEnd(node) - rocEventData(node)));
+
+  BANKOPEN(ROC_TRUNC_BANK, BT_UI4, 0);
+  *dma_dabufp++ = rocEvt.truncated;
+  *dma_dabufp++ = rocEventNodeEnd(node) - rocEventData(node);
+  BANKCLOSE;
+}
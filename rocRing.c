@@ -0,0 +1,349 @@
+/*************************************************************************
+ *
+ *  rocRing.c - Lock-free single producer / single consumer ring of event
+ *              buffers, for the handoff of events from the readout thread
+ *              (asyncTrigger) to the CODA thread (usrtrig).
+ *
+ *   The ring owns every node of the vmeIN partition, in a fixed order.
+ *   The producer fills the node at head and publishes it by advancing
+ *   head, the consumer copies out the node at tail and frees it by
+ *   advancing tail.  Neither side takes a lock; a futex on tail is used
+ *   only when the producer has to wait for a free node.
+ *
+ *   With rocRingWake set (rocRingWakeConsumer), the consumer may also
+ *   sleep on head when the ring is empty, after spinning a while, and
+ *   the producer wakes it when it publishes a node (rocRingWaitFilled).
+ *   Each node is then stamped when published, for the handoff latency.
+ *
+ *   Usage (see tiprimary_list.c):
+ *
+ *     rocRingInit(&eventRing, vmeIN);       Prestart: take all nodes
+ *
+ *     the_event = rocRingGet(&eventRing);   Producer: next free node
+ *       ... fill ...
+ *     rocRingPut(&eventRing);                         publish it
+ *     rocRingWaitFree(&eventRing);                    wait if full
+ *
+ *     rocRingRelease(&eventRing);           End / Reset: no more waits
+ *
+ *     node = rocRingPeek(&eventRing);       Consumer: oldest event
+ *       ... copy out ...
+ *     rocRingFree(&eventRing);                        free it
+ *
+ *     node = rocRingPeekAt(&eventRing, i);  Consumer: i-th oldest, i < count
+ *     rocRingFreeN(&eventRing, n);                    free the n oldest
+ *
+ *     rocRingWakeConsumer(&eventRing, 1);   Go: consumer may sleep
+ *     rocRingWaitFilled(&eventRing, spin, sleep);  Consumer: wait for an event
+ *
+ */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#define ROC_RING_MAX   256	/* Maximum number of event buffers */
+
+typedef struct
+{
+  /* Written by the producer only */
+  volatile unsigned int head __attribute__ ((aligned(64)));
+  unsigned int headIndex;	/* node[] index of head */
+
+  /* Written by the consumer only */
+  volatile unsigned int tail __attribute__ ((aligned(64)));
+  unsigned int tailIndex;	/* node[] index of tail */
+
+  /* Set by the producer while it sleeps on tail */
+  volatile int waiting __attribute__ ((aligned(64)));
+  volatile int release;		/* End / Reset: the producer stops waiting */
+
+  /* Set by the consumer while it sleeps on head */
+  volatile int cwaiting __attribute__ ((aligned(64)));
+  int wake;			/* Consumer may sleep: producer checks cwaiting */
+
+  unsigned int nnode;
+  DMANODE *node[ROC_RING_MAX];
+  unsigned long long stamp[ROC_RING_MAX];	/* Monotonic ns, when published (wake) */
+} ROC_RING;
+
+static inline unsigned long long
+rocRingClock()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void
+rocRingRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline long
+rocFutexWait(volatile unsigned int *addr, unsigned int val, long timeout_ns)
+{
+  struct timespec ts = { timeout_ns / 1000000000L, timeout_ns % 1000000000L };
+
+  return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static inline long
+rocFutexWake(volatile unsigned int *addr)
+{
+  return syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/* Take ownership of all of the free nodes in pPart.  Returns the number
+   of nodes in the ring. */
+int
+rocRingInit(ROC_RING *r, DMA_MEM_ID pPart)
+{
+  DMANODE *node;
+
+  r->head = r->tail = 0;
+  r->headIndex = r->tailIndex = 0;
+  r->waiting = 0;
+  r->release = 0;
+  r->cwaiting = 0;
+  r->nnode = 0;
+
+  while((r->nnode < ROC_RING_MAX) && ((node = dmaPGetItem(pPart)) != NULL))
+    {
+      node->length = 0;
+      node->type = 0;
+      r->node[r->nnode++] = node;
+    }
+
+  return r->nnode;
+}
+
+/* Give all nodes back to their partition */
+void
+rocRingClose(ROC_RING *r)
+{
+  unsigned int inode;
+
+  for(inode = 0; inode < r->nnode; inode++)
+    dmaPFreeItem(r->node[inode]);
+
+  r->nnode = 0;
+  r->head = r->tail = 0;
+  r->headIndex = r->tailIndex = 0;
+}
+
+/* Number of filled nodes, not yet freed by the consumer */
+static inline unsigned int
+rocRingCount(ROC_RING *r)
+{
+  return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)
+    - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/* Producer: next free node, or NULL if the ring is full */
+static inline DMANODE *
+rocRingGet(ROC_RING *r)
+{
+  if(r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nnode)
+    return NULL;
+
+  return r->node[r->headIndex];
+}
+
+/* Producer: the free node after the one from rocRingGet (the next
+   event's), or NULL if there is none */
+static inline DMANODE *
+rocRingGetNext(ROC_RING *r)
+{
+  unsigned int next = r->headIndex + 1;
+
+  if(r->head + 1 - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nnode)
+    return NULL;
+
+  return r->node[(next == r->nnode) ? 0 : next];
+}
+
+/* Producer: publish the node from rocRingGet to the consumer, wake the
+   consumer if it sleeps (and stamp the node, with rocRingWake only) */
+static inline void
+rocRingPut(ROC_RING *r)
+{
+  if(!r->wake)
+    {
+      if(++r->headIndex == r->nnode)
+	r->headIndex = 0;
+      __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+      return;
+    }
+
+  r->stamp[r->headIndex] = rocRingClock();
+  if(++r->headIndex == r->nnode)
+    r->headIndex = 0;
+
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&r->cwaiting, __ATOMIC_SEQ_CST))
+    rocFutexWake(&r->head);
+}
+
+/* Producer: true if there is no free node */
+static inline int
+rocRingFull(ROC_RING *r)
+{
+  return (r->head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= r->nnode);
+}
+
+/* Producer: sleep until the consumer frees a node */
+void
+rocRingWaitFree(ROC_RING *r)
+{
+  unsigned int tail;
+
+  while(1)
+    {
+      __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+      tail = __atomic_load_n(&r->tail, __ATOMIC_SEQ_CST);
+      if((r->head - tail < r->nnode) ||
+	 __atomic_load_n(&r->release, __ATOMIC_SEQ_CST))
+	break;
+
+      /* No cancellation point: the producer holds the interrupt lock
+	 (INTLOCK), see rocRingRelease */
+      rocFutexWait(&r->tail, tail, 100000000L);
+    }
+
+  __atomic_store_n(&r->waiting, 0, __ATOMIC_RELAXED);
+}
+
+/*
+  End / Reset: the producer stops waiting for a free node (and does not
+  wait again until rocRingInit), so that the readout thread leaves
+  asyncTrigger, and INTLOCK, without the consumer.  Before the readout
+  thread is stopped: cancelled in its wait, it would keep INTLOCK.
+*/
+void
+rocRingRelease(ROC_RING *r)
+{
+  __atomic_store_n(&r->release, 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST))
+    rocFutexWake(&r->tail);
+}
+
+/* Consumer: oldest filled node, or NULL if the ring is empty */
+static inline DMANODE *
+rocRingPeek(ROC_RING *r)
+{
+  if(__atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == r->tail)
+    return NULL;
+
+  return r->node[r->tailIndex];
+}
+
+/* Let the consumer sleep in rocRingWaitFilled (on = 1), or not.  Only
+   with the consumer stopped (Go, End). */
+void
+rocRingWakeConsumer(ROC_RING *r, int on)
+{
+  r->wake = on;
+  r->cwaiting = 0;
+}
+
+/*
+  Consumer: wait for a filled node.  Spins for spinNs, then sleeps until
+  the producer publishes one (rocRingWakeConsumer), up to sleepNs.
+  Returns the number of filled nodes, 0 if none came.
+*/
+static unsigned int
+rocRingWaitFilled(ROC_RING *r, long spinNs, long sleepNs)
+{
+  unsigned long long end;
+  unsigned int head, n, ispin = 0;
+
+  if((n = rocRingCount(r)) != 0)
+    return n;
+
+  if(spinNs > 0)
+    {
+      end = rocRingClock() + spinNs;
+      while(1)
+	{
+	  rocRingRelax();
+	  if((n = rocRingCount(r)) != 0)
+	    return n;
+	  /* The clock every 64 spins */
+	  if(((++ispin & 63) == 0) && (rocRingClock() >= end))
+	    break;
+	}
+    }
+
+  if(!r->wake || (sleepNs <= 0))
+    return 0;
+
+  __atomic_store_n(&r->cwaiting, 1, __ATOMIC_SEQ_CST);
+  head = __atomic_load_n(&r->head, __ATOMIC_SEQ_CST);
+  if(head == r->tail)
+    rocFutexWait(&r->head, head, sleepNs);
+  __atomic_store_n(&r->cwaiting, 0, __ATOMIC_RELAXED);
+
+  return rocRingCount(r);
+}
+
+/* Consumer: monotonic ns when the i-th oldest filled node was published */
+static inline unsigned long long
+rocRingStampAt(ROC_RING *r, unsigned int i)
+{
+  unsigned int index = r->tailIndex + i;
+
+  if(index >= r->nnode)
+    index -= r->nnode;
+
+  return r->stamp[index];
+}
+
+/* Consumer: i-th oldest filled node, for i below rocRingCount */
+static inline DMANODE *
+rocRingPeekAt(ROC_RING *r, unsigned int i)
+{
+  unsigned int index = r->tailIndex + i;
+
+  if(index >= r->nnode)
+    index -= r->nnode;
+
+  return r->node[index];
+}
+
+/* Consumer: free the n oldest nodes in one store to tail, wake the
+   producer if waiting */
+static inline void
+rocRingFreeN(ROC_RING *r, unsigned int n)
+{
+  if(n == 0)
+    return;
+
+  r->tailIndex += n;
+  if(r->tailIndex >= r->nnode)
+    r->tailIndex -= r->nnode;
+  __atomic_store_n(&r->tail, r->tail + n, __ATOMIC_SEQ_CST);
+
+  if(__atomic_load_n(&r->waiting, __ATOMIC_SEQ_CST))
+    rocFutexWake(&r->tail);
+}
+
+/* Consumer: free the node from rocRingPeek, wake the producer if waiting */
+static inline void
+rocRingFree(ROC_RING *r)
+{
+  rocRingFreeN(r, 1);
+}
+
+/* Consumer: drop all filled nodes (Reset) */
+void
+rocRingFlush(ROC_RING *r)
+{
+  while(rocRingPeek(r) != NULL)
+    rocRingFree(r);
+}
@@ -0,0 +1,274 @@
+/*************************************************************************
+ *
+ *  rocSched.c - CPU affinity and real-time priority of the readout
+ *               thread (asyncTrigger) and the CODA thread (usrtrig), and
+ *               their context switches in the run.
+ *
+ *   The threads are not created by the list, so each one applies its
+ *   own settings, on its first call after Go (rocSchedThread).  The
+ *   affinity and policy it had are kept, and given back at End from the
+ *   End transition (rocSchedRestore), while both threads are still alive.
+ *
+ *   The voluntary and involuntary context switches of each thread
+ *   (/proc/self/task/<tid>/status) and its CPU time are counted from its
+ *   first call after Go to End, with or without settings, for comparison.
+ *
+ *   Settings (usrString in nps_vme_list.c):
+ *
+ *     cpus:  list of CPUs, "2", "2:3", "2-3", NULL or "" = no pinning
+ *            (':' or ',' between CPUs, ',' ends a usrString value)
+ *     prio:  SCHED_FIFO priority 1-99, 0 = no change
+ *
+ *   Usage:
+ *
+ *     rocPrestart:             rocSchedConfig(ROC_SCHED_READOUT, cpus, prio);
+ *     Go:                      rocSchedArm();
+ *     asyncTrigger / usrtrig:  rocSchedThread(ROC_SCHED_READOUT / _CODA);
+ *     End, before tiIntDisconnect:  rocSchedRestore();
+ *
+ */
+
+#include <sched.h>
+#include <pthread.h>
+
+#define ROC_SCHED_READOUT  0	/* asyncTrigger */
+#define ROC_SCHED_CODA     1	/* usrtrig */
+#define ROC_SCHED_NTHREAD  2
+
+static const char *rocSchedName[ROC_SCHED_NTHREAD] = { "asyncTrigger", "usrtrig" };
+
+typedef struct
+{
+  /* Settings */
+  cpu_set_t cpus;
+  int ncpu;			/* CPUs in cpus, 0 = no pinning */
+  int prio;			/* SCHED_FIFO priority, 0 = no change */
+
+  /* Set by the thread on its first call after Go */
+  volatile int armed;
+  int applied;
+  pthread_t thread;
+  pid_t tid;
+  cpu_set_t oldCpus;
+  int oldPolicy;
+  struct sched_param oldParam;
+  int pinned, fifo;		/* Settings that took */
+  long vcsw, nivcsw;		/* Context switches at the first call */
+  double cpu, wall;		/* CPU and monotonic time at the first call (s) */
+} ROC_SCHED;
+
+static ROC_SCHED rocSched[ROC_SCHED_NTHREAD];
+
+/* Voluntary and involuntary context switches of thread tid, -1 if unknown */
+static int
+rocSchedSwitches(pid_t tid, long *vcsw, long *nivcsw)
+{
+  char name[64], line[128];
+  FILE *f;
+
+  *vcsw = -1;
+  *nivcsw = -1;
+
+  snprintf(name, sizeof(name), "/proc/self/task/%d/status", (int) tid);
+  f = fopen(name, "r");
+  if(f == NULL)
+    return ERROR;
+
+  while(fgets(line, sizeof(line), f))
+    {
+      sscanf(line, "voluntary_ctxt_switches: %ld", vcsw);
+      sscanf(line, "nonvoluntary_ctxt_switches: %ld", nivcsw);
+    }
+  fclose(f);
+
+  return OK;
+}
+
+static double
+rocSchedTime(clockid_t clk)
+{
+  struct timespec ts;
+
+  if(clock_gettime(clk, &ts) != 0)
+    return -1;
+
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/*
+  Set the CPUs (list, e.g. "2:4-5") and SCHED_FIFO priority (0 = none)
+  of thread (ROC_SCHED_READOUT or ROC_SCHED_CODA), from the next Go.
+*/
+int
+rocSchedConfig(int thread, const char *cpus, int prio)
+{
+  ROC_SCHED *s;
+  const char *p = cpus;
+  char *next;
+  long lo, hi, icpu;
+
+  if((thread < 0) || (thread >= ROC_SCHED_NTHREAD))
+    return ERROR;
+  s = &rocSched[thread];
+
+  CPU_ZERO(&s->cpus);
+  s->ncpu = 0;
+  s->prio = 0;
+
+  while(p && *p)
+    {
+      lo = strtol(p, &next, 10);
+      if((next == p) || (lo < 0) || (lo >= CPU_SETSIZE))
+	{
+	  printf("%s: ERROR: bad CPU list \"%s\" for %s\n",
+		 __func__, cpus, rocSchedName[thread]);
+	  CPU_ZERO(&s->cpus);
+	  s->ncpu = 0;
+	  return ERROR;
+	}
+      hi = lo;
+      p = next;
+      if(*p == '-')
+	{
+	  hi = strtol(p + 1, &next, 10);
+	  if((next == p + 1) || (hi < lo) || (hi >= CPU_SETSIZE))
+	    hi = lo;
+	  p = next;
+	}
+      for(icpu = lo; icpu <= hi; icpu++)
+	CPU_SET(icpu, &s->cpus);
+      if((*p == ',') || (*p == ':'))
+	p++;
+    }
+  s->ncpu = CPU_COUNT(&s->cpus);
+
+  if(prio > 0)
+    {
+      if(prio < sched_get_priority_min(SCHED_FIFO))
+	prio = sched_get_priority_min(SCHED_FIFO);
+      if(prio > sched_get_priority_max(SCHED_FIFO))
+	prio = sched_get_priority_max(SCHED_FIFO);
+      s->prio = prio;
+    }
+
+  if(s->ncpu || s->prio)
+    printf("%s: %s thread: CPUs %s, SCHED_FIFO %d\n", __func__,
+	   rocSchedName[thread], s->ncpu ? cpus : "any", s->prio);
+
+  return OK;
+}
+
+/* Have each thread apply its settings on its first call, from Go */
+void
+rocSchedArm()
+{
+  int ithr;
+
+  for(ithr = 0; ithr < ROC_SCHED_NTHREAD; ithr++)
+    {
+      rocSched[ithr].applied = 0;
+      rocSched[ithr].armed = 1;
+    }
+}
+
+/* Apply the settings of thread to the calling thread */
+static void
+rocSchedApply(int thread)
+{
+  ROC_SCHED *s = &rocSched[thread];
+  struct sched_param param;
+  int rval;
+
+  s->armed = 0;
+  s->thread = pthread_self();
+  s->tid = syscall(SYS_gettid);
+  s->pinned = 0;
+  s->fifo = 0;
+
+  pthread_getaffinity_np(s->thread, sizeof(s->oldCpus), &s->oldCpus);
+  pthread_getschedparam(s->thread, &s->oldPolicy, &s->oldParam);
+
+  if(s->ncpu)
+    {
+      rval = pthread_setaffinity_np(s->thread, sizeof(s->cpus), &s->cpus);
+      if(rval == 0)
+	s->pinned = 1;
+      else
+	daLogMsg("WARN", "%s thread not pinned: %s", rocSchedName[thread],
+		 strerror(rval));
+    }
+
+  if(s->prio)
+    {
+      memset(&param, 0, sizeof(param));
+      param.sched_priority = s->prio;
+      rval = pthread_setschedparam(s->thread, SCHED_FIFO, &param);
+      if(rval == 0)
+	s->fifo = 1;
+      else
+	daLogMsg("WARN", "%s thread not SCHED_FIFO %d: %s", rocSchedName[thread],
+		 s->prio, strerror(rval));
+    }
+
+  rocSchedSwitches(s->tid, &s->vcsw, &s->nivcsw);
+  s->cpu = rocSchedTime(CLOCK_THREAD_CPUTIME_ID);
+  s->wall = rocSchedTime(CLOCK_MONOTONIC);
+  s->applied = 1;
+}
+
+/* Called by thread on each of its calls.  Applies the settings on the first */
+static inline void
+rocSchedThread(int thread)
+{
+  if(__builtin_expect(rocSched[thread].armed, 0))
+    rocSchedApply(thread);
+}
+
+/*
+  Report the context switches of each thread since Go, and give it back
+  the affinity and policy it had.
+*/
+void
+rocSchedRestore()
+{
+  ROC_SCHED *s;
+  long vcsw, nivcsw;
+  clockid_t clk;
+  double cpu, wall;
+  int ithr;
+
+  for(ithr = 0; ithr < ROC_SCHED_NTHREAD; ithr++)
+    {
+      s = &rocSched[ithr];
+      s->armed = 0;
+      if(!s->applied)
+	continue;
+      s->applied = 0;
+
+      if((rocSchedSwitches(s->tid, &vcsw, &nivcsw) == OK) && (s->nivcsw >= 0))
+	{
+	  printf("%s: %-12s thread %d: %ld involuntary, %ld voluntary context switches%s%s\n",
+		 __func__, rocSchedName[ithr], (int) s->tid,
+		 nivcsw - s->nivcsw, vcsw - s->vcsw,
+		 s->pinned ? " (pinned)" : "", s->fifo ? " (SCHED_FIFO)" : "");
+	  daLogMsg("INFO", "%s thread: %ld involuntary, %ld voluntary context switches",
+		   rocSchedName[ithr], nivcsw - s->nivcsw, vcsw - s->vcsw);
+	}
+
+      if((pthread_getcpuclockid(s->thread, &clk) == 0)
+	 && ((cpu = rocSchedTime(clk)) >= 0) && (s->cpu >= 0))
+	{
+	  wall = rocSchedTime(CLOCK_MONOTONIC) - s->wall;
+	  printf("%s: %-12s thread %d: %.3f s CPU in %.3f s (%.1f %%)\n",
+		 __func__, rocSchedName[ithr], (int) s->tid, cpu - s->cpu, wall,
+		 (wall > 0) ? 100 * (cpu - s->cpu) / wall : 0);
+	  daLogMsg("INFO", "%s thread: %.1f %% CPU", rocSchedName[ithr],
+		   (wall > 0) ? 100 * (cpu - s->cpu) / wall : 0);
+	}
+
+      if(s->fifo)
+	pthread_setschedparam(s->thread, s->oldPolicy, &s->oldParam);
+      if(s->pinned)
+	pthread_setaffinity_np(s->thread, sizeof(s->oldCpus), &s->oldCpus);
+    }
+}
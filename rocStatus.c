@@ -0,0 +1,375 @@
+/*************************************************************************
+ *
+ *  rocStatus.c - Live run status of the readout list in a shared memory
+ *                segment (see rocStatus.h and rocmon.c)
+ *
+ *   The readout thread keeps the counts in process memory, and copies
+ *   them to the segment (under its sequence lock) every
+ *   ROC_STATUS_PERIOD_MS.  Per event, that is a few adds and a read of
+ *   the coarse monotonic clock (vDSO, no system call).  No event, no
+ *   update: the age of the status shows a readout thread that is stuck.
+ *
+ *   Usage (see tiprimary_list.c):
+ *
+ *     Download:      rocStatusInit(ROCID);
+ *     Transitions:   rocStatusState(ROC_STATE_*);  readout thread stopped
+ *
+ *     asyncTrigger:  rocStatusTrigger();               each trigger
+ *                    rocStatusEvent(trigger, words);   each event
+ *                    rocStatusTick();                  trigger without event
+ *                    rocStatusWait(ns);                waited for a buffer
+ *
+ *     rocTrigger:    rocStatusError(trigger, code, fmt, ...);
+ *
+ *     usrtrig:       rocStatusBatch(n);                events copied out
+ *                    rocStatusHandoff(ns);             latency of an event
+ *
+ *     End:           rocStatusPrintStats();
+ *
+ *   The waits of asyncTrigger for a free buffer (the event ring full:
+ *   usrtrig, the network or the event builder behind) are histogrammed
+ *   by duration, and the number of buffers waiting for usrtrig is
+ *   histogrammed at each trigger.  Mostly empty buffers and few waits
+ *   point at the readout; full buffers and long waits at what is
+ *   downstream of usrtrig.
+ *
+ *   The events copied out by each call of usrtrig (rocSetOutputBatch) and
+ *   the time from the handoff of each event to its copy (codawait only)
+ *   are histogrammed by usrtrig itself, the only writer of those counts.
+ *
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rocStatus.h"
+
+#define ROC_STATUS_PERIOD_MS  250	/* Between updates of the segment */
+
+#if ROC_RING_MAX >= ROC_STATUS_NFILLBIN
+#error "ROC_STATUS_NFILLBIN too small for ROC_RING_MAX"
+#endif
+
+static ROC_STATUS_SHM *rocStatusShm = NULL;
+
+static struct
+{
+  ROC_STATUS st;		/* Copied to rocStatusShm->status */
+  uint64_t next;		/* Coarse monotonic ms of the next update */
+  uint64_t lastNs;		/* Monotonic ns of the last update */
+  uint64_t lastEvents, lastBytes;
+} rocStat;
+
+static inline uint64_t
+rocStatusClock(clockid_t clk)
+{
+  struct timespec ts;
+
+  clock_gettime(clk, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Create (or attach to) the shared memory segment for this ROC */
+int
+rocStatusInit(int rocid)
+{
+  char name[64];
+  int fd;
+
+  if(rocStatusShm != NULL)
+    return OK;
+
+  snprintf(name, sizeof(name), ROC_STATUS_SHM_NAME, rocid);
+
+  fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if(fd < 0)
+    {
+      perror("shm_open");
+      return ERROR;
+    }
+
+  if(ftruncate(fd, sizeof(ROC_STATUS_SHM)) < 0)
+    {
+      perror("ftruncate");
+      close(fd);
+      return ERROR;
+    }
+
+  rocStatusShm = mmap(NULL, sizeof(ROC_STATUS_SHM), PROT_READ | PROT_WRITE,
+		      MAP_SHARED, fd, 0);
+  close(fd);
+  if(rocStatusShm == MAP_FAILED)
+    {
+      perror("mmap");
+      rocStatusShm = NULL;
+      return ERROR;
+    }
+
+  memset(rocStatusShm, 0, sizeof(ROC_STATUS_SHM));
+  rocStatusShm->version = ROC_STATUS_VERSION;
+  rocStatusShm->rocid = rocid;
+  rocStatusShm->pid = getpid();
+  rocStatusShm->size = sizeof(ROC_STATUS);
+  __atomic_store_n(&rocStatusShm->magic, ROC_STATUS_MAGIC, __ATOMIC_RELEASE);
+
+  memset(&rocStat, 0, sizeof(rocStat));
+  rocStat.st.lastErrorEvent = -1;
+
+  printf("%s: Run status in /dev/shm%s\n", __func__, name);
+
+  return OK;
+}
+
+/* Copy the status to the segment, now = monotonic ns */
+static void
+rocStatusPublish(uint64_t now)
+{
+  ROC_STATUS *st = &rocStat.st;
+  double dt;
+
+  if(rocStatusShm == NULL)
+    return;
+
+  dt = 1e-9 * (now - rocStat.lastNs);
+  if(st->state != ROC_STATE_ACTIVE)
+    {
+      st->eventRate = 0;
+      st->dataRate = 0;
+    }
+  else if((rocStat.lastNs != 0) && (dt > 0))
+    {
+      st->eventRate = (st->events - rocStat.lastEvents) / dt;
+      st->dataRate = 1e-6 * (st->bytes - rocStat.lastBytes) / dt;
+    }
+  rocStat.lastNs = now;
+  rocStat.lastEvents = st->events;
+  rocStat.lastBytes = st->bytes;
+
+  st->nodes = eventRing.nnode;
+  st->nodeBytes = eventRing.nnode ? eventRing.node[0]->part->size - sizeof(DMANODE) : 0;
+  st->filled = rocRingCount(&eventRing);
+  st->emptyCount = emptyCount;
+  st->errCount = errCount;
+  st->truncated = rocEvt.ntruncated;
+  st->updateTime = rocStatusClock(CLOCK_REALTIME);
+
+  __atomic_store_n(&rocStatusShm->seq, rocStatusShm->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy((void *) &rocStatusShm->status, st, sizeof(ROC_STATUS));
+  __atomic_store_n(&rocStatusShm->seq, rocStatusShm->seq + 1, __ATOMIC_RELEASE);
+
+  rocStat.next = rocStatusClock(CLOCK_MONOTONIC_COARSE) / 1000000 + ROC_STATUS_PERIOD_MS;
+}
+
+/* Update the segment if it is time to */
+static inline void
+rocStatusTick()
+{
+  uint64_t ms = rocStatusClock(CLOCK_MONOTONIC_COARSE) / 1000000;
+
+  if(__builtin_expect(ms >= rocStat.next, 0))
+    rocStatusPublish(rocStatusClock(CLOCK_MONOTONIC));
+}
+
+/* Trigger taken: event buffers waiting for usrtrig */
+static inline void
+rocStatusTrigger()
+{
+  unsigned int filled = rocRingCount(&eventRing);
+
+  rocStat.st.filledHist[filled]++;
+  if(filled > rocStat.st.filledMax)
+    rocStat.st.filledMax = filled;
+}
+
+/* Event of trigger handed to usrtrig, with words of data */
+static inline void
+rocStatusEvent(unsigned int trigger, unsigned long words)
+{
+  rocStat.st.triggers = trigger;
+  rocStat.st.events++;
+  rocStat.st.bytes += words << 2;
+
+  rocStatusTick();
+}
+
+/* asyncTrigger waited ns for a free event buffer */
+static inline void
+rocStatusWait(uint64_t ns)
+{
+  rocStat.st.waitCount++;
+  rocStat.st.waitNs += ns;
+  if(ns > rocStat.st.waitMaxNs)
+    rocStat.st.waitMaxNs = ns;
+  rocStat.st.waitHist[rocStatusWaitBin(ns)]++;
+}
+
+/* usrtrig copied out n events (CODA thread) */
+static inline void
+rocStatusBatch(unsigned int n)
+{
+  rocStat.st.batchHist[n]++;
+}
+
+/* usrtrig copied out an event ns after asyncTrigger handed it over (CODA thread) */
+static inline void
+rocStatusHandoff(uint64_t ns)
+{
+  rocStat.st.handoffCount++;
+  rocStat.st.handoffNs += ns;
+  if(ns > rocStat.st.handoffMaxNs)
+    rocStat.st.handoffMaxNs = ns;
+  rocStat.st.handoffHist[rocStatusWaitBin(ns)]++;
+}
+
+/* Readout error in trigger, with a code and description for the status */
+void
+rocStatusError(int trigger, unsigned int code, const char *fmt, ...)
+{
+  va_list args;
+
+  rocStat.st.errors++;
+  rocStat.st.lastErrorEvent = trigger;
+  rocStat.st.lastErrorCode = code;
+  rocStat.st.lastErrorTime = rocStatusClock(CLOCK_REALTIME);
+
+  va_start(args, fmt);
+  vsnprintf(rocStat.st.lastError, sizeof(rocStat.st.lastError), fmt, args);
+  va_end(args);
+}
+
+/* Run state after a transition.  Go clears the counts. */
+void
+rocStatusState(int state)
+{
+  ROC_STATUS *st = &rocStat.st;
+
+  if(state == ROC_STATE_ACTIVE)
+    {
+      memset(st, 0, sizeof(ROC_STATUS));
+      st->lastErrorEvent = -1;
+      st->goTime = rocStatusClock(CLOCK_REALTIME);
+      rocStat.lastNs = 0;
+    }
+
+  st->state = state;
+  st->runNumber = rol->runNumber;
+
+  rocStatusPublish(rocStatusClock(CLOCK_MONOTONIC));
+}
+
+/* Backpressure of the run: waits for a free buffer, buffers waiting */
+void
+rocStatusPrintStats()
+{
+  ROC_STATUS *st = &rocStat.st;
+  uint64_t ntrig = 0, sum = 0, n, ncall;
+  double runTime, mean;
+  unsigned int ibin, lo, hi, step, nodes = st->nodes;
+
+  for(ibin = 0; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    {
+      ntrig += st->filledHist[ibin];
+      sum += (uint64_t) ibin * st->filledHist[ibin];
+    }
+  if(ntrig == 0)
+    return;
+
+  runTime = 1e-9 * (rocStatusClock(CLOCK_REALTIME) - st->goTime);
+  mean = (double) sum / ntrig;
+
+  printf("%s: %llu triggers in %.1f s\n", __func__, (unsigned long long) ntrig, runTime);
+  printf("    Waits for a free event buffer: %llu (%.1f %% of the events), "
+	 "%.3f s (%.1f %% of the run), max %.3f ms\n",
+	 (unsigned long long) st->waitCount,
+	 st->events ? 100.0 * st->waitCount / st->events : 0,
+	 1e-9 * st->waitNs, (runTime > 0) ? 100e-9 * st->waitNs / runTime : 0,
+	 1e-6 * st->waitMaxNs);
+
+  if(st->waitCount)
+    {
+      printf("      %-20s %12s\n", "wait (us)", "count");
+      for(ibin = 0; ibin < ROC_STATUS_NWAITBIN; ibin++)
+	if(st->waitHist[ibin])
+	  printf("      %8llu - %-9llu %12llu\n",
+		 (unsigned long long) rocStatusWaitBinLow(ibin),
+		 (unsigned long long) rocStatusWaitBinLow(ibin + 1),
+		 (unsigned long long) st->waitHist[ibin]);
+    }
+
+  /* Buffers waiting for usrtrig at each trigger, in up to 16 rows */
+  printf("    Event buffers waiting for usrtrig at a trigger (of %u): mean %.2f, max %u\n",
+	 nodes, mean, st->filledMax);
+  printf("      %-20s %12s\n", "waiting", "triggers");
+  step = (nodes + 15) / 16;
+  if(step == 0)
+    step = 1;
+  for(lo = 0; lo <= nodes; lo += step)
+    {
+      hi = lo + step - 1;
+      if(hi > nodes)
+	hi = nodes;
+      for(n = 0, ibin = lo; ibin <= hi; ibin++)
+	n += st->filledHist[ibin];
+      if(hi > lo)
+	printf("      %4u - %-13u %12llu  (%5.1f %%)\n", lo, hi,
+	       (unsigned long long) n, 100.0 * n / ntrig);
+      else
+	printf("      %-20u %12llu  (%5.1f %%)\n", lo,
+	       (unsigned long long) n, 100.0 * n / ntrig);
+    }
+
+  /* Events copied out by each call of usrtrig, when batched */
+  for(n = 0, sum = 0, ibin = 2; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    n += st->batchHist[ibin];
+  if(n)
+    {
+      for(n = 0, ibin = 1; ibin < ROC_STATUS_NFILLBIN; ibin++)
+	{
+	  n += st->batchHist[ibin];
+	  sum += (uint64_t) ibin * st->batchHist[ibin];
+	}
+      printf("    Events per usrtrig call: mean %.2f in %llu calls\n",
+	     (double) sum / n, (unsigned long long) n);
+      printf("      %-20s %12s\n", "events", "calls");
+      for(lo = 1; lo < ROC_STATUS_NFILLBIN; lo *= 2)
+	{
+	  hi = 2 * lo - 1;
+	  if(hi >= ROC_STATUS_NFILLBIN)
+	    hi = ROC_STATUS_NFILLBIN - 1;
+	  for(ncall = 0, ibin = lo; ibin <= hi; ibin++)
+	    ncall += st->batchHist[ibin];
+	  if(ncall == 0)
+	    continue;
+	  if(hi > lo)
+	    printf("      %4u - %-13u %12llu  (%5.1f %%)\n", lo, hi,
+		   (unsigned long long) ncall, 100.0 * ncall / n);
+	  else
+	    printf("      %-20u %12llu  (%5.1f %%)\n", lo,
+		   (unsigned long long) ncall, 100.0 * ncall / n);
+	}
+    }
+
+  if(st->handoffCount)
+    {
+      printf("    Handoff to usrtrig: mean %.1f us, max %.3f ms\n",
+	     1e-3 * st->handoffNs / st->handoffCount, 1e-6 * st->handoffMaxNs);
+      printf("      %-20s %12s\n", "latency (us)", "events");
+      for(ibin = 0; ibin < ROC_STATUS_NWAITBIN; ibin++)
+	if(st->handoffHist[ibin])
+	  printf("      %8llu - %-9llu %12llu  (%5.1f %%)\n",
+		 (unsigned long long) rocStatusWaitBinLow(ibin),
+		 (unsigned long long) rocStatusWaitBinLow(ibin + 1),
+		 (unsigned long long) st->handoffHist[ibin],
+		 100.0 * st->handoffHist[ibin] / st->handoffCount);
+    }
+
+  daLogMsg("INFO", "Waited %.3f s (%.1f %% of the run) for free event buffers, "
+	   "%.2f of %u buffers waiting for usrtrig at a trigger",
+	   1e-9 * st->waitNs, (runTime > 0) ? 100e-9 * st->waitNs / runTime : 0,
+	   mean, nodes);
+}
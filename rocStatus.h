@@ -0,0 +1,159 @@
+/*************************************************************************
+ *
+ *  rocStatus.h - Layout of the shared memory segment with the live run
+ *                status of the readout list: trigger and event counts,
+ *                rates, event buffer occupancy, stalls and the last error.
+ *
+ *   Written by the readout list (rocStatus.c), read by rocmon while the
+ *   run is going.
+ *
+ *   The segment is /dev/shm/rocStatus.<ROCID>.  The readout thread is
+ *   the only writer during the run (the transitions write it while the
+ *   readout thread is stopped), and publishes the status a few times per
+ *   second under a sequence lock: seq is odd while the status is being
+ *   written, and a reader copies the status again if seq changed
+ *   (rocStatusRead).
+ *
+ */
+
+#ifndef __ROCSTATUS_H__
+#define __ROCSTATUS_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#define ROC_STATUS_SHM_NAME  "/rocStatus.%d"	/* %d = ROCID */
+#define ROC_STATUS_MAGIC     0x524f4353	/* "ROCS" */
+#define ROC_STATUS_VERSION   4
+
+/* Histograms of the waits for a free event buffer and of the handoff
+   latency: bin 0 is below 1 us, bin n from 2^(n-1) to 2^n us */
+#define ROC_STATUS_NWAITBIN  32
+
+/* Distribution of the event buffers waiting for usrtrig, 0 to 256, and
+   of the events copied out by each call of usrtrig */
+#define ROC_STATUS_NFILLBIN  257
+
+/* Run state, from the last transition */
+enum rocStatusStates
+  {
+    ROC_STATE_LOADED = 0,
+    ROC_STATE_DOWNLOADED,
+    ROC_STATE_PRESTARTED,
+    ROC_STATE_ACTIVE,
+    ROC_STATE_ENDED,
+    ROC_STATE_RESET,
+    ROC_STATE_MAX
+  };
+
+#define ROC_STATE_NAMES {						\
+    "loaded", "downloaded", "prestarted", "active", "ended", "reset" }
+
+typedef struct
+{
+  int32_t state;		/* ROC_STATE_* */
+  int32_t runNumber;
+  uint64_t updateTime;		/* Of this status, ns since epoch */
+  uint64_t goTime;		/* ns since epoch */
+
+  /* Since Go */
+  uint64_t triggers;		/* TI interrupt count of the last event */
+  uint64_t events;		/* Event buffers handed to usrtrig */
+  uint64_t bytes;		/* In those event buffers */
+  double eventRate;		/* Hz, since the last update */
+  double dataRate;		/* MB/s, since the last update */
+
+  /* Event buffers (vmeIN), in the event ring */
+  uint32_t nodes;		/* Event buffers */
+  uint32_t nodeBytes;		/* Size of each */
+  uint32_t filled;		/* Waiting for usrtrig (vmeOUT) */
+  uint32_t filledMax;		/* Most waiting at a trigger, since Go */
+
+  /* Stalls, since Go */
+  uint64_t emptyCount;		/* Events that left no free buffer */
+  uint64_t errCount;		/* Triggers without a free buffer */
+  uint64_t waitCount;		/* Waits of asyncTrigger for a free buffer */
+  uint64_t waitNs;		/* Time in those waits (ACKWAIT) */
+  uint64_t waitMaxNs;		/* Longest of those waits */
+  uint64_t truncated;		/* Events cut to the buffer size */
+
+  /* Backpressure, since Go */
+  uint64_t waitHist[ROC_STATUS_NWAITBIN];	/* Waits by duration */
+  uint64_t filledHist[ROC_STATUS_NFILLBIN];	/* Triggers by buffers waiting */
+  uint64_t batchHist[ROC_STATUS_NFILLBIN];	/* usrtrig calls by events copied out */
+
+  /* Handoff latency, since Go: from asyncTrigger's handoff of an event
+     to its copy by usrtrig */
+  uint64_t handoffCount;
+  uint64_t handoffNs;
+  uint64_t handoffMaxNs;
+  uint64_t handoffHist[ROC_STATUS_NWAITBIN];
+
+  /* Readout errors, since Go */
+  uint64_t errors;
+  int64_t lastErrorEvent;	/* Trigger of the last error, -1 = none */
+  uint64_t lastErrorTime;	/* ns since epoch */
+  uint32_t lastErrorCode;	/* From the list (e.g. block error flags) */
+  char lastError[100];
+} ROC_STATUS;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t rocid;
+  int32_t pid;			/* Process of the readout list */
+  volatile uint32_t seq;	/* Odd while the status is written */
+  uint32_t size;		/* sizeof(ROC_STATUS) */
+  ROC_STATUS status;
+} ROC_STATUS_SHM;
+
+/* Bin of a wait of ns in waitHist */
+static inline unsigned int
+rocStatusWaitBin(uint64_t ns)
+{
+  uint64_t us = ns / 1000;
+  unsigned int bin;
+
+  if(us == 0)
+    return 0;
+
+  bin = 64 - __builtin_clzll(us);
+  return (bin < ROC_STATUS_NWAITBIN) ? bin : ROC_STATUS_NWAITBIN - 1;
+}
+
+/* Lower edge of a bin of waitHist, in us */
+static inline uint64_t
+rocStatusWaitBinLow(unsigned int bin)
+{
+  return bin ? 1ULL << (bin - 1) : 0;
+}
+
+/*
+  Reader: consistent copy of the status in shm.  Returns 0, or -1 if the
+  writer was always in the middle of an update.
+*/
+static inline int
+rocStatusRead(const ROC_STATUS_SHM *shm, ROC_STATUS *status)
+{
+  uint32_t seq0, seq1;
+  int itry;
+
+  for(itry = 0; itry < 1000; itry++)
+    {
+      seq0 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+      if(seq0 & 1)
+	continue;
+
+      memcpy(status, (const void *) &shm->status, sizeof(ROC_STATUS));
+
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      seq1 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+      if(seq1 == seq0)
+	return 0;
+    }
+
+  return -1;
+}
+
+#endif /* __ROCSTATUS_H__ */
@@ -0,0 +1,149 @@
+/*************************************************************************
+ *
+ *  rocTiming.c - Per-stage latency histograms of rocTrigger, in a shared
+ *                memory segment (see rocTiming.h and rocmon.c)
+ *
+ *   Compiled in with -DROC_TIMING.  Without it, the ROC_TIMING_* macros
+ *   are empty and nothing here is built.
+ *
+ *   Usage:
+ *
+ *     rocDownload:  ROC_TIMING_INIT;
+ *     rocPrestart:  ROC_TIMING_RESET;
+ *
+ *     rocTrigger:   ROC_TIMING_START;
+ *                   tiReadTriggerBlock(...);
+ *                   ROC_TIMING_MARK(ROC_STAGE_TI);     time since last mark
+ *                   ...
+ *                   ROC_TIMING_STOP;                   time since START
+ *
+ */
+
+#ifdef ROC_TIMING
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "rocTiming.h"
+
+static ROC_TIMING_SHM *rocTimingShm = NULL;
+static uint64_t rocTimingStart = 0, rocTimingLast = 0;
+
+static inline uint64_t
+rocTimingNow()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Create (or attach to) the shared memory segment for this ROC */
+int
+rocTimingInit(int rocid)
+{
+  char name[64];
+  int fd;
+
+  if(rocTimingShm != NULL)
+    return OK;
+
+  snprintf(name, sizeof(name), ROC_TIMING_SHM_NAME, rocid);
+
+  fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if(fd < 0)
+    {
+      perror("shm_open");
+      return ERROR;
+    }
+
+  if(ftruncate(fd, sizeof(ROC_TIMING_SHM)) < 0)
+    {
+      perror("ftruncate");
+      close(fd);
+      return ERROR;
+    }
+
+  rocTimingShm = mmap(NULL, sizeof(ROC_TIMING_SHM), PROT_READ | PROT_WRITE,
+		      MAP_SHARED, fd, 0);
+  close(fd);
+  if(rocTimingShm == MAP_FAILED)
+    {
+      perror("mmap");
+      rocTimingShm = NULL;
+      return ERROR;
+    }
+
+  memset(rocTimingShm, 0, sizeof(ROC_TIMING_SHM));
+  rocTimingShm->version = ROC_TIMING_VERSION;
+  rocTimingShm->rocid = rocid;
+  rocTimingShm->pid = getpid();
+  rocTimingShm->nstage = ROC_STAGE_MAX;
+  rocTimingShm->nbin = ROC_TIMING_NBIN;
+  __atomic_store_n(&rocTimingShm->magic, ROC_TIMING_MAGIC, __ATOMIC_RELEASE);
+
+  printf("%s: Readout timing in /dev/shm%s\n", __func__, name);
+
+  return OK;
+}
+
+/* Clear all histograms, e.g. at Prestart */
+void
+rocTimingReset(int runNumber)
+{
+  int istage;
+
+  if(rocTimingShm == NULL)
+    return;
+
+  for(istage = 0; istage < ROC_STAGE_MAX; istage++)
+    {
+      memset((void *) &rocTimingShm->stage[istage], 0, sizeof(ROC_TIMING_STAGE));
+      rocTimingShm->stage[istage].min = UINT64_MAX;
+    }
+
+  rocTimingShm->runNumber = runNumber;
+  rocTimingShm->resetTime = time(NULL);
+}
+
+static inline void
+rocTimingRecord(int stage, uint64_t ns)
+{
+  ROC_TIMING_STAGE *s;
+
+  if(rocTimingShm == NULL)
+    return;
+
+  s = &rocTimingShm->stage[stage];
+  s->bin[rocTimingBin(ns)]++;
+  s->sum += ns;
+  if(ns < s->min)
+    s->min = ns;
+  if(ns > s->max)
+    s->max = ns;
+  /* count last, so that a reader never sees more entries than binned */
+  __atomic_store_n(&s->count, s->count + 1, __ATOMIC_RELEASE);
+}
+
+#define ROC_TIMING_INIT         rocTimingInit(ROCID)
+#define ROC_TIMING_RESET        rocTimingReset(rol->runNumber)
+#define ROC_TIMING_START        { rocTimingStart = rocTimingLast = rocTimingNow(); }
+#define ROC_TIMING_MARK(stage) {					\
+    uint64_t __now = rocTimingNow();					\
+    rocTimingRecord(stage, __now - rocTimingLast);			\
+    rocTimingLast = __now;						\
+  }
+#define ROC_TIMING_STOP         rocTimingRecord(ROC_STAGE_TOTAL, rocTimingNow() - rocTimingStart)
+
+#else /* ROC_TIMING */
+
+#define ROC_TIMING_INIT
+#define ROC_TIMING_RESET
+#define ROC_TIMING_START
+#define ROC_TIMING_MARK(stage)
+#define ROC_TIMING_STOP
+
+#endif /* ROC_TIMING */
@@ -0,0 +1,95 @@
+/*************************************************************************
+ *
+ *  rocTiming.h - Layout of the shared memory segment with the per-stage
+ *                readout latency histograms of rocTrigger.
+ *
+ *   Written by the readout list (rocTiming.c, compiled in with
+ *   -DROC_TIMING), read by rocmon while the run is going.
+ *
+ *   The segment is /dev/shm/rocTiming.<ROCID>.  There is a single writer
+ *   (the readout thread) and no lock: a reader may see a stage with an
+ *   update in progress, which is good enough for monitoring.
+ *
+ */
+
+#ifndef __ROCTIMING_H__
+#define __ROCTIMING_H__
+
+#include <stdint.h>
+
+#define ROC_TIMING_SHM_NAME  "/rocTiming.%d"	/* %d = ROCID */
+#define ROC_TIMING_MAGIC     0x524f4354	/* "ROCT" */
+#define ROC_TIMING_VERSION   4
+
+/* Readout stages */
+enum rocTimingStages
+  {
+    ROC_STAGE_TI = 0,		/* tiReadTriggerBlock */
+    ROC_STAGE_FA_READY,		/* faGBlockReady poll */
+    ROC_STAGE_FA_READ,		/* faReadBlock */
+    ROC_STAGE_FA_CHECK,		/* fadcCheckBank (usrString fadccheck) */
+    ROC_STAGE_FA_ZS,		/* fadcSuppressBank (usrString fadczs) */
+    ROC_STAGE_FA_PACK,		/* fadcPackBank (usrString fadcpack) */
+    ROC_STAGE_VLD,		/* vldShmReadBlock */
+    ROC_STAGE_SYNC,		/* Sync event flush (sync events only) */
+    ROC_STAGE_SCALER,		/* Scaler banks (when a new snapshot is inserted) */
+    ROC_STAGE_TOTAL,		/* All of rocTrigger */
+    ROC_STAGE_MAX
+  };
+
+#define ROC_STAGE_NAMES {				\
+    "tiReadTriggerBlock", "faGBlockReady", "faReadBlock",	\
+      "fadcCheckBank", "fadcSuppress", "fadcPackBank", "vldShmReadBlock", "sync flush", "scalers", "rocTrigger" }
+
+/*
+  Histogram bins, in ns.  Values below 8 ns have a bin each, above that
+  every power of 2 is split into 8 bins (12.5% resolution).
+*/
+#define ROC_TIMING_NBIN      512
+
+static inline unsigned int
+rocTimingBin(uint64_t ns)
+{
+  unsigned int e;
+
+  if(ns < 8)
+    return (unsigned int) ns;
+
+  e = 63 - __builtin_clzll(ns);
+  return 8 * (e - 2) + ((ns >> (e - 3)) & 7);
+}
+
+/* Lower edge of a bin, in ns */
+static inline uint64_t
+rocTimingBinLow(unsigned int bin)
+{
+  if(bin < 8)
+    return bin;
+
+  return (uint64_t) (8 + (bin & 7)) << (bin / 8 - 1);
+}
+
+typedef struct
+{
+  volatile uint64_t count;
+  volatile uint64_t sum;	/* ns */
+  volatile uint64_t min;	/* ns */
+  volatile uint64_t max;	/* ns */
+  volatile uint64_t bin[ROC_TIMING_NBIN];
+} ROC_TIMING_STAGE;
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t rocid;
+  int32_t pid;			/* Process of the readout list */
+  volatile int32_t runNumber;
+  uint32_t nstage;
+  uint32_t nbin;
+  uint32_t reserved;
+  volatile uint64_t resetTime;	/* Time of the last reset (s since epoch) */
+  ROC_TIMING_STAGE stage[ROC_STAGE_MAX];
+} ROC_TIMING_SHM;
+
+#endif /* __ROCTIMING_H__ */
@@ -0,0 +1,303 @@
+/*************************************************************************
+ *
+ *  rocTune.c - blockLevel and bufferLevel from a trigger rate target
+ *              (usrString ratetarget=<Hz>), and the levels recommended
+ *              for it after each run from the measured readout time per
+ *              block and the occupancy of the event buffers.
+ *
+ *   The readout time of a block of B events (rocTrigger) is modelled as
+ *   a + b * B:
+ *     a   per block: interrupt, TI block, block ready poll, DMA setup
+ *     b   per event: data transfer and formatting
+ *   a and b are fitted to the mean readout time per block of the last
+ *   ROC_TUNE_NRUN runs, at each blockLevel.  With runs at a single
+ *   blockLevel, a is taken as ROC_TUNE_BLOCK_NS (at most half of the
+ *   time per block), and before any run a and b are ROC_TUNE_BLOCK_NS
+ *   and ROC_TUNE_EVENT_NS.
+ *
+ *   For a trigger rate R:
+ *     blockLevel   smallest B that keeps the readout thread busy at most
+ *                  ROC_TUNE_BUSY of the time, R * (a / B + b) <= busy,
+ *                  with the time to fill a block (B / R) at most the
+ *                  latency limit (usrString maxblocklatency=<us>).  Above
+ *                  the capacity of the readout (R * b > busy), the B that
+ *                  brings a / B down to ROC_TUNE_BLOCK_SHARE of b: larger
+ *                  blocks only add latency and memory
+ *     bufferLevel  blocks that come in during a long block readout (a + b * B,
+ *                  times the 99th percentile over the mean of the last run),
+ *                  plus one, from 2 to ROC_TUNE_MAX_BUFFERLEVEL
+ *
+ *   The readout time is only measured with a rate target (no clock
+ *   reads in rocTrigger otherwise): without one, no levels are
+ *   recommended at End.
+ *
+ *   The event buffers (vmeIN) keep the memory of the default pool,
+ *   MAX_EVENT_POOL x MAX_EVENT_LENGTH: fewer, larger buffers for larger
+ *   blocks, but at least bufferLevel + 2 (rocTunePoolDepth).
+ *
+ *   Usage (nps_vme_list.c):
+ *
+ *     readUserFlags:         rocTuneConfig(rateHz, maxLatencyUs);
+ *     rocPrestart (TI master):  rocTuneLevels(&blockLevel, &bufferLevel);
+ *     rocGo:                 depth = rocTunePoolDepth(eventBytes, bufferLevel);
+ *                            rocTuneStart(blockLevel, bufferLevel);
+ *     rocTrigger:            if(rocTune.rate) rocTuneBlock(ns);
+ *     rocEnd:                rocTuneEnd();
+ *
+ */
+
+#define ROC_TUNE_NRUN             8	/* Runs kept for the fit */
+#define ROC_TUNE_BLOCK_NS     20000	/* Per block, without a fit */
+#define ROC_TUNE_EVENT_NS     10000	/* Per event, before any run */
+#define ROC_TUNE_BUSY           0.5	/* Readout thread busy at the rate target */
+#define ROC_TUNE_BLOCK_SHARE    0.1	/* Of the per event time, above capacity */
+#define ROC_TUNE_MAX_BLOCKLEVEL 255	/* TI block level register */
+#define ROC_TUNE_MAX_BUFFERLEVEL 10
+#define ROC_TUNE_MAX_LATENCY_NS 10e6	/* To fill a block, without maxblocklatency */
+
+static struct
+{
+  /* Settings */
+  double rate;			/* Hz, 0 = no target */
+  double maxLatencyNs;		/* To fill a block */
+
+  /* Model */
+  double a, b;			/* ns per block, ns per event */
+  double peak;			/* 99th percentile over mean readout time, last run */
+  int nrun;			/* Runs measured, in run[] (last ROC_TUNE_NRUN) */
+  struct
+  {
+    int blockLevel;
+    double ns;			/* Mean readout time per block */
+  } run[ROC_TUNE_NRUN];
+
+  /* This run */
+  int blockLevel, bufferLevel;
+  unsigned long long blocks;
+  unsigned long long ns, maxNs;	/* Readout time of the blocks */
+  unsigned long long hist[ROC_STATUS_NWAITBIN];	/* Blocks by readout time (rocStatusWaitBin) */
+} rocTune = { 0, ROC_TUNE_MAX_LATENCY_NS, ROC_TUNE_BLOCK_NS, ROC_TUNE_EVENT_NS, 1 };
+
+/* Rate target (Hz, 0 = none) and longest time to fill a block (us) */
+void
+rocTuneConfig(double rate, int maxLatencyUs)
+{
+  rocTune.rate = (rate > 0) ? rate : 0;
+  rocTune.maxLatencyNs = (maxLatencyUs > 0) ? 1e3 * maxLatencyUs : ROC_TUNE_MAX_LATENCY_NS;
+
+  if(rocTune.rate > 0)
+    printf("%s: Block and buffer levels for %.0f Hz, blocks filled in %.0f us at most\n",
+	   __func__, rocTune.rate, 1e-3 * rocTune.maxLatencyNs);
+}
+
+/* Fit a and b to the runs measured */
+static void
+rocTuneFit()
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, n, det, a, b;
+  int irun, nrun = (rocTune.nrun < ROC_TUNE_NRUN) ? rocTune.nrun : ROC_TUNE_NRUN;
+
+  if(nrun == 0)
+    return;
+
+  for(irun = 0; irun < nrun; irun++)
+    {
+      sx += rocTune.run[irun].blockLevel;
+      sy += rocTune.run[irun].ns;
+      sxx += (double) rocTune.run[irun].blockLevel * rocTune.run[irun].blockLevel;
+      sxy += rocTune.run[irun].blockLevel * rocTune.run[irun].ns;
+    }
+  n = nrun;
+  det = n * sxx - sx * sx;
+
+  /* Runs at more than one blockLevel: least squares */
+  if(det > 1e-9 * n * sxx)
+    {
+      b = (n * sxy - sx * sy) / det;
+      a = (sy - b * sx) / n;
+      if((a >= 0) && (b > 0))
+	{
+	  rocTune.a = a;
+	  rocTune.b = b;
+	  return;
+	}
+    }
+
+  /* One blockLevel (or no sensible fit): a assumed */
+  a = sy / n / 2;
+  if(a > ROC_TUNE_BLOCK_NS)
+    a = ROC_TUNE_BLOCK_NS;
+  rocTune.a = a;
+  rocTune.b = (sy / n - a) / (sx / n);
+  if(rocTune.b <= 0)
+    rocTune.b = 1;
+}
+
+/* blockLevel and bufferLevel for rate (Hz), from the model */
+static void
+rocTuneChoose(double rate, int *blockLevel, int *bufferLevel)
+{
+  int B, maxB;
+  double blocks;
+
+  maxB = (int) (rate * 1e-9 * rocTune.maxLatencyNs);
+  if(maxB < 1)
+    maxB = 1;
+  if(maxB > ROC_TUNE_MAX_BLOCKLEVEL)
+    maxB = ROC_TUNE_MAX_BLOCKLEVEL;
+
+  for(B = 1; B < maxB; B++)
+    {
+      if(rate * 1e-9 * (rocTune.a / B + rocTune.b) <= ROC_TUNE_BUSY)
+	break;
+      if((rate * 1e-9 * rocTune.b > ROC_TUNE_BUSY)
+	 && (rocTune.a / B <= ROC_TUNE_BLOCK_SHARE * rocTune.b))
+	break;
+    }
+  *blockLevel = B;
+
+  blocks = rocTune.peak * (rocTune.a + rocTune.b * B) * 1e-9 * rate / B;
+  *bufferLevel = (int) (blocks + 0.999) + 1;
+  if(*bufferLevel < 2)
+    *bufferLevel = 2;
+  if(*bufferLevel > ROC_TUNE_MAX_BUFFERLEVEL)
+    *bufferLevel = ROC_TUNE_MAX_BUFFERLEVEL;
+}
+
+/* Prestart, TI master: the levels for the rate target, if any */
+int
+rocTuneLevels(int *blockLevel, int *bufferLevel)
+{
+  if(rocTune.rate <= 0)
+    return ERROR;
+
+  rocTuneChoose(rocTune.rate, blockLevel, bufferLevel);
+
+  printf("%s: %.0f Hz: Block Level %d, Buffer Level %d "
+	 "(%.1f us per block + %.1f us per event%s)\n",
+	 __func__, rocTune.rate, *blockLevel, *bufferLevel,
+	 1e-3 * rocTune.a, 1e-3 * rocTune.b, rocTune.nrun ? "" : ", not measured yet");
+
+  if(rocTune.rate * 1e-9 * rocTune.b >= ROC_TUNE_BUSY)
+    daLogMsg("WARN", "Rate target %.0f Hz above %.0f Hz, the readout capacity at %.0f %% busy",
+	     rocTune.rate, ROC_TUNE_BUSY / (1e-9 * rocTune.b), 100 * ROC_TUNE_BUSY);
+
+  return OK;
+}
+
+/*
+  Event buffers for buffers of eventBytes: as many as fit in the memory of
+  the default pool, at least bufferLevel + 2.  Only with a rate target:
+  0 (MAX_EVENT_POOL) otherwise.
+*/
+int
+rocTunePoolDepth(int eventBytes, int bufferLevel)
+{
+  long depth;
+
+  if((rocTune.rate <= 0) || (eventBytes <= 0))
+    return 0;
+
+  depth = ((long) MAX_EVENT_POOL * MAX_EVENT_LENGTH) / eventBytes;
+  if(depth > MAX_EVENT_POOL)
+    depth = MAX_EVENT_POOL;
+  if(depth < bufferLevel + 2)
+    depth = bufferLevel + 2;
+  if(depth > ROC_RING_MAX)
+    depth = ROC_RING_MAX;
+
+  return depth;
+}
+
+/* Go: levels of this run, clear the measurements */
+void
+rocTuneStart(int blockLevel, int bufferLevel)
+{
+  rocTune.blockLevel = blockLevel;
+  rocTune.bufferLevel = bufferLevel;
+  rocTune.blocks = 0;
+  rocTune.ns = 0;
+  rocTune.maxNs = 0;
+  memset(rocTune.hist, 0, sizeof(rocTune.hist));
+}
+
+/* rocTrigger: readout of a block took ns */
+static inline void
+rocTuneBlock(unsigned long long ns)
+{
+  rocTune.blocks++;
+  rocTune.ns += ns;
+  if(ns > rocTune.maxNs)
+    rocTune.maxNs = ns;
+  rocTune.hist[rocStatusWaitBin(ns)]++;
+}
+
+/* End: add the run to the model, and recommend levels */
+void
+rocTuneEnd()
+{
+  ROC_STATUS *st = &rocStat.st;
+  double runTime, rate, busy, meanNs, p99Ns, filled = 0;
+  uint64_t ntrig = 0, sum = 0, n;
+  int irun, blockLevel, bufferLevel;
+  unsigned int ibin;
+
+  if(rocTune.blocks < 10)
+    return;
+
+  runTime = 1e-9 * (rocStatusClock(CLOCK_REALTIME) - st->goTime);
+  if(runTime <= 0)
+    return;
+
+  meanNs = (double) rocTune.ns / rocTune.blocks;
+  rate = rocTune.blocks * rocTune.blockLevel / runTime;
+  busy = 1e-9 * rocTune.ns / runTime;
+
+  irun = rocTune.nrun++ % ROC_TUNE_NRUN;
+  rocTune.run[irun].blockLevel = rocTune.blockLevel;
+  rocTune.run[irun].ns = meanNs;
+  rocTuneFit();
+
+  /* 99th percentile: upper edge of its bin, at most the longest */
+  for(n = 0, ibin = 0; ibin < ROC_STATUS_NWAITBIN - 1; ibin++)
+    {
+      n += rocTune.hist[ibin];
+      if(n >= 0.99 * rocTune.blocks)
+	break;
+    }
+  p99Ns = 1e3 * rocStatusWaitBinLow(ibin + 1);
+  if(p99Ns > rocTune.maxNs)
+    p99Ns = rocTune.maxNs;
+  rocTune.peak = (p99Ns > meanNs) ? p99Ns / meanNs : 1;
+
+  for(ibin = 0; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    {
+      ntrig += st->filledHist[ibin];
+      sum += (uint64_t) ibin * st->filledHist[ibin];
+    }
+  if(ntrig)
+    filled = (double) sum / ntrig;
+
+  printf("%s: Block Level %d, Buffer Level %d: %.0f Hz, %.1f us per block "
+	 "(p99 < %.1f us, max %.1f us), readout busy %.1f %%\n", __func__,
+	 rocTune.blockLevel, rocTune.bufferLevel, rate, 1e-3 * meanNs, 1e-3 * p99Ns,
+	 1e-3 * rocTune.maxNs, 100 * busy);
+  printf("    Model: %.1f us per block + %.1f us per event (%d runs)\n",
+	 1e-3 * rocTune.a, 1e-3 * rocTune.b, rocTune.nrun);
+  printf("    Event buffers waiting for usrtrig: mean %.2f, max %u of %u, %llu waits for a free one\n",
+	 filled, st->filledMax, st->nodes, (unsigned long long) st->waitCount);
+
+  rocTuneChoose(rocTune.rate, &blockLevel, &bufferLevel);
+  printf("    Recommended for %.0f Hz: Block Level %d, Buffer Level %d\n",
+	 rocTune.rate, blockLevel, bufferLevel);
+  daLogMsg("INFO", "Recommended for %.0f Hz: Block Level %d, Buffer Level %d "
+	   "(%.1f us per block + %.1f us per event)",
+	   rocTune.rate, blockLevel, bufferLevel,
+	   1e-3 * rocTune.a, 1e-3 * rocTune.b);
+
+  /* Buffers full: the readout waited on usrtrig, more levels do not help */
+  if(st->waitCount && (st->filledMax + 1 >= st->nodes))
+    printf("    Event buffers full %llu times: downstream of usrtrig limits the rate, "
+	   "more buffers with 'pool=%u'\n", (unsigned long long) st->waitCount,
+	   2 * st->nodes);
+}
@@ -40,53 +40,107 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
-/* Routine to read in a file (as text) and create a String Bank
-   (uchar*) in a buffer
-*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROCUTILS_X86
+#endif
 
-int
-rocFile2Bank(const char *fname, uint8_t *buf,
-	      uint16_t banktag, uint8_t banknum,
-	      int32_t maxbytes)
+/* Swap the bytes of nwords 32 bit words, in place.
+   AVX2 or SSSE3 (pshufb) when the CPU has it, bswap_32 otherwise.
+   The buffer need only be 4 byte aligned.
+
+   The vector kernels use the gcc vector extensions rather than
+   immintrin.h, whose __pause() collides with the one in rol.h. */
+
+static void
+rocBswap32Scalar(uint32_t *w, size_t nwords)
 {
+  size_t ii;
 
-  int ii, c, ilen, rem;
-  FILE *fid;
-  int maxb = 1024 * 1024 * 4;	/* max output buffer size */
-  uint32_t bank_header[2];
+  for(ii = 0; ii < nwords; ii++)
+    w[ii] = bswap_32(w[ii]);
+}
 
-  if(fname == NULL)
+#ifdef ROCUTILS_X86
+typedef uint8_t rocBytes16 __attribute__((vector_size(16)));
+typedef uint8_t rocBytes32 __attribute__((vector_size(32)));
+
+__attribute__((target("avx2")))
+static void
+rocBswap32AVX2(uint32_t *w, size_t nwords)
+{
+  const rocBytes32 mask = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+			    15, 14, 13, 12, 19, 18, 17, 16, 23, 22, 21, 20,
+			    27, 26, 25, 24, 31, 30, 29, 28 };
+  rocBytes32 r0, r1;
+  size_t ii = 0;
+
+  for(; ii + 16 <= nwords; ii += 16)
     {
-      printf("%s: ERROR: No filename was specified\n", __func__);
-      return -1;
+      memcpy(&r0, w + ii, 32);
+      memcpy(&r1, w + ii + 8, 32);
+      r0 = __builtin_shuffle(r0, mask);
+      r1 = __builtin_shuffle(r1, mask);
+      memcpy(w + ii, &r0, 32);
+      memcpy(w + ii + 8, &r1, 32);
     }
 
-  if((maxbytes == 0) || (maxbytes > maxb))
-    maxbytes = maxb;		/* Default to 4 MB */
+  rocBswap32Scalar(w + ii, nwords - ii);
+}
 
+__attribute__((target("ssse3")))
+static void
+rocBswap32SSSE3(uint32_t *w, size_t nwords)
+{
+  const rocBytes16 mask = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8,
+			    15, 14, 13, 12 };
+  rocBytes16 r;
+  size_t ii = 0;
 
-  fid = fopen(fname, "r");
-  if(fid == NULL)
+  for(; ii + 4 <= nwords; ii += 4)
     {
-      printf("%s: ERROR: The file %s does not exist \n", __func__, fname);
-      return -1;
-    }
-  else
-    {
-      printf("%s: INFO: Opened file %s for reading into Bank (%x,%x) \n",
-	     __func__, fname, banktag, banknum);
+      memcpy(&r, w + ii, 16);
+      r = __builtin_shuffle(r, mask);
+      memcpy(w + ii, &r, 16);
     }
 
-  /* Read in the file to the buffer */
-  ilen = 8;			/* leave the header words */
+  rocBswap32Scalar(w + ii, nwords - ii);
+}
+#endif /* ROCUTILS_X86 */
 
-  while((ilen < maxbytes) && ((c = getc(fid)) != EOF))
+void
+rocBswap32(uint32_t *w, size_t nwords)
+{
+#ifdef ROCUTILS_X86
+  static int level = -1;	/* 0 = scalar, 1 = SSSE3, 2 = AVX2 */
+
+  if(level < 0)
     {
-      buf[ilen++] = c;
+      __builtin_cpu_init();
+      level = __builtin_cpu_supports("avx2") ? 2 :
+	__builtin_cpu_supports("ssse3") ? 1 : 0;
     }
-  fclose(fid);
-  printf("%s: INFO: Read %d bytes into buffer\n", __func__, ilen);
+
+  if(level == 2)
+    rocBswap32AVX2(w, nwords);
+  else if(level == 1)
+    rocBswap32SSSE3(w, nwords);
+  else
+#endif
+    rocBswap32Scalar(w, nwords);
+}
+
+/* Pad the string at buf[8] (ilen - 8 bytes) to an integral number of
+   words, write the bank header and (BYTESWAPIT) swap the data words.
+   Returns the length of the bank in words. */
+static int
+rocBankFinish(uint8_t *buf, int ilen, uint16_t banktag, uint8_t banknum)
+{
+  int ii, rem;
+  uint32_t bank_header[2];
 
   /* Make sure we null terminate the buffer and pad it out to an
      integal number of words */
@@ -96,7 +150,6 @@ rocFile2Bank(const char *fname, uint8_t *buf,
       for(ii = 0; ii < rem; ii++)
 	buf[(ilen + ii)] = 0;
       ilen += ii;
-      //      rem = 0;
     }
   else
     {
@@ -112,83 +165,88 @@ rocFile2Bank(const char *fname, uint8_t *buf,
 
   /*Swap the bytes going to the Async Event 32 bit Fifo */
 #ifdef BYTESWAPIT
-    {
-      uint8_t aa, bb;
-      for(ii = 8; ii <= (bank_header[0] << 2); ii += 4)
-	{
-	  aa = buf[ii];
-	  bb = buf[ii + 1];
-	  buf[ii] = buf[ii + 3];
-	  buf[ii + 1] = buf[ii + 2];
-	  buf[ii + 2] = bb;
-	  buf[ii + 3] = aa;
-	}
-    }
+  rocBswap32((uint32_t *) &buf[8], bank_header[0] - 1);
 #endif /* BYTESWAPIT */
 
   return (bank_header[0] + 1);
-
 }
 
+/* Routine to read in a file (as text) and create a String Bank
+   (uchar*) in a buffer
+*/
+
 int
-rocBuffer2Bank(const char *inbuf, uint8_t *buf,
+rocFile2Bank(const char *fname, uint8_t *buf,
 	      uint16_t banktag, uint8_t banknum,
-	      int32_t nbytes)
+	      int32_t maxbytes)
 {
 
-  int ii, c, ilen, ibyte = 0, rem;
+  int fd, ilen;
+  ssize_t nread;
   int maxb = 1024 * 1024 * 4;	/* max output buffer size */
-  uint32_t bank_header[2];
 
-  if(nbytes > maxb)
-    nbytes = maxb;		/* Default to 4 MB */
-
-  /* Read in the file to the buffer */
-  ilen = 8;			/* leave the header words */
-  ibyte = 0;
-  while(ibyte < nbytes)
+  if(fname == NULL)
     {
-      buf[ilen++] = inbuf[ibyte++];
+      printf("%s: ERROR: No filename was specified\n", __func__);
+      return -1;
     }
-  printf("%s: INFO: Read %d bytes into buffer\n", __func__, ilen);
 
-  /* Make sure we null terminate the buffer and pad it out to an
-     integal number of words */
-  rem = 4 - (ilen & 0x3);
-  if(rem < 4)
+  if((maxbytes == 0) || (maxbytes > maxb))
+    maxbytes = maxb;		/* Default to 4 MB */
+
+
+  fd = open(fname, O_RDONLY);
+  if(fd < 0)
     {
-      for(ii = 0; ii < rem; ii++)
-	buf[(ilen + ii)] = 0;
-      ilen += ii;
+      printf("%s: ERROR: The file %s does not exist \n", __func__, fname);
+      return -1;
     }
   else
     {
-      rem = 0;			/* no padding necessary just NULL terminate */
-      buf[ilen] = 0;
+      printf("%s: INFO: Opened file %s for reading into Bank (%x,%x) \n",
+	     __func__, fname, banktag, banknum);
     }
 
-  /* Write the header info in the buffer */
-  /* Bank Tag */
-  bank_header[0] = (ilen>>2) - 1; /* divide by 4  and subtract 1 */
-  bank_header[1] = (banktag<<16)|(rem<<14)|(3<<8)| banknum;
-  memcpy(&buf[0],&bank_header[0],8);
-
-  /*Swap the bytes going to the Async Event 32 bit Fifo */
-#ifdef BYTESWAPIT
+  /* Read in the file to the buffer, straight after the header words */
+  ilen = 8;
+  while(ilen < maxbytes)
     {
-      uint8_t aa, bb;
-      for(ii = 8; ii <= (bank_header[0] << 2); ii += 4)
+      nread = read(fd, &buf[ilen], maxbytes - ilen);
+      if(nread < 0)
 	{
-	  aa = buf[ii];
-	  bb = buf[ii + 1];
-	  buf[ii] = buf[ii + 3];
-	  buf[ii + 1] = buf[ii + 2];
-	  buf[ii + 2] = bb;
-	  buf[ii + 3] = aa;
+	  if(errno == EINTR)
+	    continue;
+	  perror("read");
+	  break;
 	}
+      if(nread == 0)
+	break;
+      ilen += nread;
     }
-#endif /* BYTESWAPIT */
+  close(fd);
+  printf("%s: INFO: Read %d bytes into buffer\n", __func__, ilen);
 
-  return (bank_header[0] + 1);
+  return rocBankFinish(buf, ilen, banktag, banknum);
+}
+
+int
+rocBuffer2Bank(const char *inbuf, uint8_t *buf,
+	      uint16_t banktag, uint8_t banknum,
+	      int32_t nbytes)
+{
+
+  int ilen;
+  int maxb = 1024 * 1024 * 4;	/* max output buffer size */
+
+  if(nbytes > maxb)
+    nbytes = maxb;		/* Default to 4 MB */
+  if(nbytes < 0)
+    nbytes = 0;
+
+  /* Copy in the buffer, after the header words */
+  memcpy(&buf[8], inbuf, nbytes);
+  ilen = 8 + nbytes;
+  printf("%s: INFO: Read %d bytes into buffer\n", __func__, ilen);
 
+  return rocBankFinish(buf, ilen, banktag, banknum);
 }
@@ -0,0 +1,363 @@
+/*************************************************************************
+ *
+ *  rocmon.c - Print the run status and the per-stage readout latency of
+ *             a running readout list, from its shared memory segments
+ *             (see rocStatus.h and rocTiming.h).
+ *
+ *     The latency is only there with a list compiled with -DROC_TIMING.
+ *
+ *     Usage:  rocmon [-r rocid] [-i seconds]
+ *
+ *       -r rocid    ROC ID of the readout list (default: every ROC found
+ *                   in /dev/shm)
+ *       -i seconds  Repeat every <seconds>, showing the rate since the
+ *                   last print, on a cleared screen on a terminal
+ *                   (default: print once)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "rocTiming.h"
+#include "rocStatus.h"
+
+#define MAX_ROCS 32
+
+static const char *stageNames[ROC_STAGE_MAX] = ROC_STAGE_NAMES;
+static const char *stateNames[ROC_STATE_MAX] = ROC_STATE_NAMES;
+
+static ROC_STATUS_SHM *
+rocmonAttachStatus(const char *path)
+{
+  ROC_STATUS_SHM *shm;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    {
+      perror(path);
+      return NULL;
+    }
+
+  shm = mmap(NULL, sizeof(ROC_STATUS_SHM), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(shm == MAP_FAILED)
+    {
+      perror("mmap");
+      return NULL;
+    }
+
+  if((shm->magic != ROC_STATUS_MAGIC) || (shm->version != ROC_STATUS_VERSION)
+     || (shm->size != sizeof(ROC_STATUS)))
+    {
+      fprintf(stderr, "%s: not a (version %d) rocStatus segment\n",
+	      path, ROC_STATUS_VERSION);
+      munmap(shm, sizeof(ROC_STATUS_SHM));
+      return NULL;
+    }
+
+  return shm;
+}
+
+static ROC_TIMING_SHM *
+rocmonAttach(const char *path)
+{
+  ROC_TIMING_SHM *shm;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    {
+      perror(path);
+      return NULL;
+    }
+
+  shm = mmap(NULL, sizeof(ROC_TIMING_SHM), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(shm == MAP_FAILED)
+    {
+      perror("mmap");
+      return NULL;
+    }
+
+  if((shm->magic != ROC_TIMING_MAGIC) || (shm->version != ROC_TIMING_VERSION)
+     || (shm->nstage != ROC_STAGE_MAX) || (shm->nbin != ROC_TIMING_NBIN))
+    {
+      fprintf(stderr, "%s: not a (version %d) rocTiming segment\n",
+	      path, ROC_TIMING_VERSION);
+      munmap(shm, sizeof(ROC_TIMING_SHM));
+      return NULL;
+    }
+
+  return shm;
+}
+
+/* Value (ns) below which a fraction frac of the entries are */
+static double
+rocmonPercentile(ROC_TIMING_STAGE *s, uint64_t count, double frac)
+{
+  uint64_t sum = 0, want = (uint64_t) (frac * count + 0.5);
+  unsigned int ibin;
+
+  if(want == 0)
+    want = 1;
+
+  for(ibin = 0; ibin < ROC_TIMING_NBIN; ibin++)
+    {
+      sum += s->bin[ibin];
+      if(sum >= want)
+	return 0.5 * (rocTimingBinLow(ibin) + rocTimingBinLow(ibin + 1));
+    }
+
+  return (double) s->max;
+}
+
+static void
+rocmonPrint(ROC_TIMING_SHM *shm, uint64_t *lastCount, double dt)
+{
+  ROC_TIMING_STAGE *s;
+  uint64_t count;
+  int istage;
+
+  printf("ROC %d  (pid %d)  run %d\n", shm->rocid, shm->pid, shm->runNumber);
+  printf("  %-20s %12s %10s %10s %10s %10s %10s %10s\n",
+	 "stage", "count", "rate(Hz)", "min(us)", "avg(us)", "p50(us)",
+	 "p99(us)", "max(us)");
+
+  for(istage = 0; istage < ROC_STAGE_MAX; istage++)
+    {
+      s = &shm->stage[istage];
+      count = __atomic_load_n(&s->count, __ATOMIC_ACQUIRE);
+
+      printf("  %-20s %12llu ", stageNames[istage], (unsigned long long) count);
+      if(dt > 0)
+	printf("%10.1f ", (count - lastCount[istage]) / dt);
+      else
+	printf("%10s ", "-");
+      lastCount[istage] = count;
+
+      if(count == 0)
+	{
+	  printf("\n");
+	  continue;
+	}
+
+      printf("%10.2f %10.2f %10.2f %10.2f %10.2f\n",
+	     1e-3 * s->min, 1e-3 * s->sum / count,
+	     1e-3 * rocmonPercentile(s, count, 0.50),
+	     1e-3 * rocmonPercentile(s, count, 0.99), 1e-3 * s->max);
+    }
+  printf("\n");
+}
+
+/* Seconds, from ns since epoch to now */
+static double
+rocmonAge(uint64_t ns)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  return (now.tv_sec + 1e-9 * now.tv_nsec) - 1e-9 * ns;
+}
+
+/* Bin of hist (ROC_STATUS_NFILLBIN bins, n entries) below which a
+   fraction frac of the entries are */
+static unsigned int
+rocmonHistPercentile(const uint64_t *hist, uint64_t n, double frac)
+{
+  uint64_t sum = 0, want = (uint64_t) (frac * n + 0.5);
+  unsigned int ibin;
+
+  if(want == 0)
+    want = 1;
+
+  for(ibin = 0; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    {
+      sum += hist[ibin];
+      if(sum >= want)
+	return ibin;
+    }
+
+  return ROC_STATUS_NFILLBIN - 1;
+}
+
+static void
+rocmonPrintStatus(ROC_STATUS_SHM *shm)
+{
+  ROC_STATUS st;
+  time_t t;
+  char when[32];
+  uint64_t ntrig = 0, sum = 0, ncall;
+  unsigned int ibin;
+
+  if(rocStatusRead(shm, &st) != 0)
+    {
+      printf("ROC %d  (pid %d)  status busy\n\n", shm->rocid, shm->pid);
+      return;
+    }
+
+  printf("ROC %d  (pid %d)  run %d  %s", shm->rocid, shm->pid, st.runNumber,
+	 ((st.state >= 0) && (st.state < ROC_STATE_MAX)) ? stateNames[st.state] : "?");
+  if(st.state == ROC_STATE_ACTIVE)
+    printf(" for %.0f s", rocmonAge(st.goTime));
+  printf("  (updated %.1f s ago)\n", rocmonAge(st.updateTime));
+
+  printf("  triggers %12llu   events %12llu   %10.1f Hz   %8.2f MB/s\n",
+	 (unsigned long long) st.triggers, (unsigned long long) st.events,
+	 st.eventRate, st.dataRate);
+  printf("  buffers  %5u x %-8u filled %4u   max %4u   (vmeIN free %u)\n",
+	 st.nodes, st.nodeBytes, st.filled, st.filledMax, st.nodes - st.filled);
+  printf("  stalls   pool empty %llu   no buffer %llu   waits %llu (%.3f s, max %.3f ms)   cut %llu\n",
+	 (unsigned long long) st.emptyCount, (unsigned long long) st.errCount,
+	 (unsigned long long) st.waitCount, 1e-9 * st.waitNs, 1e-6 * st.waitMaxNs,
+	 (unsigned long long) st.truncated);
+
+  /* Backpressure: buffers waiting for usrtrig at a trigger, waits by duration */
+  for(ibin = 0; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    {
+      ntrig += st.filledHist[ibin];
+      sum += (uint64_t) ibin * st.filledHist[ibin];
+    }
+  if(ntrig)
+    printf("  waiting  at a trigger: mean %.2f   p50 %u   p90 %u   p99 %u   max %u of %u\n",
+	   (double) sum / ntrig, rocmonHistPercentile(st.filledHist, ntrig, 0.50),
+	   rocmonHistPercentile(st.filledHist, ntrig, 0.90),
+	   rocmonHistPercentile(st.filledHist, ntrig, 0.99), st.filledMax, st.nodes);
+  /* Events copied out by each call of usrtrig, when batched */
+  for(ncall = 0, sum = 0, ibin = 1; ibin < ROC_STATUS_NFILLBIN; ibin++)
+    {
+      ncall += st.batchHist[ibin];
+      sum += (uint64_t) ibin * st.batchHist[ibin];
+    }
+  if(ncall && (sum > ncall))
+    printf("  usrtrig  events per call: mean %.2f   p50 %u   p90 %u   p99 %u\n",
+	   (double) sum / ncall, rocmonHistPercentile(st.batchHist, ncall, 0.50),
+	   rocmonHistPercentile(st.batchHist, ncall, 0.90),
+	   rocmonHistPercentile(st.batchHist, ncall, 0.99));
+
+  if(st.handoffCount)
+    printf("  handoff  to usrtrig: mean %.1f us   max %.3f ms\n",
+	   1e-3 * st.handoffNs / st.handoffCount, 1e-6 * st.handoffMaxNs);
+
+  if(st.waitCount)
+    {
+      printf("  waits    (us)");
+      for(ibin = 0; ibin < ROC_STATUS_NWAITBIN; ibin++)
+	if(st.waitHist[ibin])
+	  printf("  <%llu: %llu", (unsigned long long) rocStatusWaitBinLow(ibin + 1),
+		 (unsigned long long) st.waitHist[ibin]);
+      printf("\n");
+    }
+
+  if(st.errors)
+    {
+      t = st.lastErrorTime / 1000000000ULL;
+      strftime(when, sizeof(when), "%H:%M:%S", localtime(&t));
+      printf("  errors   %llu   last: trigger %lld at %s, code 0x%x: %.*s\n",
+	     (unsigned long long) st.errors, (long long) st.lastErrorEvent, when,
+	     st.lastErrorCode, (int) sizeof(st.lastError), st.lastError);
+    }
+  else
+    printf("  errors   0\n");
+
+  printf("\n");
+}
+
+static void
+usage(char *prog)
+{
+  printf("Usage: %s [-r rocid] [-i seconds]\n", prog);
+}
+
+int
+main(int argc, char *argv[])
+{
+  ROC_TIMING_SHM *shm[MAX_ROCS];
+  ROC_STATUS_SHM *status[MAX_ROCS];
+  uint64_t lastCount[MAX_ROCS][ROC_STAGE_MAX];
+  struct timespec t0, t1;
+  double interval = 0, dt = 0;
+  char path[256];
+  glob_t g;
+  int opt, rocid = -1, nroc = 0, nstatus = 0, iroc, clear;
+  size_t ipath;
+
+  while((opt = getopt(argc, argv, "r:i:h")) != -1)
+    {
+      switch (opt)
+	{
+	case 'r': rocid = atoi(optarg); break;
+	case 'i': interval = atof(optarg); break;
+	default:
+	  usage(argv[0]);
+	  return 1;
+	}
+    }
+
+  if(rocid >= 0)
+    {
+      snprintf(path, sizeof(path), "/dev/shm" ROC_STATUS_SHM_NAME, rocid);
+      if((access(path, F_OK) == 0) && ((status[0] = rocmonAttachStatus(path)) != NULL))
+	nstatus = 1;
+      snprintf(path, sizeof(path), "/dev/shm" ROC_TIMING_SHM_NAME, rocid);
+      if((access(path, F_OK) == 0) && ((shm[0] = rocmonAttach(path)) != NULL))
+	nroc = 1;
+    }
+  else
+    {
+      if(glob("/dev/shm/rocStatus.*", 0, NULL, &g) == 0)
+	{
+	  for(ipath = 0; (ipath < g.gl_pathc) && (nstatus < MAX_ROCS); ipath++)
+	    if((status[nstatus] = rocmonAttachStatus(g.gl_pathv[ipath])) != NULL)
+	      nstatus++;
+	  globfree(&g);
+	}
+      if(glob("/dev/shm/rocTiming.*", 0, NULL, &g) == 0)
+	{
+	  for(ipath = 0; (ipath < g.gl_pathc) && (nroc < MAX_ROCS); ipath++)
+	    if((shm[nroc] = rocmonAttach(g.gl_pathv[ipath])) != NULL)
+	      nroc++;
+	  globfree(&g);
+	}
+    }
+
+  if((nroc == 0) && (nstatus == 0))
+    {
+      fprintf(stderr, "%s: No readout list status or timing found in /dev/shm\n",
+	      argv[0]);
+      return 1;
+    }
+
+  /* Like top, on a terminal */
+  clear = (interval > 0) && isatty(STDOUT_FILENO);
+
+  memset(lastCount, 0, sizeof(lastCount));
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+
+  while(1)
+    {
+      if(clear)
+	printf("\033[H\033[2J");
+      for(iroc = 0; iroc < nstatus; iroc++)
+	rocmonPrintStatus(status[iroc]);
+      for(iroc = 0; iroc < nroc; iroc++)
+	rocmonPrint(shm[iroc], lastCount[iroc], dt);
+      fflush(stdout);
+
+      if(interval <= 0)
+	break;
+
+      usleep((useconds_t) (interval * 1e6));
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      dt = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+      t0 = t1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+/*************************************************************************
+ *
+ *  fadcPackCheck.c - Round trip check and throughput of the FADC bank
+ *                    compaction (../fadcPack.c).
+ *
+ *     Packs and unpacks FADC banks and checks that the words come back
+ *     unchanged, then reports the compaction and MB/s of both ways.
+ *
+ *     Usage:  fadcPackCheck [-n iterations] [capture file ...]
+ *
+ *       Without a capture file, synthetic banks are used: every window
+ *       width from 0 to 130, pedestals with noise and pulses, odd
+ *       windows, sample words with bits outside of the sample fields and
+ *       a channel cut short by the end of the bank.
+ *
+ *       With capture files (usrString capture=<dir>, see rocCapture.h),
+ *       the FADC banks (tag 0x3) of every event buffer are used, and
+ *       packed banks (FADC_PACK_BANK) are unpacked and packed again.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../rocCapture.h"
+#include "../fadcPack.c"
+
+#define FADC_BANK   0x3
+#define MAX_BANKS   100000
+#define MAX_WORDS   (64 * 1024 * 1024)
+
+/* The FADC bank data (after the bank header) to check */
+static uint32_t *bankData[MAX_BANKS];
+static int bankWords[MAX_BANKS];
+static int nbank = 0;
+
+static unsigned long long simRng = 88172645463325252ULL;
+
+static unsigned int
+rnd()
+{
+  simRng ^= simRng << 13;
+  simRng ^= simRng >> 7;
+  simRng ^= simRng << 17;
+  return (unsigned int) simRng;
+}
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static void
+addBank(const uint32_t *data, int nwords)
+{
+  if(nbank >= MAX_BANKS)
+    return;
+
+  bankData[nbank] = malloc((nwords + 1) * sizeof(uint32_t));
+  memcpy(bankData[nbank], data, nwords * sizeof(uint32_t));
+  bankWords[nbank++] = nwords;
+}
+
+/* One module block of window raw data, channels of width ptw */
+static uint32_t *
+synthBlock(uint32_t *dp, int slot, int ptw, int nbad)
+{
+  int ichan, is, ped, amp, t0;
+  uint32_t s[2];
+
+  *dp++ = 0x80000000 | (slot << 22) | (1 << 18) | 1;
+  *dp++ = 0x90000000 | (slot << 22) | (rnd() & 0x3fffff);
+  *dp++ = 0x98000000 | (rnd() & 0xffffff);
+  *dp++ = rnd() & 0xffffff;
+
+  for(ichan = 0; ichan < 16; ichan++)
+    {
+      *dp++ = 0xa0000000 | (ichan << 23) | ptw;
+      ped = 50 + rnd() % 400;
+      amp = (rnd() % 4 == 0) ? rnd() % 4000 : 0;
+      t0 = ptw ? rnd() % ptw : 0;
+
+      for(is = 0; is < ptw + (ptw & 1); is++)
+	{
+	  int v = ped + (int) (rnd() % 9) - 4;
+
+	  if(amp && (is >= t0))
+	    v += amp * exp(-(is - t0) / 4.0);
+	  if(v > 0x1fff)
+	    v = 0x1fff;		/* Overflow bit */
+	  s[is & 1] = v;
+	  if(is >= ptw)
+	    s[1] = (1 << 13);	/* Not valid */
+	  if(is & 1)
+	    *dp++ = (s[0] << 16) | s[1];
+	}
+
+      /* Words that are not window raw data */
+      if(nbad-- > 0)
+	dp[-1] |= (rnd() & 1) ? 0x40000000 : 0x0000c000;
+    }
+
+  *dp++ = 0x88000000 | (slot << 22) | 0;
+  return dp;
+}
+
+static void
+synthBanks()
+{
+  uint32_t *buf = malloc(MAX_WORDS / 16 * sizeof(uint32_t)), *dp;
+  int ptw, islot;
+
+  for(ptw = 0; ptw <= 130; ptw++)
+    {
+      dp = buf;
+      for(islot = 3; islot < 7; islot++)
+	dp = synthBlock(dp, islot, ptw, (islot == 6) ? 2 : 0);
+      addBank(buf, dp - buf);
+
+      /* Cut short in the samples of the last channel */
+      if(ptw > 4)
+	addBank(buf, dp - buf - 3);
+    }
+
+  free(buf);
+}
+
+/* FADC banks from the event buffers in a capture file */
+static int
+captureBanks(const char *filename)
+{
+  ROC_CAPTURE_HEADER *hdr;
+  ROC_CAPTURE_RECORD *rec;
+  uint32_t *ev, *bank, *evend, *tmp;
+  struct stat st;
+  char *map, *p, *end;
+  int fd, n;
+
+  fd = open(filename, O_RDONLY);
+  if((fd < 0) || (fstat(fd, &st) < 0))
+    {
+      perror(filename);
+      return -1;
+    }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    {
+      perror("mmap");
+      return -1;
+    }
+
+  hdr = (ROC_CAPTURE_HEADER *) map;
+  if((st.st_size < sizeof(ROC_CAPTURE_HEADER)) || (hdr->magic != ROC_CAPTURE_MAGIC))
+    {
+      fprintf(stderr, "%s: not a capture file\n", filename);
+      return -1;
+    }
+
+  tmp = malloc(MAX_WORDS / 16 * sizeof(uint32_t));
+  p = map + hdr->headerBytes;
+  end = p + hdr->nbytes;
+  if(end > map + st.st_size)
+    end = map + st.st_size;
+
+  while(p + sizeof(ROC_CAPTURE_RECORD) <= end)
+    {
+      rec = (ROC_CAPTURE_RECORD *) p;
+      ev = (uint32_t *) (rec + 1);
+      evend = ev + rec->nwords;
+      if((char *) evend > end)
+	break;
+
+      for(bank = ev; bank + 1 < evend; bank += bank[0] + 1)
+	{
+	  if(bank + bank[0] + 1 > evend)
+	    break;
+	  if((bank[1] >> 16) == FADC_BANK)
+	    addBank(&bank[2], bank[0] - 1);
+	  else if((bank[1] >> 16) == FADC_PACK_BANK)
+	    {
+	      n = fadcUnpackBank(&bank[2], bank[0] - 1, tmp, MAX_WORDS / 16);
+	      if(n < 0)
+		printf("ERROR: %s: packed bank does not unpack\n", filename);
+	      else
+		addBank(tmp, n);
+	    }
+	}
+      p = (char *) evend;
+    }
+
+  free(tmp);
+  munmap(map, st.st_size);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t *packed, *unpacked;
+  int opt, niter = 20, ib, it, n, nu, nerr = 0, nraw = 0;
+  unsigned long long win = 0, wout = 0;
+  double t0, tpack, tunpack;
+
+  while((opt = getopt(argc, argv, "n:h")) != -1)
+    {
+      switch (opt)
+	{
+	case 'n': niter = atoi(optarg); break;
+	default:
+	  printf("Usage: %s [-n iterations] [capture file ...]\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  if(optind < argc)
+    {
+      for(; optind < argc; optind++)
+	if(captureBanks(argv[optind]) < 0)
+	  return 1;
+    }
+  else
+    synthBanks();
+
+  if(nbank == 0)
+    {
+      printf("No FADC banks found\n");
+      return 1;
+    }
+
+  packed = malloc(MAX_WORDS / 16 * sizeof(uint32_t));
+  unpacked = malloc(MAX_WORDS / 16 * sizeof(uint32_t));
+
+  /* Round trip */
+  for(ib = 0; ib < nbank; ib++)
+    {
+      win += bankWords[ib];
+      n = fadcPackBank(bankData[ib], bankWords[ib], packed, MAX_WORDS / 16);
+      if(n < 0)
+	{
+	  printf("ERROR: bank %d (%d words) does not pack\n", ib, bankWords[ib]);
+	  nerr++;
+	  continue;
+	}
+      if(n >= bankWords[ib])
+	nraw++;			/* The list keeps the FADC bank */
+      wout += (n < bankWords[ib]) ? n : bankWords[ib];
+
+      nu = fadcUnpackBank(packed, n, unpacked, MAX_WORDS / 16);
+      if((nu != bankWords[ib]) ||
+	 memcmp(unpacked, bankData[ib], nu * sizeof(uint32_t)) != 0)
+	{
+	  printf("ERROR: bank %d (%d words) does not unpack to the same words\n",
+		 ib, bankWords[ib]);
+	  nerr++;
+	}
+    }
+
+  printf("%d banks, %llu words: %s\n", nbank, win,
+	 nerr ? "ROUND TRIP FAILED" : "round trip OK");
+  printf("  packed %llu words  (%.2f : 1),  %d banks kept as they are\n",
+	 wout, (double) win / wout, nraw);
+
+  /* Throughput */
+  t0 = now();
+  for(it = 0; it < niter; it++)
+    for(ib = 0; ib < nbank; ib++)
+      fadcPackBank(bankData[ib], bankWords[ib], packed, MAX_WORDS / 16);
+  tpack = now() - t0;
+
+  /* Pack and unpack, less the packing time */
+  t0 = now();
+  for(it = 0; it < niter; it++)
+    for(ib = 0; ib < nbank; ib++)
+      {
+	n = fadcPackBank(bankData[ib], bankWords[ib], packed, MAX_WORDS / 16);
+	fadcUnpackBank(packed, n, unpacked, MAX_WORDS / 16);
+      }
+  tunpack = now() - t0 - tpack;
+
+  printf("  fadcPackBank    %10.1f MB/s\n", 4e-6 * win * niter / tpack);
+  if(tunpack > 0)
+    printf("  fadcUnpackBank  %10.1f MB/s\n", 4e-6 * win * niter / tunpack);
+
+  return nerr ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+/*************************************************************************
+ *
+ *  TIPRIMARY_source.h - Hardware stand-in for the CODA TIPRIMARY trigger
+ *                       source.  The trigger "fires" when an event is
+ *                       waiting in vmeOUT.
+ *
+ */
+
+#ifndef __TIPRIMARY_ROL__
+#define __TIPRIMARY_ROL__
+
+static int TIPRIMARY_handlers, TIPRIMARYflag;
+static int TIPRIMARY_isAsync;
+
+extern DMA_MEM_ID vmeOUT;
+
+static void
+TIPRIMARYtenable(int code, int val)
+{
+  TIPRIMARYflag = 1;
+}
+
+static void
+TIPRIMARYtdisable(int code, int val)
+{
+  TIPRIMARYflag = 0;
+}
+
+static unsigned int
+TIPRIMARYttype()
+{
+  return (1);
+}
+
+static int
+TIPRIMARYttest()
+{
+  if(dmaPEmpty(vmeOUT))
+    return (0);
+  else
+    return (1);
+}
+
+#define TIPRIMARY_TEST  TIPRIMARYttest
+
+#define TIPRIMARY_INIT { TIPRIMARY_handlers = 0; TIPRIMARY_isAsync = 0; TIPRIMARYflag = 0; }
+
+#define TIPRIMARY_ASYNC(code, id) {					\
+    printf("No Async mode is available for TIPRIMARY\n");		\
+  }
+
+#define TIPRIMARY_SYNC(code, id) {					\
+    TIPRIMARY_handlers = (id); TIPRIMARY_isAsync = 0;			\
+  }
+
+#define TIPRIMARY_SETA(code) TIPRIMARYflag = code;
+#define TIPRIMARY_SETS(code) TIPRIMARYflag = code;
+#define TIPRIMARY_ENA(code, val) TIPRIMARYtenable(code, val);
+#define TIPRIMARY_DIS(code, val) TIPRIMARYtdisable(code, val);
+#define TIPRIMARY_CLRS(code) TIPRIMARYflag = 0;
+#define TIPRIMARY_GETID(code) TIPRIMARY_handlers
+#define TIPRIMARY_TTYPE TIPRIMARYttype
+#define TIPRIMARY_START(val) {;}
+#define TIPRIMARY_STOP(val) {TIPRIMARYtdisable(val, 0);}
+#define TIPRIMARY_ENCODE(code) (code)
+
+#endif /* __TIPRIMARY_ROL__ */
@@ -0,0 +1,17 @@
+/*************************************************************************
+ *
+ *  dalmaRolLib.h - Hardware stand-in for the library that pipes stdout
+ *                  to daLogMsg.  Output simply stays on stdout.
+ *
+ */
+
+#ifndef __DALMAROLLIB_SIM_H__
+#define __DALMAROLLIB_SIM_H__
+
+int dalmaInit(int force);
+int dalmaClose();
+
+#define DALMAGO   {;}
+#define DALMASTOP {;}
+
+#endif /* __DALMAROLLIB_SIM_H__ */
@@ -0,0 +1,27 @@
+/*************************************************************************
+ *
+ *  dmaBankTools.h - Hardware stand-in for the jvme bank macros used to
+ *                   build CODA banks in a DMA event buffer.
+ *
+ */
+
+#ifndef __DMABANKTOOLS_SIM_H__
+#define __DMABANKTOOLS_SIM_H__
+
+#define BT_BANK_ty  0x10
+#define BT_UI4_ty   0x01
+#define BT_UC1_ty   0x07
+#define BT_SEG_ty   0x20
+
+static unsigned int *StartOfBank;
+
+#define BANKOPEN(bnum, btype, code) {					\
+    StartOfBank = (dma_dabufp);						\
+    *(++(dma_dabufp)) = (((bnum) << 16) | (btype##_ty) << 8) | (code); \
+    ((dma_dabufp))++;}
+
+#define BANKCLOSE {							\
+    *StartOfBank = (unsigned int) ((dma_dabufp) - StartOfBank) - 1;	\
+  }
+
+#endif /* __DMABANKTOOLS_SIM_H__ */
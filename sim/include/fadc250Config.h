@@ -0,0 +1,14 @@
+/*************************************************************************
+ *
+ *  fadc250Config.h - Hardware stand-in for the FADC250 configuration
+ *                    file library.
+ *
+ */
+
+#ifndef __FADC250CONFIG_SIM_H__
+#define __FADC250CONFIG_SIM_H__
+
+int fadc250Config(char *fname);
+int fadc250UploadAll(char *string, int length);
+
+#endif /* __FADC250CONFIG_SIM_H__ */
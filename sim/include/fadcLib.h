@@ -0,0 +1,72 @@
+/*************************************************************************
+ *
+ *  fadcLib.h - Hardware stand-in for the JLab FADC250 library.
+ *
+ *     faReadBlock() produces FADC250 block data in the module format
+ *     (block header/trailer, event header, trigger time, window raw
+ *     data sized from PTW, filler words) for every module in the
+ *     multiblock chain.
+ *
+ */
+
+#ifndef __FADCLIB_SIM_H__
+#define __FADCLIB_SIM_H__
+
+#include "jvme.h"
+
+#define FA_MAX_BOARDS 20
+
+#define FA_INIT_SOFT_SYNCRESET  0x0
+#define FA_INIT_EXT_SYNCRESET   0x1
+#define FA_INIT_SOFT_TRIG       0x0
+#define FA_INIT_FP_TRIG         0x2
+#define FA_INIT_VXS_TRIG        0x4
+#define FA_INIT_INT_CLKSRC      0x0
+#define FA_INIT_FP_CLKSRC       0x10
+#define FA_INIT_VXS_CLKSRC      0x20
+#define FA_INIT_SKIP            0x10000
+#define FA_INIT_USE_ADDRLIST    0x20000
+#define FA_INIT_SKIP_FIRMWARE_CHECK 0x40000
+
+/* Data format (bit 31 set: data type defining word) */
+#define FA_DATA_TYPE_DEFINE     0x80000000
+#define FA_DATA_TYPE_MASK       0x78000000
+#define FA_DATA_BLOCK_HEADER    0x00000000
+#define FA_DATA_BLOCK_TRAILER   0x08000000
+#define FA_DATA_EVENT_HEADER    0x10000000
+#define FA_DATA_TRIGGER_TIME    0x18000000
+#define FA_DATA_WINDOW_RAW      0x20000000
+#define FA_DATA_INVALID         0x70000000
+#define FA_DATA_FILLER          0x78000000
+
+extern int fadcA32Base;
+extern int nfadc;
+
+int  faInit(unsigned int addr, unsigned int addr_inc, int nadc, int iFlag);
+void faGStatus(int sflag);
+int  faSlot(unsigned int i);
+unsigned int faScanMask();
+void faEnableMultiBlock(int tflag);
+void faDisableMultiBlock();
+int  faEnableBusError(int id);
+int  faResetMGT(int id, int reset);
+int  faSetTrigOut(int id, int trigout);
+int  faSetTriggerBusyCondition(int id, int trigger_max);
+void faSoftReset(int id, int cflag);
+void faResetToken(int id);
+void faResetTriggerCount(int id);
+void faEnableSyncReset(int id);
+void faGSetBlockLevel(int level);
+int  faGetProcMode(int id, int *pmode, unsigned int *PL, unsigned int *PTW,
+		   unsigned int *NSB, unsigned int *NSA, unsigned int *NP);
+void faGEnable(int eflag, int bank);
+void faGDisable(int eflag);
+void faGReset(int reset);
+
+unsigned int faGBlockReady(unsigned int slotmask, int nloop);
+int  faBready(int id);
+int  faReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag);
+int  faGetBlockError(int pflag);
+unsigned int faGetA32(int id);
+
+#endif /* __FADCLIB_SIM_H__ */
@@ -0,0 +1,107 @@
+/*************************************************************************
+ *
+ *  jvme.h - Hardware stand-in for the JLab VME library (jvme).
+ *
+ *     Provides the subset of the VME bus, DMA and memory partition
+ *     (dmaPList) interface used by the readout lists, implemented on
+ *     plain heap memory in simLib.c.
+ *
+ */
+
+#ifndef __JVME_SIM_H__
+#define __JVME_SIM_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifndef OK
+#define OK     0
+#endif
+#ifndef ERROR
+#define ERROR -1
+#endif
+
+typedef unsigned int UINT32;
+typedef void (*VOIDFUNCPTR) ();
+
+/* Memory partition node (same layout as dmaPList.h) */
+typedef struct dmanode
+{
+  struct dmanode *n;		/* Next node in the partition list */
+  struct dma_mem_part *part;	/* Partition that this node belongs to */
+  unsigned long physMemBase;	/* Physical (bus) address of this node */
+  volatile int type;		/* Event type */
+  volatile long nevent;		/* Event number */
+  volatile long length;		/* Length of data (in words) */
+  volatile unsigned int data[1];	/* Start of the data */
+} DMANODE;
+
+typedef struct dma_mem_part
+{
+  char name[40];		/* Name of the partition */
+  int size;			/* Size of each node (bytes, header included) */
+  int c;			/* Number of nodes owned by the partition */
+  int incr;			/* Increment to grow partition (unused) */
+  int totalMem;			/* Total memory allocated */
+  char *mem;			/* Node memory (NULL for queue-only partitions) */
+  size_t mapBytes;		/* Of mem, when mapped (simConfig.hugePages), else 0 */
+  int huge;			/* mem: 0 = 4 KB pages, 1 = transparent huge pages, 2 = hugetlbfs */
+  DMANODE *head, *tail;		/* Linked list of queued nodes */
+  int count;			/* Number of nodes currently in the list */
+  pthread_mutex_t mutex;
+  struct dma_mem_part *next;	/* Next partition in the global list */
+} DMA_MEM_PART;
+
+typedef DMA_MEM_PART *DMA_MEM_ID;
+
+extern DMANODE *the_event;
+extern unsigned int *dma_dabufp;
+
+int  dmaPartInit();
+void dmaPFreeAll();
+DMA_MEM_ID dmaPCreate(char *name, int size, int c, int incr);
+void dmaPFree(DMA_MEM_ID pPart);
+int  dmaPReInit(DMA_MEM_ID pPart);
+int  dmaPReInitAll();
+void dmaPStats(DMA_MEM_ID pPart);
+void dmaPStatsAll();
+DMANODE *dmaPGetItem(DMA_MEM_ID pPart);
+void dmaPFreeItem(DMANODE *pItem);
+void dmaPEnqueue(DMA_MEM_ID pPart, DMANODE *pItem);
+int  dmaPEmpty(DMA_MEM_ID pPart);
+int  dmaPNodeCount(DMA_MEM_ID pPart);
+
+/* Grab an event buffer from the input partition */
+#define GETEVENT(inputList, eventNumber) {				\
+    the_event = dmaPGetItem(inputList);					\
+    if(the_event) {							\
+      the_event->nevent = eventNumber;					\
+      the_event->length = 0;						\
+      dma_dabufp = (unsigned int *) &(the_event->data[0]);		\
+    }									\
+  }
+
+/* Close the event and put it on the output partition */
+#define PUTEVENT(outputList) {						\
+    the_event->length = dma_dabufp - (unsigned int *)&(the_event->data[0]); \
+    if(the_event->length == 0)						\
+      printf("PUTEVENT: Empty event length\n");				\
+    dmaPEnqueue(outputList, the_event);					\
+  }
+
+/* VME bus access and DMA */
+int  vmeDmaConfig(unsigned int addrType, unsigned int dataType, unsigned int sstMode);
+int  vmeDmaFlush(unsigned int addr);
+int  vmeCheckMutexHealth(int time_seconds);
+int  vmeBusLock();
+int  vmeBusUnlock();
+
+/* vxWorks compatibility */
+int  taskDelay(int ticks);
+int  logMsg(char *format, ...);
+
+#endif /* __JVME_SIM_H__ */
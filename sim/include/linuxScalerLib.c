@@ -0,0 +1,14 @@
+/*************************************************************************
+ *
+ *  linuxScalerLib.c - Hardware stand-in for the scaler server interface
+ *                     used by the readout list.  Implemented in simLib.c.
+ *
+ */
+
+int  fadcscaler_init_crl();
+void set_runstatus(int status);
+void enable_scalers();
+void disable_scalers();
+int  read_fadc_scalers(unsigned int **dabufp, int flag);
+int  read_ti_scalers(unsigned int **dabufp, int flag);
+void read_clock_channels();
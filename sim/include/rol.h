@@ -0,0 +1,205 @@
+/*************************************************************************
+ *
+ *  rol.h - Hardware stand-in for the CODA readout list framework header.
+ *
+ *     Provides the readout list parameter block, the transition entry
+ *     point (INIT_NAME), the polling dispatcher and the event building
+ *     macros that tiprimary_list.c expects from CODA.  The entry point is
+ *     driven by rocsim.c instead of the CODA ROC.
+ *
+ */
+
+#ifndef __ROL_SIM_H__
+#define __ROL_SIM_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Transition codes passed in rolParameters.daproc */
+#define DA_INIT_PROC      0
+#define DA_DOWNLOAD_PROC  1
+#define DA_PRESTART_PROC  2
+#define DA_END_PROC       3
+#define DA_PAUSE_PROC     4
+#define DA_GO_PROC        5
+#define DA_POLL_PROC      6
+#define DA_DONE_PROC      7
+#define DA_RESET_PROC     8
+
+typedef struct rolParameters *rolParam;
+
+struct rolParameters
+{
+  char *name;			/* name of this readout list */
+  int runType;
+  int runNumber;
+  int daproc;			/* transition to execute */
+  int pid;			/* ROC ID */
+  int poll;			/* 1 if the list is to be polled */
+  int inited;
+  int doDone;
+  int *nevents;			/* number of events taken */
+  int *async_roc;		/* 0 for a normal ROC */
+  int recNb;			/* output record number */
+  int dbufSize;			/* size of the output buffer (words) */
+  unsigned int *dabufp;		/* output write pointer */
+  unsigned int *dabufpi;	/* input read pointer (ROL2) */
+  char *usrString;		/* usrString from the configuration */
+  char *usrConfig;		/* usrConfig from the configuration */
+  int err;			/* set by ROL_SET_ERROR */
+};
+
+static rolParam rol;
+
+/* Globals that CODA provides to the readout list */
+static int blockLevel = 1;
+static int syncFlag = 0;
+static int lateFail = 0;
+static int poolEmpty = 0;
+
+#define ROCID (rol->pid)
+
+#define ROL_SET_ERROR { rol->err = 1; }
+
+/* The sim never keeps a pending transition event */
+#define __the_event__ 0
+#define WRITE_EVENT_ {}
+
+static void __download();
+static void __prestart();
+static void __end();
+static void __pause();
+static void __go();
+static void __done();
+static void __reset();
+static void __poll();
+
+/* Trigger source dispatch, filled in by CTRIGRSS */
+static struct
+{
+  int (*test) ();
+  void (*routine) (unsigned long, unsigned long);
+  void (*done) ();
+  int code;
+  int type;
+  int enabled;
+} __trig_src;
+
+#define CTRIGINIT { memset(&__trig_src, 0, sizeof(__trig_src)); }
+
+#define CTRIGRSS(source, tcode, handler, done_routine) {		\
+    void handler(unsigned long, unsigned long); void done_routine();	\
+    source##_SYNC(tcode, tcode);					\
+    __trig_src.test = (int (*)()) source##_TEST;			\
+    __trig_src.routine = handler;					\
+    __trig_src.done = done_routine;					\
+    __trig_src.code = (tcode);						\
+  }
+
+#define CRTTYPE(ttype, source, tcode) { __trig_src.type = (ttype); }
+
+#define CDOENABLE(source, tcode, val) {					\
+    source##_ENA(tcode, val);						\
+    __trig_src.enabled = 1;						\
+  }
+
+#define CDODISABLE(source, tcode, val) {				\
+    __trig_src.enabled = 0;						\
+    source##_DIS(tcode, val);						\
+  }
+
+/* Event building in the output buffer (rol->dabufp) */
+static unsigned int *StartOfEvent[32];
+static int event_depth__ = 0;
+
+#ifndef BT_BANK_ty
+#define BT_BANK_ty  0x10
+#define BT_UI4_ty   0x01
+#define BT_UC1_ty   0x07
+#define BT_SEG_ty   0x20
+#endif
+
+#define CEOPEN(bnum, btype, nev) {					\
+    StartOfEvent[event_depth__++] = (rol->dabufp);			\
+    *(++(rol->dabufp)) = ((bnum) << 16) | ((btype##_ty) << 8) | (0xff & (nev)); \
+    (rol->dabufp)++;							\
+  }
+
+#define CECLOSE {							\
+    event_depth__--;							\
+    *StartOfEvent[event_depth__] =					\
+      (unsigned int) ((rol->dabufp) - StartOfEvent[event_depth__]) - 1; \
+    (*(rol->nevents))++;						\
+  }
+
+#define UEOPEN(bnum, btype, nev) {					\
+    StartOfEvent[event_depth__++] = (rol->dabufp);			\
+    *(++(rol->dabufp)) = ((bnum) << 16) | ((btype##_ty) << 8) | (0xff & (nev)); \
+    (rol->dabufp)++;							\
+  }
+
+#define UECLOSE {							\
+    event_depth__--;							\
+    *StartOfEvent[event_depth__] =					\
+      (unsigned int) ((rol->dabufp) - StartOfEvent[event_depth__]) - 1; \
+  }
+
+/* Transition entry point */
+void
+INIT_NAME(rolParam rolp)
+{
+  switch (rolp->daproc)
+    {
+    case DA_INIT_PROC:
+      rol = rolp;
+      rolp->inited = 1;
+      break;
+    case DA_DOWNLOAD_PROC:
+      __download();
+      break;
+    case DA_PRESTART_PROC:
+      __prestart();
+      break;
+    case DA_PAUSE_PROC:
+      __pause();
+      break;
+    case DA_END_PROC:
+      __end();
+      break;
+    case DA_GO_PROC:
+      __go();
+      break;
+    case DA_POLL_PROC:
+      __poll();
+      break;
+    case DA_DONE_PROC:
+      __done();
+      break;
+    case DA_RESET_PROC:
+      __reset();
+      break;
+    }
+}
+
+/* Poll the trigger source once, dispatch to the trigger routine if ready */
+static void
+__poll()
+{
+  if(__trig_src.enabled && __trig_src.test && (*__trig_src.test) ())
+    {
+      (*__trig_src.routine) (__trig_src.type, __trig_src.code);
+      if(__trig_src.done)
+	(*__trig_src.done) ();
+    }
+}
+
+void
+INIT_NAME_POLL()
+{
+  __poll();
+}
+
+#endif /* __ROL_SIM_H__ */
@@ -0,0 +1,7 @@
+/*************************************************************************
+ *
+ *  scale32LibNew.c - Hardware stand-in for the scaler server SCALE32
+ *                    library.  Nothing from it is used directly by the
+ *                    readout list.
+ *
+ */
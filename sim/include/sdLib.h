@@ -0,0 +1,14 @@
+/*************************************************************************
+ *
+ *  sdLib.h - Hardware stand-in for the JLab Signal Distribution library.
+ *
+ */
+
+#ifndef __SDLIB_SIM_H__
+#define __SDLIB_SIM_H__
+
+int sdInit(int flag);
+int sdStatus(int pflag);
+int sdSetActiveVmeSlots(unsigned int vmemask);
+
+#endif /* __SDLIB_SIM_H__ */
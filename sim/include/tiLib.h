@@ -0,0 +1,116 @@
+/*************************************************************************
+ *
+ *  tiLib.h - Hardware stand-in for the JLab pipeline TI library.
+ *
+ *     Triggers are generated in software at the rate configured in
+ *     simConfig (see simLib.h).  tiIntEnable() starts a polling thread
+ *     that calls the connected routine once per available block, as the
+ *     TI_READOUT_*_POLL modes of the real library do.
+ *
+ */
+
+#ifndef __TILIB_SIM_H__
+#define __TILIB_SIM_H__
+
+#include "jvme.h"
+
+#define TI_READOUT_EXT_INT    0
+#define TI_READOUT_EXT_POLL   1
+#define TI_READOUT_TS_INT     2
+#define TI_READOUT_TS_POLL    3
+
+#define TI_INIT_NO_INIT              (1<<0)
+#define TI_INIT_SKIP_FIRMWARE_CHECK  (1<<2)
+#define TI_INIT_SLAVE_FIBER_1        (0)
+#define TI_INIT_SLAVE_FIBER_5        (1<<1)
+
+#define TI_TRIGGER_P0        0
+#define TI_TRIGGER_HFBR1     1
+#define TI_TRIGGER_FPTRG     2
+#define TI_TRIGGER_TSINPUTS  3
+#define TI_TRIGGER_TSREV2    4
+#define TI_TRIGGER_PULSER    5
+
+#define TI_TSINPUT_1  (1<<0)
+#define TI_TSINPUT_2  (1<<1)
+#define TI_TSINPUT_3  (1<<2)
+#define TI_TSINPUT_4  (1<<3)
+#define TI_TSINPUT_5  (1<<4)
+#define TI_TSINPUT_6  (1<<5)
+
+#define TI_INT_VEC 0xec
+
+struct TI_A24RegStruct
+{
+  volatile unsigned int boardID;
+};
+
+extern volatile struct TI_A24RegStruct *TIp;
+extern int tiNeedAck;
+
+/* Lock held by the polling thread while the connected routine runs */
+extern pthread_mutex_t tiISR_mutex;
+#define INTLOCK {							\
+    if(pthread_mutex_lock(&tiISR_mutex) < 0)				\
+      perror("pthread_mutex_lock");					\
+  }
+#define INTUNLOCK {							\
+    if(pthread_mutex_unlock(&tiISR_mutex) < 0)				\
+      perror("pthread_mutex_unlock");					\
+  }
+
+int  tiInit(unsigned int tAddr, unsigned int mode, int iFlag);
+int  tiStatus(int pflag);
+int  tiSetFiberLatencyOffset_preInit(int flo);
+int  tiSetCrateID_preInit(int cid);
+int  tiSetEventFormat(int format);
+int  tiClockReset();
+int  tiTrigLinkReset();
+int  tiSyncReset(int bflag);
+int  tiSetSyncResetType(int type);
+int  tiSetUserSyncResetReceive(int enable);
+int  tiUserSyncReset(int enable, int pflag);
+int  tiEnableVXSSignals();
+int  tiDisableVXSSignals();
+
+int  tiSetTriggerSource(int trig);
+int  tiDisableTriggerSource(int fflag);
+int  tiEnableTSInput(unsigned int inpMask);
+int  tiLoadTriggerTable(int mode);
+int  tiSetTriggerHoldoff(int rule, unsigned int value, int timestep);
+int  tiSetTriggerPulse(int trigger, int delay, int width, int delay_step);
+int  tiSetPromptTriggerWidth(int width);
+int  tiSetPrescale(int prescale);
+int  tiSetInputPrescale(int input, int prescale);
+int  tiSetFPInputReadout(int enable);
+int  tiSetFiberSyncDelay(unsigned int delay);
+int  tiSetSyncEventInterval(int blk_interval);
+int  tiSetRandomTrigger(int trigger, int setting);
+int  tiDisableRandomTrigger();
+int  tiSoftTrig(int trigger, unsigned int nevents, unsigned int period_inc, int range);
+
+int  tiSetBlockLevel(int blockLevel);
+int  tiGetCurrentBlockLevel();
+int  tiSetBlockBufferLevel(unsigned int level);
+int  tiGetBlockBufferLevel();
+int  tiGetBroadcastBlockBufferLevel();
+int  tiUseBroadcastBufferLevel(int enable);
+
+int  tiResetSlaveConfig();
+int  tiAddSlave(unsigned int fiber);
+int  tiRocEnable(int roc);
+
+int  tiIntConnect(unsigned int vector, VOIDFUNCPTR routine, unsigned int arg);
+int  tiIntDisconnect();
+int  tiIntEnable(int iflag);
+void tiIntDisable();
+unsigned int tiGetIntCount();
+
+int  tiBReady();
+unsigned int tiBlockStatus(int fiber, int pflag);
+int  tiReadTriggerBlock(volatile unsigned int *data);
+int  tiGetBlockSyncFlag();
+unsigned int tiGetAdr32();
+int  tiLive(int sflag);
+
+#endif /* __TILIB_SIM_H__ */
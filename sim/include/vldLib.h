@@ -0,0 +1,14 @@
+/*************************************************************************
+ *
+ *  vldLib.h - Hardware stand-in for the JLab VLD (LED driver) library.
+ *
+ */
+
+#ifndef __VLDLIB_SIM_H__
+#define __VLDLIB_SIM_H__
+
+int  vldInit(unsigned int addr, unsigned int addr_inc, int nfind, int iFlag);
+int  vldGetNVLD();
+void vldGStatus(int pflag);
+
+#endif /* __VLDLIB_SIM_H__ */
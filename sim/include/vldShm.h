@@ -0,0 +1,13 @@
+/*************************************************************************
+ *
+ *  vldShm.h - Hardware stand-in for the VLD shared memory readout.
+ *
+ */
+
+#ifndef __VLDSHM_SIM_H__
+#define __VLDSHM_SIM_H__
+
+int vldShmResetCounts(int clear_trig, int clear_pulse);
+int vldShmReadBlock(volatile unsigned int *data, int nwords);
+
+#endif /* __VLDSHM_SIM_H__ */
@@ -0,0 +1,235 @@
+/*************************************************************************
+ *
+ *  rocUtilsBench.c - Throughput (MB/s) of the config file to bank
+ *                    routines of rocUtils.c (BYTESWAPIT), against the
+ *                    previous getc() loader and scalar byte swap.
+ *
+ *     Usage:  rocUtilsBench [-s kbytes] [-n iterations] [-f file]
+ *
+ *       -s kbytes      Size of the generated config file (default 512)
+ *       -n iterations  Repetitions of each measurement (default 50)
+ *       -f file        Use this file instead of a generated one
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BYTESWAPIT
+#include "../rocUtils.c"
+
+/* The loaders as they were: getc() into the buffer, byte by byte swap */
+static int
+oldFile2Bank(const char *fname, uint8_t *buf, uint16_t banktag,
+	     uint8_t banknum, int32_t maxbytes)
+{
+  int ii, c, ilen;
+  FILE *fid;
+
+  fid = fopen(fname, "r");
+  if(fid == NULL)
+    return -1;
+
+  ilen = 8;
+  while((ilen < maxbytes) && ((c = getc(fid)) != EOF))
+    buf[ilen++] = c;
+  fclose(fid);
+
+  {
+    uint8_t aa, bb;
+    int last;
+
+    while(ilen & 0x3)
+      buf[ilen++] = 0;
+    last = ilen - 4;
+    for(ii = 8; ii <= last; ii += 4)
+      {
+	aa = buf[ii];
+	bb = buf[ii + 1];
+	buf[ii] = buf[ii + 3];
+	buf[ii + 1] = buf[ii + 2];
+	buf[ii + 2] = bb;
+	buf[ii + 3] = aa;
+      }
+  }
+
+  return ilen >> 2;
+}
+
+static double
+now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* rocUtils prints on every call: send stdout elsewhere while timing */
+static int savedStdout = -1;
+
+static void
+quiet(int on)
+{
+  fflush(stdout);
+  if(on)
+    {
+      int fd = open("/dev/null", O_WRONLY);
+      savedStdout = dup(1);
+      dup2(fd, 1);
+      close(fd);
+    }
+  else
+    {
+      dup2(savedStdout, 1);
+      close(savedStdout);
+    }
+}
+
+static void
+report(const char *name, double mbytes, int niter, double dt)
+{
+  printf("  %-32s %10.1f MB/s   %8.1f us/call\n", name, mbytes * niter / dt,
+	 1e6 * dt / niter);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char fname[256] = "";
+  int opt, kbytes = 512, niter = 50, ii, nbytes, nwords, owords;
+  int generated = 0;
+  uint8_t *buf, *ref;
+  char *text;
+  double t0, mbytes;
+  struct stat st;
+  FILE *f;
+
+  while((opt = getopt(argc, argv, "s:n:f:h")) != -1)
+    {
+      switch (opt)
+	{
+	case 's': kbytes = atoi(optarg); break;
+	case 'n': niter = atoi(optarg); break;
+	case 'f': strncpy(fname, optarg, sizeof(fname) - 1); break;
+	default:
+	  printf("Usage: %s [-s kbytes] [-n iterations] [-f file]\n", argv[0]);
+	  return 1;
+	}
+    }
+
+  if(fname[0] == '\0')
+    {
+      /* Something that looks like an fadc250 config dump */
+      snprintf(fname, sizeof(fname), "/tmp/rocUtilsBench.%d.cfg", getpid());
+      f = fopen(fname, "w");
+      if(f == NULL)
+	{
+	  perror(fname);
+	  return 1;
+	}
+      for(ii = 0; ftell(f) < kbytes * 1024; ii++)
+	fprintf(f, "FADC250_SLOT %d\nFADC250_TET %d %d %d %d %d %d %d %d\n",
+		3 + (ii % 18), ii, ii + 1, ii + 2, ii + 3, ii + 4, ii + 5,
+		ii + 6, ii + 7);
+      fclose(f);
+      generated = 1;
+    }
+
+  if(stat(fname, &st) < 0)
+    {
+      perror(fname);
+      return 1;
+    }
+  nbytes = st.st_size;
+  if(nbytes > 4 * 1024 * 1024 - 8)
+    nbytes = 4 * 1024 * 1024 - 8;
+  mbytes = nbytes / 1e6;
+
+  buf = malloc(nbytes + 16);
+  ref = malloc(nbytes + 16);
+  text = malloc(nbytes + 1);
+  f = fopen(fname, "r");
+  if(fread(text, 1, nbytes, f) != (size_t) nbytes)
+    printf("WARN: short read of %s\n", fname);
+  fclose(f);
+  text[nbytes] = '\0';
+
+  /* Same bank data (the header words differ: the old loader did not
+     write one here) */
+  owords = oldFile2Bank(fname, ref, 0x1, 0, nbytes + 8);
+  quiet(1);
+  nwords = rocFile2Bank(fname, buf, 0x1, 0, nbytes + 8);
+  quiet(0);
+  if((nwords != owords) ||
+     memcmp(buf + 8, ref + 8, (nwords - 2) * 4) != 0)
+    {
+      printf("ERROR: rocFile2Bank output differs from the old loader\n");
+      return 1;
+    }
+  quiet(1);
+  rocBuffer2Bank(text, buf, 0x1, 0, nbytes);
+  quiet(0);
+  if(memcmp(buf + 8, ref + 8, (nwords - 2) * 4) != 0)
+    {
+      printf("ERROR: rocBuffer2Bank output differs from the old loader\n");
+      return 1;
+    }
+
+  printf("%s: %d bytes, %d iterations\n", fname, nbytes, niter);
+
+  quiet(1);
+  t0 = now();
+  for(ii = 0; ii < niter; ii++)
+    oldFile2Bank(fname, buf, 0x1, 0, nbytes + 8);
+  double dOld = now() - t0;
+
+  t0 = now();
+  for(ii = 0; ii < niter; ii++)
+    rocFile2Bank(fname, buf, 0x1, 0, nbytes + 8);
+  double dFile = now() - t0;
+
+  t0 = now();
+  for(ii = 0; ii < niter; ii++)
+    rocBuffer2Bank(text, buf, 0x1, 0, nbytes);
+  double dBuf = now() - t0;
+  quiet(0);
+
+  report("file, getc + byte swap (old)", mbytes, niter, dOld);
+  report("rocFile2Bank", mbytes, niter, dFile);
+  report("rocBuffer2Bank", mbytes, niter, dBuf);
+
+  /* The swap kernels alone, on the data in the buffer */
+  nwords -= 2;
+  t0 = now();
+  for(ii = 0; ii < niter; ii++)
+    rocBswap32Scalar((uint32_t *) (buf + 8), nwords);
+  report("bswap32 scalar", mbytes, niter, now() - t0);
+
+#ifdef ROCUTILS_X86
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("ssse3"))
+    {
+      t0 = now();
+      for(ii = 0; ii < niter; ii++)
+	rocBswap32SSSE3((uint32_t *) (buf + 8), nwords);
+      report("bswap32 SSSE3", mbytes, niter, now() - t0);
+    }
+  if(__builtin_cpu_supports("avx2"))
+    {
+      t0 = now();
+      for(ii = 0; ii < niter; ii++)
+	rocBswap32AVX2((uint32_t *) (buf + 8), nwords);
+      report("bswap32 AVX2", mbytes, niter, now() - t0);
+    }
+#endif
+
+  if(generated)
+    unlink(fname);
+
+  free(buf);
+  free(ref);
+  free(text);
+
+  return 0;
+}
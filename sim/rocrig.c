@@ -0,0 +1,671 @@
+/*************************************************************************
+ *
+ *  rocrig.c - Run control test rig: random sequences of Download,
+ *             Prestart, Go, End and Reset through a readout list, with
+ *             triggers in flight and injected faults, against the
+ *             simulated TI / FADC250 / SD / VLD backend.
+ *
+ *     Each sequence starts with Download and ends with Reset, with up to
+ *     -m transitions in between, drawn from those run control allows in
+ *     the current state.  Go keeps the run active for a random time, at
+ *     a random trigger rate.  As in the CODA ROC, a second thread polls
+ *     the list (usrtrig) from Go to the end of End.
+ *
+ *     Faults, each in a fraction -f of the runs:
+ *
+ *       stall   the CODA thread stops polling for a while: the readout
+ *               thread runs out of free event buffers, possibly into End
+ *       error   FADC250 blocks with a broken structure (block errors)
+ *       stuck   from End, tiBReady / tiBlockStatus report a block that
+ *               never comes: End waits for it until its timeout
+ *       tisize  half of the TI blocks are one word per event longer: the
+ *               TI block changes size from one block to the next
+ *
+ *     Checks, after each transition:
+ *
+ *       - the list did not flag an error (ROL_SET_ERROR)
+ *       - the event ring is empty after Prestart and Reset
+ *       - End: each block read from the TI went to usrtrig or is in the
+ *         event ring, and no block was left in the TI (but with stuck)
+ *       - End returned before its timeout (-T), or at it with stuck
+ *       - no transition took more than -L ms (End with stuck excepted)
+ *       - End: no event out with a bad FADC bank (FADC_CHECK_BANK), but
+ *         with error
+ *
+ *     The wall time of each transition is reported at the end.  The
+ *     transitions, rates and faults of sequence i only depend on -S and
+ *     i: a failed sequence is run again on its own with -S seed -k i.
+ *
+ *     The output of the readout list goes to -o file (default /dev/null).
+ *
+ *     e.g.  ./rocrig_nps -n 2000 -u fapipeline
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "simLib.h"
+#include "fadcCheck.h"
+
+/* Same codes as include/rol.h */
+#define DA_INIT_PROC      0
+#define DA_DOWNLOAD_PROC  1
+#define DA_PRESTART_PROC  2
+#define DA_END_PROC       3
+#define DA_PAUSE_PROC     4
+#define DA_GO_PROC        5
+#define DA_POLL_PROC      6
+#define DA_DONE_PROC      7
+#define DA_RESET_PROC     8
+
+struct rolParameters
+{
+  char *name;
+  int runType;
+  int runNumber;
+  int daproc;
+  int pid;
+  int poll;
+  int inited;
+  int doDone;
+  int *nevents;
+  int *async_roc;
+  int recNb;
+  int dbufSize;
+  unsigned int *dabufp;
+  unsigned int *dabufpi;
+  char *usrString;
+  char *usrConfig;
+  int err;
+};
+
+extern void rocsim__init(struct rolParameters *rolp);
+extern void rocsim__poll();
+extern int getOutQueueCount();
+
+/* Output record buffer size (words) */
+#define OUTBUF_WORDS  (4 * 1024 * 1024)
+
+/* Run control states */
+enum rigStates
+  {
+    RIG_CONFIGURED = 0,		/* After Init and Reset */
+    RIG_DOWNLOADED,
+    RIG_PRESTARTED,
+    RIG_ACTIVE,
+    RIG_ENDED
+  };
+
+/* Transitions, as timed: End with stuck apart, it waits out its timeout */
+enum rigTransitions
+  {
+    RIG_DOWNLOAD = 0,
+    RIG_PRESTART,
+    RIG_GO,
+    RIG_END,
+    RIG_RESET,
+    RIG_END_STUCK,
+    RIG_NTRANS
+  };
+
+static const char *rigTransName[RIG_NTRANS] =
+  { "Download", "Prestart", "Go", "End", "Reset", "End stuck" };
+
+static const int rigTransProc[RIG_NTRANS] =
+  { DA_DOWNLOAD_PROC, DA_PRESTART_PROC, DA_GO_PROC, DA_END_PROC, DA_RESET_PROC,
+    DA_END_PROC };
+
+/* Transitions allowed in each state, the one towards a run first:
+   taken in RIG_FORWARD of the cases, one of the others otherwise */
+#define RIG_FORWARD  0.7
+
+static const int rigAllowed[][3] =
+  {
+    [RIG_CONFIGURED] = { RIG_DOWNLOAD, -1, -1 },
+    [RIG_DOWNLOADED] = { RIG_PRESTART, RIG_DOWNLOAD, RIG_RESET },
+    [RIG_PRESTARTED] = { RIG_GO, RIG_END, RIG_RESET },
+    [RIG_ACTIVE]     = { RIG_END, RIG_RESET, -1 },
+    [RIG_ENDED]      = { RIG_PRESTART, RIG_DOWNLOAD, RIG_RESET }
+  };
+
+static struct rolParameters rolp;
+static int nevents = 0, async_roc = 0;
+static unsigned int *outbuf, *trbuf;
+static FILE *report;
+
+/* Settings */
+static int nseq = 200, maxTrans = 12, onlySeq = -1;
+static unsigned int seed = 1;
+static double maxGoMs = 20, faultFraction = 0.2;
+static int endTimeoutMs = 200, limitMs = 0;
+static int verbose = 0;
+
+/* CODA thread: polls while codaPoll, but until stallUntil */
+static pthread_t coda;
+static pthread_mutex_t codaLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile int codaRunning = 0, codaPoll = 0;
+static volatile double stallUntil = 0;
+
+/* Events out with a bad FADC bank */
+static volatile unsigned long long badFadc = 0;
+
+/* Wall time of the transitions (ms) */
+static struct
+{
+  double *ms;
+  int n, size;
+} rigTimes[RIG_NTRANS];
+
+/* Totals */
+static unsigned long long nruns = 0, nfaults[4], nblocks = 0, nevout = 0;
+static unsigned long long nleft = 0, nlogErrors = 0;
+static int nfailures = 0;
+
+/* Sequence random numbers: xorshift64* */
+static unsigned long long rigRng;
+
+static unsigned int
+rigRand()
+{
+  rigRng ^= rigRng >> 12;
+  rigRng ^= rigRng << 25;
+  rigRng ^= rigRng >> 27;
+  return (unsigned int) ((rigRng * 2685821657736338717ULL) >> 32);
+}
+
+/* Uniform in [0, 1) */
+static double
+rigUniform()
+{
+  return rigRand() / 4294967296.0;
+}
+
+static void
+rigSleep(double ms)
+{
+  struct timespec ts;
+
+  if(ms <= 0)
+    return;
+
+  ts.tv_sec = (time_t) (ms / 1000);
+  ts.tv_nsec = (long) ((ms - 1000.0 * ts.tv_sec) * 1e6);
+  nanosleep(&ts, NULL);
+}
+
+/* Events of the last poll with a FADC_CHECK_BANK (each event: length,
+   header, banks) */
+static void
+rigScanOutput()
+{
+  unsigned int *ev, *bank, *end;
+
+  for(ev = outbuf; ev < rolp.dabufp; ev += ev[0] + 1)
+    {
+      end = ev + ev[0] + 1;
+      for(bank = ev + 2; bank < end; bank += bank[0] + 1)
+	if((bank[1] >> 16) == FADC_CHECK_BANK)
+	  {
+	    badFadc++;
+	    break;
+	  }
+    }
+}
+
+/* CODA thread: poll the readout list while the run is active or ending */
+static void *
+codaThread(void *arg)
+{
+  while(codaRunning)
+    {
+      if(!codaPoll || (simTime() < stallUntil))
+	{
+	  rigSleep(0.05);
+	  continue;
+	}
+
+      pthread_mutex_lock(&codaLock);
+      if(codaPoll)
+	{
+	  rolp.dabufp = outbuf;
+	  rocsim__poll();
+	  rigScanOutput();
+	}
+      pthread_mutex_unlock(&codaLock);
+    }
+
+  return NULL;
+}
+
+/* Start (on = 1) or stop the polls of the CODA thread.  Returns with no
+   poll in progress. */
+static void
+codaPolling(int on)
+{
+  pthread_mutex_lock(&codaLock);
+  codaPoll = on;
+  if(!on)
+    stallUntil = 0;
+  pthread_mutex_unlock(&codaLock);
+}
+
+static void
+rigTime(int itrans, double ms)
+{
+  if(rigTimes[itrans].n == rigTimes[itrans].size)
+    {
+      rigTimes[itrans].size = rigTimes[itrans].size ? 2 * rigTimes[itrans].size : 1024;
+      rigTimes[itrans].ms = realloc(rigTimes[itrans].ms,
+				    rigTimes[itrans].size * sizeof(double));
+      if(rigTimes[itrans].ms == NULL)
+	{
+	  perror("realloc");
+	  exit(1);
+	}
+    }
+
+  rigTimes[itrans].ms[rigTimes[itrans].n++] = ms;
+}
+
+static void
+rigFail(int iseq, int itrans, const char *fmt, ...)
+{
+  va_list ap;
+
+  nfailures++;
+  fprintf(report, "rocrig: FAIL: sequence %d, transition %d: ", iseq, itrans);
+  va_start(ap, fmt);
+  vfprintf(report, fmt, ap);
+  va_end(ap);
+  fprintf(report, "   (again with -S %u -k %d)\n", seed, iseq);
+  fflush(report);
+}
+
+/* Run a transition, return its wall time in ms */
+static double
+rigTransition(int daproc)
+{
+  double t0 = simTime();
+
+  rolp.daproc = daproc;
+  rolp.dabufp = trbuf;
+  rolp.err = 0;
+  rocsim__init(&rolp);
+
+  return 1e3 * (simTime() - t0);
+}
+
+/* Run of the current sequence, from Go */
+static struct
+{
+  int stall, error, stuck, tisize;
+  double stallAt, stallMs;
+  int eventsAtGo;
+  unsigned long long badAtGo;
+} run;
+
+/* Trigger rate, sync events and faults of the next run, before Go */
+static void
+rigRunSetup(double goMs)
+{
+  memset(&run, 0, sizeof(run));
+
+  /* Half of the runs as fast as the readout allows, the others 1 to 100 kHz */
+  simConfig.trigRate = (rigRand() & 1) ? 0 : 1000.0 * (1 + rigRand() % 100);
+  simConfig.syncInterval = (rigRand() & 1) ? 0 : 1 + rigRand() % 20;
+
+  run.stall = (rigUniform() < faultFraction);
+  run.error = (rigUniform() < faultFraction);
+  run.stuck = (rigUniform() < faultFraction);
+  run.tisize = (rigUniform() < faultFraction);
+
+  /* From a time in Go, up to twice the length of Go: into End */
+  run.stallAt = goMs * rigUniform();
+  run.stallMs = 2 * maxGoMs * rigUniform();
+
+  simConfig.faErrorFraction = run.error ? 0.05 : 0;
+  simConfig.tiStuckBReady = 0;
+  simConfig.tiLongFraction = run.tisize ? 0.5 : 0;
+
+  nfaults[0] += run.stall;
+  nfaults[1] += run.error;
+  nfaults[2] += run.stuck;
+  nfaults[3] += run.tisize;
+}
+
+/* Checks after transition itrans (trans, of ms) of sequence iseq */
+static void
+rigCheck(int iseq, int itrans, int trans, int wasActive, double ms)
+{
+  SIM_STATS stats;
+  int left;
+  long long lost;
+
+  if(rolp.err)
+    rigFail(iseq, itrans, "%s flagged an error", rigTransName[trans]);
+
+  if((limitMs > 0) && (trans != RIG_END_STUCK) && (ms > limitMs))
+    rigFail(iseq, itrans, "%s took %.3f ms (limit %d ms)",
+	    rigTransName[trans], ms, limitMs);
+
+  left = getOutQueueCount();
+
+  switch (trans)
+    {
+    case RIG_PRESTART:
+    case RIG_RESET:
+      if(left != 0)
+	rigFail(iseq, itrans, "%d events in the event ring after %s",
+		left, rigTransName[trans]);
+      break;
+
+    case RIG_END:
+    case RIG_END_STUCK:
+      if(ms >= endTimeoutMs)
+	{
+	  if(trans == RIG_END)
+	    rigFail(iseq, itrans, "End took %.3f ms, its timeout is %d ms",
+		    ms, endTimeoutMs);
+	}
+      else if(trans == RIG_END_STUCK)
+	rigFail(iseq, itrans, "End with a stuck tiBReady took %.3f ms, before its timeout (%d ms)",
+		ms, endTimeoutMs);
+
+      if(!wasActive)
+	break;
+
+      simGetStats(&stats);
+      lost = (long long) stats.blocks - (nevents - run.eventsAtGo) - left;
+      if(lost != 0)
+	rigFail(iseq, itrans, "%lld blocks read from the TI and lost (%llu read, %d out, %d in the ring)",
+		lost, stats.blocks, nevents - run.eventsAtGo, left);
+      if(stats.pending && (trans == RIG_END))
+	rigFail(iseq, itrans, "%llu blocks left in the TI after End", stats.pending);
+      if(left && (trans == RIG_END))
+	rigFail(iseq, itrans, "%d events left in the event ring after End", left);
+      if(!run.error && (badFadc != run.badAtGo))
+	rigFail(iseq, itrans, "%llu events out with a bad FADC bank",
+		badFadc - run.badAtGo);
+
+      nblocks += stats.blocks;
+      nevout += nevents - run.eventsAtGo;
+      nleft += left;
+      break;
+
+    default:
+      break;
+    }
+}
+
+static void
+rigSequence(int iseq)
+{
+  int itrans, trans, state = RIG_CONFIGURED, ntrans, nallowed, wasActive;
+  double ms, goMs = 0, t0;
+  SIM_STATS stats;
+
+  rigRng = (0x9E3779B97F4A7C15ULL * (2ULL * iseq + 1)) ^ (((unsigned long long) seed << 32) | seed);
+  if(rigRng == 0)
+    rigRng = 1;
+
+  /* Download, 1 to maxTrans transitions, Reset */
+  ntrans = 2 + rigRand() % maxTrans;
+
+  for(itrans = 0; itrans <= ntrans; itrans++)
+    {
+      if(itrans == 0)
+	trans = RIG_DOWNLOAD;
+      else if(itrans == ntrans)
+	trans = RIG_RESET;
+      else
+	{
+	  for(nallowed = 0; (nallowed < 3) && (rigAllowed[state][nallowed] >= 0); nallowed++)
+	    ;
+	  if((nallowed == 1) || (rigUniform() < RIG_FORWARD))
+	    trans = rigAllowed[state][0];
+	  else
+	    trans = rigAllowed[state][1 + rigRand() % (nallowed - 1)];
+	}
+
+      wasActive = (state == RIG_ACTIVE);
+
+      /* Before: CODA thread stops polling but for End, faults of the run */
+      switch (trans)
+	{
+	case RIG_GO:
+	  goMs = maxGoMs * rigUniform();
+	  rigRunSetup(goMs);
+	  run.eventsAtGo = nevents;
+	  run.badAtGo = badFadc;
+	  codaPolling(1);
+	  nruns++;
+	  break;
+
+	case RIG_END:
+	  if(run.stuck && wasActive)
+	    {
+	      trans = RIG_END_STUCK;
+	      simConfig.tiStuckBReady = 1;
+	    }
+	  break;
+
+	default:
+	  codaPolling(0);
+	  break;
+	}
+
+      if(verbose)
+	fprintf(report, "rocrig: sequence %d: %s\n", iseq, rigTransName[trans]);
+
+      ms = rigTransition(rigTransProc[trans]);
+      rigTime(trans, ms);
+
+      rigCheck(iseq, itrans, trans, wasActive, ms);
+
+      switch (trans)
+	{
+	case RIG_DOWNLOAD: state = RIG_DOWNLOADED; break;
+	case RIG_PRESTART: state = RIG_PRESTARTED; break;
+	case RIG_GO:       state = RIG_ACTIVE;     break;
+	case RIG_RESET:    state = RIG_CONFIGURED; break;
+	default:           state = RIG_ENDED;      break;
+	}
+
+      if((trans == RIG_END) || (trans == RIG_END_STUCK))
+	{
+	  codaPolling(0);
+	  simConfig.tiStuckBReady = 0;
+	}
+
+      /* Run, with triggers in flight, and the CODA thread stalled for a while */
+      if(trans == RIG_GO)
+	{
+	  t0 = simTime();
+	  if(run.stall)
+	    {
+	      rigSleep(run.stallAt);
+	      stallUntil = simTime() + 1e-3 * run.stallMs;
+	    }
+	  rigSleep(goMs - 1e3 * (simTime() - t0));
+	}
+    }
+
+  simGetStats(&stats);
+  nlogErrors = stats.logErrors;
+}
+
+/* Ascending, for the median and 99th percentile */
+static int
+rigCompare(const void *a, const void *b)
+{
+  double da = *(const double *) a, db = *(const double *) b;
+  return (da > db) - (da < db);
+}
+
+static void
+rigReport(double elapsed)
+{
+  int itrans, i, n, i99;
+  double sum, *ms;
+
+  fprintf(report, "\nrocrig: %d sequences, %llu runs in %.1f s   seed %u\n",
+	  (onlySeq >= 0) ? 1 : nseq, nruns, elapsed, seed);
+  fprintf(report, "  Faults             stall %llu   block error %llu   stuck tiBReady %llu   TI block size %llu\n",
+	  nfaults[0], nfaults[1], nfaults[2], nfaults[3]);
+  fprintf(report, "  Blocks read        %12llu\n", nblocks);
+  fprintf(report, "  Events out         %12llu\n", nevout);
+  fprintf(report, "  Left in the ring   %12llu  (at End, flushed at Prestart)\n", nleft);
+  fprintf(report, "  ERROR messages     %12llu\n", nlogErrors);
+
+  fprintf(report, "\n  %-10s %8s %10s %10s %10s %10s %10s\n",
+	  "Transition", "count", "min ms", "mean ms", "median", "p99", "max ms");
+  for(itrans = 0; itrans < RIG_NTRANS; itrans++)
+    {
+      n = rigTimes[itrans].n;
+      if(n == 0)
+	continue;
+
+      ms = rigTimes[itrans].ms;
+      qsort(ms, n, sizeof(double), rigCompare);
+      for(i = 0, sum = 0; i < n; i++)
+	sum += ms[i];
+      i99 = (int) (0.99 * n);
+      if(i99 >= n)
+	i99 = n - 1;
+
+      fprintf(report, "  %-10s %8d %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+	      rigTransName[itrans], n, ms[0], sum / n, ms[n / 2],
+	      ms[i99], ms[n - 1]);
+    }
+
+  fprintf(report, "\nrocrig: %s (%d failures)\n", nfailures ? "FAILED" : "passed", nfailures);
+}
+
+static void
+usage(char *prog)
+{
+  printf("Usage: %s [options]\n", prog);
+  printf("  -n nseq     Number of sequences (default %d)\n", nseq);
+  printf("  -m ntrans   Most transitions between Download and Reset (default %d)\n",
+	 maxTrans);
+  printf("  -S seed     Seed of the sequences (default %u)\n", seed);
+  printf("  -k iseq     Only run sequence iseq\n");
+  printf("  -g ms       Longest Go period (default %.0f ms)\n", maxGoMs);
+  printf("  -f frac     Fraction of the runs with each fault (default %.2f)\n",
+	 faultFraction);
+  printf("  -T ms       End timeout, usrString endtimeout (default %d ms)\n", endTimeoutMs);
+  printf("  -L ms       Fail a transition that takes longer, 0 = no limit (default 0)\n");
+  printf("  -N nfadc    Number of FADC250 (default %d)\n", simConfig.nfadc);
+  printf("  -u string   usrString passed to the readout list\n");
+  printf("  -c file     usrConfig (FADC250 config file) passed to the readout list\n");
+  printf("  -o file     Output of the readout list (default /dev/null)\n");
+  printf("  -v          Print each transition\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *usrString = "", *logFile = "/dev/null";
+  static char usr[1024];
+  double t0;
+  int opt, iseq;
+
+  memset(&rolp, 0, sizeof(rolp));
+  rolp.name = "rocrig";
+  rolp.pid = 10;
+  rolp.runNumber = 1;
+  rolp.nevents = &nevents;
+  rolp.async_roc = &async_roc;
+  rolp.dbufSize = OUTBUF_WORDS;
+  rolp.usrConfig = "";
+
+  while((opt = getopt(argc, argv, "n:m:S:k:g:f:T:L:N:u:c:o:vh")) != -1)
+    {
+      switch (opt)
+	{
+	case 'n': nseq = atoi(optarg); break;
+	case 'm': maxTrans = atoi(optarg); break;
+	case 'S': seed = strtoul(optarg, NULL, 0); break;
+	case 'k': onlySeq = atoi(optarg); break;
+	case 'g': maxGoMs = atof(optarg); break;
+	case 'f': faultFraction = atof(optarg); break;
+	case 'T': endTimeoutMs = atoi(optarg); break;
+	case 'L': limitMs = atoi(optarg); break;
+	case 'N': simConfig.nfadc = atoi(optarg); break;
+	case 'u': usrString = optarg; break;
+	case 'c': rolp.usrConfig = optarg; break;
+	case 'o': logFile = optarg; break;
+	case 'v': verbose = 1; break;
+	default:
+	  usage(argv[0]);
+	  return 1;
+	}
+    }
+
+  if(maxTrans < 1)
+    maxTrans = 1;
+  if(endTimeoutMs < 1)
+    endTimeoutMs = 1;
+
+  snprintf(usr, sizeof(usr), "%s%sendtimeout=%d", usrString,
+	   strlen(usrString) ? "," : "", endTimeoutMs);
+  rolp.usrString = usr;
+
+  outbuf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  trbuf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  if((outbuf == NULL) || (trbuf == NULL))
+    {
+      perror("malloc");
+      return 1;
+    }
+
+  /* Report on stdout, the readout list to logFile */
+  fflush(stdout);
+  report = fdopen(dup(fileno(stdout)), "w");
+  if((report == NULL) || (freopen(logFile, "w", stdout) == NULL) ||
+     (dup2(fileno(stdout), fileno(stderr)) < 0))
+    {
+      perror(logFile);
+      return 1;
+    }
+  setvbuf(report, NULL, _IOLBF, 0);
+
+  rigTransition(DA_INIT_PROC);
+
+  codaRunning = 1;
+  if(pthread_create(&coda, NULL, codaThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      return 1;
+    }
+
+  t0 = simTime();
+  if(onlySeq >= 0)
+    rigSequence(onlySeq);
+  else
+    for(iseq = 0; iseq < nseq; iseq++)
+      {
+	rigSequence(iseq);
+
+	if((nseq >= 10) && ((iseq + 1) % (nseq / 10) == 0))
+	  fprintf(report, "rocrig: %d sequences, %d failures\n", iseq + 1, nfailures);
+      }
+
+  codaRunning = 0;
+  pthread_join(coda, NULL);
+
+  rigReport(simTime() - t0);
+
+  free(outbuf);
+  free(trbuf);
+
+  return nfailures ? 1 : 0;
+}
@@ -0,0 +1,339 @@
+/*************************************************************************
+ *
+ *  rocsim.c - Drive a readout list through Download, Prestart, Go and End
+ *             against the simulated TI / FADC250 / SD / VLD backend.
+ *
+ *     The readout list is compiled unchanged with the stand-in headers
+ *     in include/ and linked with simLib.o (see Makefile).  As in the
+ *     CODA ROC, transitions run in the main thread while a second thread
+ *     polls the list (usrtrig) and passes each output event through a
+ *     ROL2 stand-in with the copy of event_list.crl.  With -B, each
+ *     event also goes through the previous (word by word) ROL2 copy,
+ *     and the time spent in both is compared.
+ *
+ *     At the end of the run, the throughput of the software path is
+ *     reported: the CPU time of the polls that returned events (usrtrig,
+ *     copy out of the event buffers) and the time in the ROL2 copy.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "simLib.h"
+#include "rocCopy.c"
+
+/* Same codes as include/rol.h */
+#define DA_INIT_PROC      0
+#define DA_DOWNLOAD_PROC  1
+#define DA_PRESTART_PROC  2
+#define DA_END_PROC       3
+#define DA_PAUSE_PROC     4
+#define DA_GO_PROC        5
+#define DA_POLL_PROC      6
+#define DA_DONE_PROC      7
+#define DA_RESET_PROC     8
+
+struct rolParameters
+{
+  char *name;
+  int runType;
+  int runNumber;
+  int daproc;
+  int pid;
+  int poll;
+  int inited;
+  int doDone;
+  int *nevents;
+  int *async_roc;
+  int recNb;
+  int dbufSize;
+  unsigned int *dabufp;
+  unsigned int *dabufpi;
+  char *usrString;
+  char *usrConfig;
+  int err;
+};
+
+extern void rocsim__init(struct rolParameters *rolp);
+extern void rocsim__poll();
+
+/* Output record buffer size (words) */
+#define OUTBUF_WORDS  (4 * 1024 * 1024)
+
+static struct rolParameters rolp;
+static int nevents = 0, async_roc = 0;
+static unsigned int *outbuf, *rol2buf, *rol2oldbuf, *trbuf;
+
+static volatile int codaRunning = 0;
+static int useRol2 = 1, benchRol2 = 0;
+
+/* Output statistics, accumulated by the CODA thread */
+static unsigned long long outEvents = 0, outWords = 0, outPolls = 0, rol2Words = 0;
+static unsigned long long rol2Mismatch = 0;
+static double codaCpu = 0, rol2Time = 0, rol2OldTime = 0, usrtrigTime = 0;
+
+static void
+transition(int daproc, char *name)
+{
+  double t0 = simTime();
+
+  rolp.daproc = daproc;
+  rolp.dabufp = trbuf;
+  rocsim__init(&rolp);
+
+  if(daproc != DA_INIT_PROC)
+    printf("rocsim: %-8s %8.3f ms\n", name, 1e3 * (simTime() - t0));
+
+  if(rolp.err)
+    printf("rocsim: WARN: %s flagged an error\n", name);
+}
+
+/* ROL2 stand-in: the trigger body of event_list.crl */
+static unsigned int *
+rol2Event(unsigned int *INPUT, int EVENT_LENGTH, unsigned int *dabufp)
+{
+  /* Copy event, including Header from Input to Output, in one block */
+  return rocCopyWords(dabufp, &INPUT[-2], EVENT_LENGTH + 2);
+}
+
+/* The previous event_list.crl trigger body, for -B */
+static unsigned int *
+rol2EventOld(unsigned int *INPUT, int EVENT_LENGTH, unsigned int *dabufp)
+{
+  int ii;
+
+  for(ii = -2; ii < EVENT_LENGTH; ii++)	/* Copy event, including Header from Input to Output */
+    *dabufp++ = INPUT[ii];
+
+  return dabufp;
+}
+
+/* CPU time of the calling thread */
+static double
+threadCpu()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* CODA thread: poll the readout list, then pass its output through ROL2 */
+static void *
+codaThread(void *arg)
+{
+  struct timespec cpu;
+  unsigned int *ev, *dp, *dpold;
+  int nwords;
+  double t0;
+
+  while(codaRunning)
+    {
+      rolp.dabufp = outbuf;
+      t0 = threadCpu();
+      rocsim__poll();
+      nwords = rolp.dabufp - outbuf;
+      if(nwords <= 0)
+	continue;
+
+      usrtrigTime += threadCpu() - t0;
+      outPolls++;
+      outWords += nwords;
+
+      if(useRol2)
+	{
+	  t0 = simTime();
+	  dp = rol2buf;
+	  for(ev = outbuf; ev < rolp.dabufp; ev += ev[0] + 1)
+	    dp = rol2Event(&ev[2], ev[0] - 1, dp);
+	  rol2Time += simTime() - t0;
+	  rol2Words += dp - rol2buf;
+
+	  if(benchRol2)
+	    {
+	      t0 = simTime();
+	      dpold = rol2oldbuf;
+	      for(ev = outbuf; ev < rolp.dabufp; ev += ev[0] + 1)
+		dpold = rol2EventOld(&ev[2], ev[0] - 1, dpold);
+	      rol2OldTime += simTime() - t0;
+
+	      if((dpold - rol2oldbuf != dp - rol2buf) ||
+		 memcmp(rol2buf, rol2oldbuf, (dp - rol2buf) * 4) != 0)
+		rol2Mismatch++;
+	    }
+	}
+    }
+
+  outEvents = nevents;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+  codaCpu = cpu.tv_sec + 1e-9 * cpu.tv_nsec;
+
+  return NULL;
+}
+
+static void
+usage(char *prog)
+{
+  printf("Usage: %s [options]\n", prog);
+  printf("  -t seconds  Length of the Go period (default 5)\n");
+  printf("  -r rate     L1A rate in Hz, 0 = as fast as the readout allows (default 0)\n");
+  printf("  -n nfadc    Number of FADC250 (default %d)\n", simConfig.nfadc);
+  printf("  -m mode     FADC250 processing mode (default %d)\n", simConfig.mode);
+  printf("  -w ptw      FADC250 window width in samples (default %d)\n", simConfig.ptw);
+  printf("  -p frac     Fraction of channels with a pulse (default %.2f)\n",
+	 simConfig.pulseFraction);
+  printf("  -l ns       FADC250 block ready latency after trigger readout (default 0)\n");
+  printf("  -v ns       Cost of a single cycle VME access (default 0)\n");
+  printf("  -d MB/s     Emulated FADC250 block transfer rate, CPU free meanwhile,\n"
+	 "              0 = memcpy (default 0)\n");
+  printf("  -s blocks   Sync event interval, 0 = none (default: readout list value)\n");
+  printf("  -V nvld     Number of VLD (default %d)\n", simConfig.nvld);
+  printf("  -e frac     Fraction of FADC250 blocks with a broken structure (default 0)\n");
+  printf("  -x words    Words added to each FADC250 block, beyond its expected size (default 0)\n");
+  printf("  -L frac     Fraction of TI blocks one word per event longer (default 0)\n");
+  printf("  -H          Event buffers (dmaPCreate) in 2 MB huge pages\n");
+  printf("  -u string   usrString passed to the readout list\n");
+  printf("  -c file     usrConfig (FADC250 config file) passed to the readout list\n");
+  printf("  -R rocid    ROC ID (default 10)\n");
+  printf("  -P file     Replay the event buffers of a capture file (usrString capture=<dir>)\n");
+  printf("  -N          Skip the ROL2 stand-in\n");
+  printf("  -B          Also run the previous ROL2 copy and compare the time in each\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  pthread_t coda;
+  double seconds = 5, t0, tgo;
+  SIM_STATS stats;
+  int opt;
+
+  memset(&rolp, 0, sizeof(rolp));
+  rolp.name = "rocsim";
+  rolp.pid = 10;
+  rolp.runNumber = 1;
+  rolp.nevents = &nevents;
+  rolp.async_roc = &async_roc;
+  rolp.dbufSize = OUTBUF_WORDS;
+  rolp.usrString = "";
+  rolp.usrConfig = "";
+
+  while((opt = getopt(argc, argv, "t:r:n:m:w:p:l:v:d:s:V:e:x:L:u:c:R:P:HNBh")) != -1)
+    {
+      switch (opt)
+	{
+	case 't': seconds = atof(optarg); break;
+	case 'r': simConfig.trigRate = atof(optarg); break;
+	case 'n': simConfig.nfadc = atoi(optarg); break;
+	case 'm': simConfig.mode = atoi(optarg); break;
+	case 'w': simConfig.ptw = atoi(optarg); break;
+	case 'p': simConfig.pulseFraction = atof(optarg); break;
+	case 'l': simConfig.faLatencyNs = atoi(optarg); break;
+	case 'v': simConfig.vmeCycleNs = atoi(optarg); break;
+	case 'd': simConfig.dmaMBps = atof(optarg); break;
+	case 's': simConfig.syncInterval = atoi(optarg); break;
+	case 'V': simConfig.nvld = atoi(optarg); break;
+	case 'e': simConfig.faErrorFraction = atof(optarg); break;
+	case 'x': simConfig.faExtraWords = atoi(optarg); break;
+	case 'L': simConfig.tiLongFraction = atof(optarg); break;
+	case 'H': simConfig.hugePages = 1; break;
+	case 'u': rolp.usrString = optarg; break;
+	case 'c': rolp.usrConfig = optarg; break;
+	case 'R': rolp.pid = atoi(optarg); break;
+	case 'P': simConfig.replayFile = optarg; break;
+	case 'N': useRol2 = 0; break;
+	case 'B': benchRol2 = 1; break;
+	default:
+	  usage(argv[0]);
+	  return 1;
+	}
+    }
+
+  outbuf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  rol2buf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  rol2oldbuf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  trbuf = malloc(OUTBUF_WORDS * sizeof(unsigned int));
+  if((outbuf == NULL) || (rol2buf == NULL) || (rol2oldbuf == NULL) ||
+     (trbuf == NULL))
+    {
+      perror("malloc");
+      return 1;
+    }
+
+  transition(DA_INIT_PROC, "Init");
+  transition(DA_DOWNLOAD_PROC, "Download");
+  transition(DA_PRESTART_PROC, "Prestart");
+
+  codaRunning = 1;
+  if(pthread_create(&coda, NULL, codaThread, NULL) != 0)
+    {
+      perror("pthread_create");
+      return 1;
+    }
+
+  transition(DA_GO_PROC, "Go");
+  tgo = simTime();
+
+  t0 = tgo + seconds;
+  while(simTime() < t0)
+    usleep(10000);
+
+  transition(DA_END_PROC, "End");
+  tgo = simTime() - tgo;
+
+  codaRunning = 0;
+  pthread_join(coda, NULL);
+
+  simGetStats(&stats);
+
+  printf("\nrocsim: %.2f s in Go   %d FADC250  mode %d  PTW %d  rate %s\n",
+	 tgo, simConfig.nfadc, simConfig.mode, simConfig.ptw,
+	 (simConfig.trigRate > 0) ? "limited" : "unlimited");
+  if(stats.replayRecords)
+    printf("  Replayed from      %s  (%llu event buffers)\n",
+	   simConfig.replayFile, stats.replayRecords);
+  printf("  L1A offered        %12llu  (%10.1f Hz)\n",
+	 stats.offered, stats.offered / tgo);
+  printf("  L1A accepted       %12llu  (%10.1f Hz)\n",
+	 stats.accepted, stats.accepted / tgo);
+  printf("  Blocks read        %12llu  (%10.1f Hz)  sync %llu\n",
+	 stats.blocks, stats.blocks / tgo, stats.syncBlocks);
+  if(stats.faCorrupted)
+    printf("  Broken FADC blocks %12llu\n", stats.faCorrupted);
+  printf("  Events out         %12llu  (%10.1f Hz)  in %llu polls\n",
+	 outEvents, outEvents / tgo, outPolls);
+  printf("  Data out           %12.3f MB (%10.3f MB/s)\n",
+	 outWords * 4e-6, outWords * 4e-6 / tgo);
+  if(outEvents)
+    printf("  Event size         %12.1f bytes\n", outWords * 4.0 / outEvents);
+  if(usrtrigTime > 0)
+    printf("  usrtrig            %12.3f s  (%10.1f MB/s while copying)\n",
+	   usrtrigTime, outWords * 4e-6 / usrtrigTime);	/* CPU time */
+  if(useRol2)
+    {
+      printf("  ROL2 out           %12.3f MB (%10.3f MB/s)\n",
+	     rol2Words * 4e-6, rol2Words * 4e-6 / tgo);
+      if(rol2Time > 0)
+	printf("  ROL2 copy          %12.3f s  (%10.1f MB/s while copying)\n",
+	       rol2Time, rol2Words * 4e-6 / rol2Time);
+      if(benchRol2 && (rol2OldTime > 0))
+	printf("  ROL2 copy (old)    %12.3f s  (%10.1f MB/s while copying)  %s\n",
+	       rol2OldTime, rol2Words * 4e-6 / rol2OldTime,
+	       rol2Mismatch ? "OUTPUT DIFFERS" : "same output");
+    }
+  printf("  Readout thread CPU %12.1f %%\n", 100 * stats.pollCpu / tgo);
+  printf("  CODA thread CPU    %12.1f %%\n", 100 * codaCpu / tgo);
+
+  free(outbuf);
+  free(rol2buf);
+  free(rol2oldbuf);
+  free(trbuf);
+
+  return 0;
+}
@@ -0,0 +1,1697 @@
+/*************************************************************************
+ *
+ *  simLib.c - Simulated TI, FADC250, SD and VLD backend.
+ *
+ *     Hardware stand-in for jvme, tiLib, fadcLib, sdLib, vldLib, the
+ *     scaler server interface and the CODA ROC services used by the
+ *     readout lists.  Linked with the unchanged readout list sources,
+ *     it lets rocsim.c drive asyncTrigger() / usrtrig() on a Linux box
+ *     without a VME crate.
+ *
+ *     The TI generates triggers at simConfig.trigRate and holds them in
+ *     up to bufferLevel blocks, losing triggers while busy.  FADC250 data
+ *     is produced in the module format from a set of pre-computed
+ *     waveforms, so the generator costs a memcpy per channel.
+ *
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "jvme.h"
+#include "tiLib.h"
+#include "fadcLib.h"
+#include "fadc250Config.h"
+#include "sdLib.h"
+#include "vldLib.h"
+#include "vldShm.h"
+#include "dalmaRolLib.h"
+#include "simLib.h"
+#include "rocCapture.h"
+
+SIM_CONFIG simConfig =
+  {
+    .trigRate = 0,
+    .nfadc = 16,
+    .mode = 1,
+    .pl = 250,
+    .ptw = 120,
+    .nsb = 3,
+    .nsa = 10,
+    .np = 1,
+    .nvld = 1,
+    .pulseFraction = 0.05,
+    .faLatencyNs = 0,
+    .vmeCycleNs = 0,
+    .dmaMBps = 0,
+    .syncInterval = -1,
+    .seed = 1,
+    .replayFile = NULL
+  };
+
+/* CODA ROC globals */
+int bigendian_out = 1;
+
+/* jvme globals */
+DMANODE *the_event;
+unsigned int *dma_dabufp;
+
+/* tiLib globals */
+volatile struct TI_A24RegStruct *TIp = NULL;
+int tiNeedAck = 0;
+pthread_mutex_t tiISR_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* fadcLib globals */
+int fadcA32Base = 0x09000000;
+int nfadc = 0;
+
+static unsigned long long logErrors = 0;
+
+double
+simTime()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* Busy wait, to emulate time spent on the VME bus */
+static void
+simSpin(double ns)
+{
+  double end;
+
+  if(ns <= 0)
+    return;
+
+  end = simTime() + 1e-9 * ns;
+  while(simTime() < end)
+    ;
+}
+
+/* Wait for a block transfer by the DMA engine: the thread sleeps, the
+   CPU is free for other threads meanwhile */
+static void
+simDmaWait(double ns)
+{
+  struct timespec end;
+
+  if(ns <= 0)
+    return;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  end.tv_nsec += (long) ns;
+  while(end.tv_nsec >= 1000000000L)
+    {
+      end.tv_nsec -= 1000000000L;
+      end.tv_sec++;
+    }
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR)
+    ;
+}
+
+/*************************************************************************
+ *  CODA ROC services
+ */
+
+void
+daLogMsg(char *severity, char *fmt, ...)
+{
+  va_list ap;
+  int len = strlen(fmt);
+
+  if(strcmp(severity, "ERROR") == 0)
+    logErrors++;
+
+  printf("%s: ", severity);
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  if((len == 0) || (fmt[len - 1] != '\n'))
+    printf("\n");
+}
+
+int
+logMsg(char *format, ...)
+{
+  va_list ap;
+
+  va_start(ap, format);
+  vprintf(format, ap);
+  va_end(ap);
+
+  return OK;
+}
+
+int
+taskDelay(int ticks)
+{
+  struct timespec ts = { 0, ticks * 1000000L };	/* 1 tick = 1 ms */
+
+  nanosleep(&ts, NULL);
+  return OK;
+}
+
+int
+dalmaInit(int force)
+{
+  return OK;
+}
+
+int
+dalmaClose()
+{
+  return OK;
+}
+
+/*************************************************************************
+ *  dmaPList - memory partitions on heap memory
+ */
+
+static DMA_MEM_ID partList = NULL;
+static pthread_mutex_t partListMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int
+dmaPartInit()
+{
+  return OK;
+}
+
+#define SIM_HUGE_PAGE  (2 * 1024 * 1024)
+
+/*
+  Node memory in 2 MB huge pages (simConfig.hugePages), as from a DMA
+  driver with huge page backed buffers: hugetlbfs if there are huge
+  pages reserved, else transparent huge pages (2 MB aligned, advised
+  before it is touched).  Returns NULL if neither is available.
+*/
+static char *
+simHugeAlloc(DMA_MEM_ID pPart, size_t nbytes)
+{
+  size_t len = (nbytes + SIM_HUGE_PAGE - 1) & ~(size_t) (SIM_HUGE_PAGE - 1);
+  char *map, *mem;
+
+  map = mmap(NULL, len, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if(map != MAP_FAILED)
+    {
+      pPart->mapBytes = len;
+      pPart->huge = 2;
+      return map;
+    }
+
+  map = mmap(NULL, len + SIM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(map == MAP_FAILED)
+    return NULL;
+
+  /* Keep the 2 MB aligned part */
+  mem = (char *) (((unsigned long) map + SIM_HUGE_PAGE - 1) & ~(unsigned long) (SIM_HUGE_PAGE - 1));
+  if(mem > map)
+    munmap(map, mem - map);
+  munmap(mem + len, (map + len + SIM_HUGE_PAGE) - (mem + len));
+
+  if(madvise(mem, len, MADV_HUGEPAGE) < 0)
+    {
+      munmap(mem, len);
+      return NULL;
+    }
+
+  pPart->mapBytes = len;
+  pPart->huge = 1;
+  return mem;
+}
+
+DMA_MEM_ID
+dmaPCreate(char *name, int size, int c, int incr)
+{
+  DMA_MEM_ID pPart;
+  int inode, nodesize;
+
+  pPart = calloc(1, sizeof(DMA_MEM_PART));
+  if(pPart == NULL)
+    return 0;
+
+  strncpy(pPart->name, name, sizeof(pPart->name) - 1);
+  pthread_mutex_init(&pPart->mutex, NULL);
+
+  if((size > 0) && (c > 0))
+    {
+      /* Node size rounded up to keep each node 8 byte aligned */
+      nodesize = (size + sizeof(DMANODE) + 7) & ~7;
+      if(simConfig.hugePages)
+	pPart->mem = simHugeAlloc(pPart, (size_t) c * nodesize);
+      if(pPart->mem == NULL)
+	pPart->mem = calloc(c, nodesize);
+      if(pPart->mem == NULL)
+	{
+	  free(pPart);
+	  return 0;
+	}
+      pPart->size = nodesize;
+      pPart->c = c;
+      pPart->incr = incr;
+      pPart->totalMem = c * nodesize;
+
+      for(inode = 0; inode < c; inode++)
+	{
+	  DMANODE *node = (DMANODE *) (pPart->mem + inode * nodesize);
+	  node->part = pPart;
+	  node->physMemBase = (unsigned long) node;
+	  dmaPEnqueue(pPart, node);
+	}
+    }
+
+  pthread_mutex_lock(&partListMutex);
+  pPart->next = partList;
+  partList = pPart;
+  pthread_mutex_unlock(&partListMutex);
+
+  return pPart;
+}
+
+void
+dmaPFree(DMA_MEM_ID pPart)
+{
+  DMA_MEM_ID *pp;
+
+  if(pPart == NULL)
+    return;
+
+  pthread_mutex_lock(&partListMutex);
+  for(pp = &partList; *pp != NULL; pp = &(*pp)->next)
+    {
+      if(*pp == pPart)
+	{
+	  *pp = pPart->next;
+	  break;
+	}
+    }
+  pthread_mutex_unlock(&partListMutex);
+
+  if(pPart->mapBytes)
+    munmap(pPart->mem, pPart->mapBytes);
+  else if(pPart->mem)
+    free(pPart->mem);
+  free(pPart);
+}
+
+void
+dmaPFreeAll()
+{
+  while(partList != NULL)
+    dmaPFree(partList);
+}
+
+int
+dmaPReInit(DMA_MEM_ID pPart)
+{
+  int inode;
+
+  pthread_mutex_lock(&pPart->mutex);
+  pPart->head = pPart->tail = NULL;
+  pPart->count = 0;
+  pthread_mutex_unlock(&pPart->mutex);
+
+  for(inode = 0; inode < pPart->c; inode++)
+    {
+      DMANODE *node = (DMANODE *) (pPart->mem + inode * pPart->size);
+      node->length = 0;
+      node->type = 0;
+      dmaPEnqueue(pPart, node);
+    }
+
+  return OK;
+}
+
+int
+dmaPReInitAll()
+{
+  DMA_MEM_ID pPart;
+
+  pthread_mutex_lock(&partListMutex);
+  for(pPart = partList; pPart != NULL; pPart = pPart->next)
+    dmaPReInit(pPart);
+  pthread_mutex_unlock(&partListMutex);
+
+  return OK;
+}
+
+void
+dmaPStats(DMA_MEM_ID pPart)
+{
+  const char *pages[3] = { "", "  (transparent huge pages)", "  (hugetlbfs)" };
+
+  printf("  %-10s  node size = %7d  nodes = %3d  queued = %3d%s\n",
+	 pPart->name, pPart->size, pPart->c, pPart->count, pages[pPart->huge]);
+}
+
+void
+dmaPStatsAll()
+{
+  DMA_MEM_ID pPart;
+
+  printf("dmaPStatsAll:\n");
+  pthread_mutex_lock(&partListMutex);
+  for(pPart = partList; pPart != NULL; pPart = pPart->next)
+    dmaPStats(pPart);
+  pthread_mutex_unlock(&partListMutex);
+}
+
+DMANODE *
+dmaPGetItem(DMA_MEM_ID pPart)
+{
+  DMANODE *node;
+
+  pthread_mutex_lock(&pPart->mutex);
+  node = pPart->head;
+  if(node)
+    {
+      pPart->head = node->n;
+      if(pPart->head == NULL)
+	pPart->tail = NULL;
+      node->n = NULL;
+      pPart->count--;
+    }
+  pthread_mutex_unlock(&pPart->mutex);
+
+  return node;
+}
+
+void
+dmaPEnqueue(DMA_MEM_ID pPart, DMANODE *pItem)
+{
+  pthread_mutex_lock(&pPart->mutex);
+  pItem->n = NULL;
+  if(pPart->tail)
+    pPart->tail->n = pItem;
+  else
+    pPart->head = pItem;
+  pPart->tail = pItem;
+  pPart->count++;
+  pthread_mutex_unlock(&pPart->mutex);
+}
+
+void
+dmaPFreeItem(DMANODE *pItem)
+{
+  if(pItem == NULL)
+    return;
+
+  pItem->length = 0;
+  dmaPEnqueue(pItem->part, pItem);
+}
+
+int
+dmaPEmpty(DMA_MEM_ID pPart)
+{
+  return (pPart->count == 0);
+}
+
+int
+dmaPNodeCount(DMA_MEM_ID pPart)
+{
+  return pPart->count;
+}
+
+/*************************************************************************
+ *  VME bus
+ */
+
+static pthread_mutex_t vmeBusMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int
+vmeDmaConfig(unsigned int addrType, unsigned int dataType, unsigned int sstMode)
+{
+  return OK;
+}
+
+int
+vmeDmaFlush(unsigned int addr)
+{
+  simSpin(simConfig.vmeCycleNs);
+  return OK;
+}
+
+int
+vmeCheckMutexHealth(int time_seconds)
+{
+  return OK;
+}
+
+int
+vmeBusLock()
+{
+  return pthread_mutex_lock(&vmeBusMutex);
+}
+
+int
+vmeBusUnlock()
+{
+  return pthread_mutex_unlock(&vmeBusMutex);
+}
+
+/*************************************************************************
+ *  Replay of a capture file (rocCapture.h)
+ *
+ *   Block n is record (n-1) % nrec of the file.  Its trigger, FADC250
+ *   and VLD banks are returned by tiReadTriggerBlock, faReadBlock and
+ *   vldShmReadBlock in place of generated data, and its sync flag
+ *   replaces the sync event interval.  A packed FADC bank
+ *   (FADC_PACK_BANK, usrString fadcpack) is unpacked first.
+ */
+
+#include "fadcPack.c"
+
+#define SIM_REPLAY_FADC_BANK  0x3
+#define SIM_REPLAY_VLD_BANK   0x1ed
+#define SIM_REPLAY_MAXFADC    (1024 * 1024)
+
+static struct
+{
+  char *map;
+  size_t size;
+  unsigned long long nrec;
+  ROC_CAPTURE_RECORD **rec;	/* Start of each record */
+  /* Banks of the current record */
+  unsigned int *tiData, *faData, *vldData;
+  int tiWords, faWords, vldWords;
+  unsigned int *faUnpacked;	/* Unpacked FADC_PACK_BANK */
+} simReplay;
+
+static int
+simReplayOpen(const char *filename)
+{
+  ROC_CAPTURE_HEADER *hdr;
+  ROC_CAPTURE_RECORD *rec;
+  char *end;
+  struct stat st;
+  unsigned long long irec;
+  int fd;
+
+  fd = open(filename, O_RDONLY);
+  if(fd < 0)
+    {
+      perror(filename);
+      return ERROR;
+    }
+  fstat(fd, &st);
+  simReplay.size = st.st_size;
+  simReplay.map = mmap(NULL, simReplay.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(simReplay.map == MAP_FAILED)
+    {
+      perror("mmap");
+      simReplay.map = NULL;
+      return ERROR;
+    }
+
+  hdr = (ROC_CAPTURE_HEADER *) simReplay.map;
+  if((simReplay.size < sizeof(ROC_CAPTURE_HEADER)) || (hdr->magic != ROC_CAPTURE_MAGIC)
+     || (hdr->version != ROC_CAPTURE_VERSION))
+    {
+      printf("simReplayOpen: ERROR: %s is not a (version %d) capture file\n",
+	     filename, ROC_CAPTURE_VERSION);
+      goto fail;
+    }
+
+  end = simReplay.map + hdr->headerBytes + hdr->nbytes;
+  if(end > simReplay.map + simReplay.size)
+    end = simReplay.map + simReplay.size;
+
+  simReplay.rec = malloc((hdr->nrecords + 1) * sizeof(ROC_CAPTURE_RECORD *));
+  rec = (ROC_CAPTURE_RECORD *) (simReplay.map + hdr->headerBytes);
+  for(irec = 0; irec < hdr->nrecords; irec++)
+    {
+      if(((char *) (rec + 1) > end) ||
+	 ((char *) (rec + 1) + rec->nwords * sizeof(uint32_t) > end))
+	break;
+      simReplay.rec[irec] = rec;
+      rec = (ROC_CAPTURE_RECORD *) ((uint32_t *) (rec + 1) + rec->nwords);
+    }
+  simReplay.nrec = irec;
+
+  if(simReplay.nrec == 0)
+    {
+      printf("simReplayOpen: ERROR: No events in %s\n", filename);
+      free(simReplay.rec);
+      goto fail;
+    }
+
+  printf("simReplayOpen: Replaying %llu event buffers from %s (ROC %d, run %d)\n",
+	 simReplay.nrec, filename, hdr->rocid, hdr->runNumber);
+
+  return OK;
+
+ fail:
+  munmap(simReplay.map, simReplay.size);
+  simReplay.map = NULL;
+  simReplay.nrec = 0;
+  return ERROR;
+}
+
+static inline ROC_CAPTURE_RECORD *
+simReplayRecord(unsigned long long blk)
+{
+  return simReplay.rec[(blk - 1) % simReplay.nrec];
+}
+
+/* Find the banks of the record for block blk: the FADC250 bank (fadc = 1),
+   or the trigger and VLD banks (fadc = 0).  The FADC250s may be read
+   ahead of the TI (readout list fapipeline). */
+static void
+simReplaySelect(unsigned long long blk, int fadc)
+{
+  ROC_CAPTURE_RECORD *rec = simReplayRecord(blk);
+  unsigned int *data = (unsigned int *) (rec + 1);
+  unsigned int idx = 0, len, tag;
+
+  if(fadc)
+    simReplay.faWords = 0;
+  else
+    simReplay.tiWords = simReplay.vldWords = 0;
+
+  while(idx + 1 < rec->nwords)
+    {
+      len = data[idx];
+      if(idx + 1 + len > rec->nwords)
+	break;
+
+      tag = (data[idx + 1] >> 16) & 0xffff;
+      if(idx == 0)
+	{
+	  /* Trigger bank, as read from the TI */
+	  if(!fadc)
+	    {
+	      simReplay.tiData = &data[idx];
+	      simReplay.tiWords = len + 1;
+	    }
+	}
+      else if(!fadc)
+	{
+	  if(tag == SIM_REPLAY_VLD_BANK)
+	    {
+	      simReplay.vldData = &data[idx + 2];
+	      simReplay.vldWords = len - 1;
+	    }
+	}
+      else if(tag == SIM_REPLAY_FADC_BANK)
+	{
+	  simReplay.faData = &data[idx + 2];
+	  simReplay.faWords = len - 1;
+	}
+      else if(tag == FADC_PACK_BANK)
+	{
+	  if(simReplay.faUnpacked == NULL)
+	    simReplay.faUnpacked = malloc(SIM_REPLAY_MAXFADC * sizeof(unsigned int));
+	  simReplay.faData = simReplay.faUnpacked;
+	  simReplay.faWords = fadcUnpackBank(&data[idx + 2], len - 1,
+					     simReplay.faUnpacked, SIM_REPLAY_MAXFADC);
+	  if(simReplay.faWords < 0)
+	    {
+	      printf("%s: ERROR: Packed FADC bank of block %llu does not unpack\n",
+		     __func__, blk);
+	      simReplay.faWords = 0;
+	    }
+	}
+
+      idx += len + 1;
+    }
+}
+
+/*************************************************************************
+ *  TI - trigger generation and polling thread
+ */
+
+static struct
+{
+  pthread_mutex_t lock;
+  int blockLevel;
+  int bufferLevel;
+  int syncInterval;
+  int enabled;			/* Triggers generated between Go and End */
+  double t0;			/* Time that triggers were enabled */
+  unsigned long long offered;
+  unsigned long long accepted;	/* Triggers held in (or read from) the TI */
+  unsigned long long blocksRead;
+  unsigned long long syncBlocks;
+  int syncHold;			/* Sync block accepted, but not yet read */
+  int syncFlag;			/* Sync flag of the last block read */
+  double readTime;		/* Time the last block was read */
+} ti =
+  {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .blockLevel = 1,
+    .bufferLevel = 1,
+    .syncInterval = 0
+  };
+
+/* Blocks read from the FADC250s: ahead of ti.blocksRead when the next
+   block is read before its trigger block (readout list fapipeline) */
+static unsigned long long faBlocksRead = 0;
+
+static VOIDFUNCPTR tiIntRoutine = NULL;
+static unsigned int tiIntArg = 0;
+static volatile unsigned int tiIntCount = 0;
+static volatile int tiIntRunning = 0;
+static pthread_t tiPollThread;
+static int tiPollThreadStarted = 0;
+static double tiPollCpu = 0;
+
+/* Is block b a sync event */
+static inline int
+tiSimSyncBlock(unsigned long long b)
+{
+  if(simReplay.nrec)
+    return (simReplayRecord(b)->type != 0);
+
+  return (ti.syncInterval > 0) && ((b % ti.syncInterval) == 0);
+}
+
+/* Accept the triggers offered since the last update, with ti.lock held */
+static void
+tiSimUpdate()
+{
+  unsigned long long offered, space, pending, take, blocks, b;
+
+  if(!ti.enabled)
+    return;
+
+  pending = ti.accepted - ti.blocksRead * ti.blockLevel;
+  if(ti.syncHold)
+    space = 0;
+  else
+    space = (unsigned long long) ti.bufferLevel * ti.blockLevel - pending;
+
+  if(simConfig.trigRate > 0)
+    {
+      offered = (unsigned long long) ((simTime() - ti.t0) * simConfig.trigRate);
+      take = offered - ti.offered;
+      ti.offered = offered;
+    }
+  else
+    {
+      take = space;
+      ti.offered += take;
+    }
+
+  if(take > space)
+    take = space;
+
+  blocks = ti.accepted / ti.blockLevel;
+  ti.accepted += take;
+
+  /* The TI holds off triggers after a sync event, until it is read out */
+  if((ti.syncInterval > 0) || simReplay.nrec)
+    {
+      for(b = blocks + 1; b <= ti.accepted / ti.blockLevel; b++)
+	{
+	  if(tiSimSyncBlock(b))
+	    {
+	      ti.accepted = b * ti.blockLevel;
+	      ti.syncHold = 1;
+	      break;
+	    }
+	}
+    }
+}
+
+static int
+tiSimBlocksReady()
+{
+  int rval;
+
+  pthread_mutex_lock(&ti.lock);
+  tiSimUpdate();
+  rval = (int) (ti.accepted / ti.blockLevel - ti.blocksRead);
+  pthread_mutex_unlock(&ti.lock);
+
+  return rval;
+}
+
+/* Blocks with all of their triggers in */
+static unsigned long long
+tiSimBlocksAccepted()
+{
+  unsigned long long rval;
+
+  pthread_mutex_lock(&ti.lock);
+  tiSimUpdate();
+  rval = ti.accepted / ti.blockLevel;
+  pthread_mutex_unlock(&ti.lock);
+
+  return rval;
+}
+
+/* Acknowledge the block: triggers held off by a sync event resume */
+static void
+tiSimAck()
+{
+  pthread_mutex_lock(&ti.lock);
+  if(ti.syncFlag)
+    ti.syncHold = 0;
+  pthread_mutex_unlock(&ti.lock);
+}
+
+static void *
+tiPoll(void *arg)
+{
+  struct timespec idle = { 0, 20000 };
+
+  while(tiIntRunning)
+    {
+      pthread_testcancel();
+
+      if(tiSimBlocksReady() > 0)
+	{
+	  INTLOCK;
+	  tiIntCount++;
+	  if(tiIntRoutine != NULL)
+	    (*tiIntRoutine) (tiIntArg);
+	  tiSimAck();
+	  INTUNLOCK;
+	}
+      else if(simConfig.trigRate > 0)
+	nanosleep(&idle, NULL);
+      else
+	sched_yield();
+    }
+
+  return NULL;
+}
+
+int
+tiInit(unsigned int tAddr, unsigned int mode, int iFlag)
+{
+  static struct TI_A24RegStruct tiRegs;
+
+  TIp = &tiRegs;
+  printf("tiInit: Simulated TI at 0x%x (mode %d)\n", tAddr, mode);
+
+  return OK;
+}
+
+int
+tiStatus(int pflag)
+{
+  printf("tiStatus: Simulated TI: blockLevel %d  bufferLevel %d  "
+	 "triggers %llu  blocks read %llu\n",
+	 ti.blockLevel, ti.bufferLevel, ti.accepted, ti.blocksRead);
+  return OK;
+}
+
+int tiSetFiberLatencyOffset_preInit(int flo) { return OK; }
+int tiSetCrateID_preInit(int cid) { return OK; }
+int tiSetEventFormat(int format) { return OK; }
+int tiClockReset() { return OK; }
+int tiTrigLinkReset() { return OK; }
+int tiSetSyncResetType(int type) { return OK; }
+int tiSetUserSyncResetReceive(int enable) { return OK; }
+int tiUserSyncReset(int enable, int pflag) { return OK; }
+int tiEnableVXSSignals() { return OK; }
+int tiDisableVXSSignals() { return OK; }
+int tiSetTriggerSource(int trig) { return OK; }
+int tiEnableTSInput(unsigned int inpMask) { return OK; }
+int tiLoadTriggerTable(int mode) { return OK; }
+int tiSetTriggerHoldoff(int rule, unsigned int value, int timestep) { return OK; }
+int tiSetTriggerPulse(int trigger, int delay, int width, int delay_step) { return OK; }
+int tiSetPromptTriggerWidth(int width) { return OK; }
+int tiSetPrescale(int prescale) { return OK; }
+int tiSetInputPrescale(int input, int prescale) { return OK; }
+int tiSetFPInputReadout(int enable) { return OK; }
+int tiSetFiberSyncDelay(unsigned int delay) { return OK; }
+int tiSetRandomTrigger(int trigger, int setting) { return OK; }
+int tiDisableRandomTrigger() { return OK; }
+int tiSoftTrig(int trigger, unsigned int nevents, unsigned int period_inc, int range) { return OK; }
+int tiResetSlaveConfig() { return OK; }
+int tiAddSlave(unsigned int fiber) { return OK; }
+int tiRocEnable(int roc) { return OK; }
+int tiUseBroadcastBufferLevel(int enable) { return OK; }
+
+int
+tiSyncReset(int bflag)
+{
+  pthread_mutex_lock(&ti.lock);
+  ti.enabled = 0;
+  ti.offered = ti.accepted = ti.blocksRead = ti.syncBlocks = 0;
+  faBlocksRead = 0;
+  ti.syncHold = 0;
+  ti.syncFlag = 0;
+  pthread_mutex_unlock(&ti.lock);
+
+  return OK;
+}
+
+int
+tiSetSyncEventInterval(int blk_interval)
+{
+  ti.syncInterval = blk_interval;
+  return OK;
+}
+
+int
+tiSetBlockLevel(int blockLevel)
+{
+  if(blockLevel < 1)
+    blockLevel = 1;
+  ti.blockLevel = blockLevel;
+  return OK;
+}
+
+int
+tiGetCurrentBlockLevel()
+{
+  return ti.blockLevel;
+}
+
+int
+tiSetBlockBufferLevel(unsigned int level)
+{
+  ti.bufferLevel = (level < 1) ? 1 : level;
+  return OK;
+}
+
+int
+tiGetBlockBufferLevel()
+{
+  return ti.bufferLevel;
+}
+
+int
+tiGetBroadcastBlockBufferLevel()
+{
+  return ti.bufferLevel;
+}
+
+int
+tiDisableTriggerSource(int fflag)
+{
+  pthread_mutex_lock(&ti.lock);
+  tiSimUpdate();
+  ti.enabled = 0;
+  pthread_mutex_unlock(&ti.lock);
+
+  return OK;
+}
+
+int
+tiIntConnect(unsigned int vector, VOIDFUNCPTR routine, unsigned int arg)
+{
+  tiIntRoutine = routine;
+  tiIntArg = arg;
+  tiIntCount = 0;
+
+  return OK;
+}
+
+int
+tiIntDisconnect()
+{
+  tiIntRoutine = NULL;
+  return OK;
+}
+
+int
+tiIntEnable(int iflag)
+{
+  if(simConfig.syncInterval >= 0)
+    ti.syncInterval = simConfig.syncInterval;
+
+  if(simConfig.replayFile && (simReplay.map == NULL))
+    simReplayOpen(simConfig.replayFile);
+
+  pthread_mutex_lock(&ti.lock);
+  ti.offered = ti.accepted = ti.blocksRead = ti.syncBlocks = 0;
+  faBlocksRead = 0;
+  ti.syncHold = 0;
+  ti.t0 = simTime();
+  ti.enabled = 1;
+  pthread_mutex_unlock(&ti.lock);
+
+  tiIntRunning = 1;
+  if(pthread_create(&tiPollThread, NULL, tiPoll, NULL) != 0)
+    {
+      perror("pthread_create");
+      tiIntRunning = 0;
+      return ERROR;
+    }
+  tiPollThreadStarted = 1;
+
+  return OK;
+}
+
+void
+tiIntDisable()
+{
+  clockid_t cid;
+  struct timespec cpu;
+
+  tiIntRunning = 0;
+
+  if(tiPollThreadStarted)
+    {
+      if((pthread_getcpuclockid(tiPollThread, &cid) == 0) &&
+	 (clock_gettime(cid, &cpu) == 0))
+	tiPollCpu = cpu.tv_sec + 1e-9 * cpu.tv_nsec;
+
+      pthread_cancel(tiPollThread);
+      pthread_join(tiPollThread, NULL);
+      tiPollThreadStarted = 0;
+    }
+}
+
+unsigned int
+tiGetIntCount()
+{
+  return tiIntCount;
+}
+
+int
+tiBReady()
+{
+  int rval = tiSimBlocksReady();
+
+  if(simConfig.tiStuckBReady && (rval == 0))
+    rval = 1;
+
+  return rval;
+}
+
+unsigned int
+tiBlockStatus(int fiber, int pflag)
+{
+  return (tiBReady() > 0) ? 1 : 0;
+}
+
+int
+tiGetBlockSyncFlag()
+{
+  return ti.syncFlag;
+}
+
+unsigned int
+tiGetAdr32()
+{
+  return 0x08000000;
+}
+
+int
+tiLive(int sflag)
+{
+  return 1000;
+}
+
+/* Current block, for the FADC250 and VLD data that goes with it */
+static unsigned long long simBlockNumber = 0;
+static unsigned long long simFirstEvent = 0;
+
+int
+tiReadTriggerBlock(volatile unsigned int *data)
+{
+  unsigned long long blk;
+  unsigned long long tstamp;
+  int iev, nwords = 0, seglen;
+
+  pthread_mutex_lock(&ti.lock);
+  tiSimUpdate();
+  if(ti.accepted / ti.blockLevel <= ti.blocksRead)
+    {
+      pthread_mutex_unlock(&ti.lock);
+      printf("tiReadTriggerBlock: ERROR: No data available\n");
+      return ERROR;
+    }
+  blk = ++ti.blocksRead;
+  ti.syncFlag = tiSimSyncBlock(blk);
+  if(ti.syncFlag)
+    ti.syncBlocks++;
+  ti.readTime = simTime();
+  pthread_mutex_unlock(&ti.lock);
+
+  simBlockNumber = blk;
+  simFirstEvent = (blk - 1) * ti.blockLevel + 1;
+
+  if(simReplay.nrec)
+    {
+      simReplaySelect(blk, 0);
+      memcpy((void *) data, simReplay.tiData, simReplay.tiWords * sizeof(unsigned int));
+      simSpin(simConfig.vmeCycleNs * simReplay.tiWords / 2.0);
+      return simReplay.tiWords;
+    }
+
+  /* Blocks with the trigger bits word: the TI block changes size from
+     one block to the next (picked from the block number, the same in
+     every run) */
+  seglen = 3;
+  if((simConfig.tiLongFraction > 0) &&
+     ((((blk * 2654435761ULL) >> 16) % 10000) / 10000. < simConfig.tiLongFraction))
+    seglen = 4;
+
+  /* Trigger bank: one segment per event (event number, 48 bit timestamp,
+     trigger bits) */
+  data[nwords++] = 1 + ti.blockLevel * (seglen + 1);
+  data[nwords++] = 0xFF102000 | (ti.blockLevel & 0xff);
+  for(iev = 0; iev < ti.blockLevel; iev++)
+    {
+      unsigned long long evnum = simFirstEvent + iev;
+
+      if(simConfig.trigRate > 0)
+	tstamp = (unsigned long long) (evnum * 250e6 / simConfig.trigRate);
+      else
+	tstamp = (unsigned long long) (simTime() * 250e6);
+
+      data[nwords++] = (1 << 24) | (0x01 << 16) | seglen;
+      data[nwords++] = evnum & 0xffffffff;
+      data[nwords++] = tstamp & 0xffffffff;
+      data[nwords++] = (tstamp >> 32) & 0xffff;
+      if(seglen == 4)
+	data[nwords++] = 1;
+    }
+
+  simSpin(simConfig.vmeCycleNs * nwords / 2.0);
+
+  return nwords;
+}
+
+/*************************************************************************
+ *  FADC250
+ */
+
+#define SIM_NWAVE 256
+
+static int faSlotList[FA_MAX_BOARDS];
+static unsigned int faMask = 0;
+static int faBlockError = 0;
+static int faBlockLevel = 1;
+static unsigned long long faWordsRead = 0;
+static unsigned long long faCorrupted = 0;
+
+/* Pre-computed channel data (window raw words), SIM_NWAVE windows */
+static unsigned int *simWave = NULL;
+static int simWaveWords = 0;	/* Sample words per window */
+static unsigned int simWavePtw = 0;
+static int simWavePulse[SIM_NWAVE];	/* Pulse peak (0 = no pulse) */
+static int simWavePed[SIM_NWAVE];
+
+static unsigned long long simRng = 88172645463325252ULL;
+
+static inline unsigned int
+simRand()
+{
+  simRng ^= simRng << 13;
+  simRng ^= simRng >> 7;
+  simRng ^= simRng << 17;
+  return (unsigned int) (simRng >> 16);
+}
+
+static double
+simGauss()
+{
+  double u1 = (simRand() + 1.0) / 4294967297.0;
+  double u2 = (simRand() + 1.0) / 4294967297.0;
+
+  return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+/* Fill the waveform table: pedestal + noise, with a pulse in a fraction
+   of the windows */
+static void
+simWaveInit()
+{
+  int iw, is, nsamples = simConfig.ptw;
+
+  simRng = 88172645463325252ULL ^ simConfig.seed;
+  simWaveWords = (nsamples + 1) / 2;
+  simWavePtw = simConfig.ptw;
+
+  free(simWave);
+  simWave = calloc(SIM_NWAVE * simWaveWords, sizeof(unsigned int));
+
+  for(iw = 0; iw < SIM_NWAVE; iw++)
+    {
+      double ped = 100 + simRand() % 200;
+      double amp = 0, t0 = 0, tau = 2 + simRand() % 3;
+      unsigned int sample[2];
+
+      if(((simRand() % 10000) / 10000.) < simConfig.pulseFraction)
+	{
+	  amp = 50 + simRand() % 3000;
+	  t0 = simRand() % (nsamples > 20 ? nsamples - 20 : 1);
+	}
+      simWavePed[iw] = (int) ped;
+      simWavePulse[iw] = 0;
+
+      for(is = 0; is < simWaveWords * 2; is++)
+	{
+	  double t = is - t0, v = ped + 1.5 * simGauss();
+
+	  if((amp > 0) && (t > 0))
+	    v += amp * (t / tau) * (t / tau) * exp(-t / tau) / (4 * exp(-2));
+	  if(v < 0)
+	    v = 0;
+	  if(v > 4095)
+	    v = 4095;
+	  if((int) v - simWavePed[iw] > simWavePulse[iw])
+	    simWavePulse[iw] = (int) v - simWavePed[iw];
+
+	  sample[is & 1] = (unsigned int) v;
+	  if(is >= nsamples)	/* Odd window: last sample not valid */
+	    sample[1] = (1 << 13);
+
+	  if(is & 1)
+	    simWave[iw * simWaveWords + is / 2] =
+	      ((sample[0] & 0x1fff) << 16) | (sample[1] & 0x3fff);
+	}
+    }
+}
+
+int
+faInit(unsigned int addr, unsigned int addr_inc, int nadc, int iFlag)
+{
+  int ii;
+
+  nfadc = (simConfig.nfadc < nadc) ? simConfig.nfadc : nadc;
+  faMask = 0;
+  for(ii = 0; ii < nfadc; ii++)
+    {
+      /* Skip the switch slots (11, 12), as in a VXS crate */
+      faSlotList[ii] = 3 + ii + ((3 + ii >= 11) ? 2 : 0);
+      faMask |= (1 << faSlotList[ii]);
+    }
+
+  if(!(iFlag & FA_INIT_SKIP))
+    printf("faInit: Found %d simulated FADC250 (mask 0x%08x)\n", nfadc, faMask);
+
+  return OK;
+}
+
+void
+faGStatus(int sflag)
+{
+  printf("faGStatus: %d simulated FADC250  mode %d  PTW %d  NSB %d  NSA %d  blockLevel %d\n",
+	 nfadc, simConfig.mode, simConfig.ptw, simConfig.nsb, simConfig.nsa, faBlockLevel);
+}
+
+int
+faSlot(unsigned int i)
+{
+  if(i >= nfadc)
+    return ERROR;
+  return faSlotList[i];
+}
+
+unsigned int
+faScanMask()
+{
+  return faMask;
+}
+
+void faEnableMultiBlock(int tflag) { }
+void faDisableMultiBlock() { }
+int faEnableBusError(int id) { return OK; }
+int faResetMGT(int id, int reset) { return OK; }
+int faSetTrigOut(int id, int trigout) { return OK; }
+int faSetTriggerBusyCondition(int id, int trigger_max) { return OK; }
+void faSoftReset(int id, int cflag) { }
+void faResetToken(int id) { }
+void faResetTriggerCount(int id) { }
+void faEnableSyncReset(int id) { }
+void faGEnable(int eflag, int bank) { }
+void faGDisable(int eflag) { }
+void faGReset(int reset) { }
+
+void
+faGSetBlockLevel(int level)
+{
+  faBlockLevel = (level < 1) ? 1 : level;
+}
+
+int
+faGetProcMode(int id, int *pmode, unsigned int *PL, unsigned int *PTW,
+	      unsigned int *NSB, unsigned int *NSA, unsigned int *NP)
+{
+  *pmode = simConfig.mode;
+  *PL = simConfig.pl;
+  *PTW = simConfig.ptw;
+  *NSB = simConfig.nsb;
+  *NSA = simConfig.nsa;
+  *NP = simConfig.np;
+
+  return OK;
+}
+
+unsigned int
+faGBlockReady(unsigned int slotmask, int nloop)
+{
+  int iloop;
+  unsigned long long blk = faBlocksRead + 1;
+  double ready = ti.readTime + 1e-9 * simConfig.faLatencyNs;
+
+  for(iloop = 0; iloop < nloop; iloop++)
+    {
+      /* One register read per module */
+      simSpin((double) simConfig.vmeCycleNs * nfadc);
+      if(blk <= ti.blocksRead)
+	{
+	  if(simTime() >= ready)
+	    return (slotmask & faMask);
+	}
+      else if(tiSimBlocksAccepted() >= blk)
+	return (slotmask & faMask);	/* Ahead of the TI, triggers long in */
+    }
+
+  return 0;
+}
+
+int
+faBready(int id)
+{
+  return (int) (tiSimBlocksAccepted() - faBlocksRead);
+}
+
+unsigned int
+faGetA32(int id)
+{
+  return fadcA32Base + (id << 19);
+}
+
+int
+faGetBlockError(int pflag)
+{
+  int rval = faBlockError;
+
+  if(rval && pflag)
+    printf("faGetBlockError: ERROR: Block error flagged\n");
+  faBlockError = 0;
+
+  return rval;
+}
+
+/* Write block blk of one module, return the number of words */
+static int
+simFaBlock(int slot, unsigned long long blk, unsigned int *data)
+{
+  unsigned int *dp = data;
+  int iev, ichan, iw, nwords;
+
+  *dp++ = 0x80000000 | (slot << 22) | (1 << 18)
+    | ((blk & 0x3ff) << 8) | (faBlockLevel & 0xff);
+
+  for(iev = 0; iev < faBlockLevel; iev++)
+    {
+      unsigned long long evnum = (blk - 1) * faBlockLevel + 1 + iev;
+      unsigned long long tstamp = (unsigned long long) (simTime() * 250e6);
+
+      *dp++ = 0x90000000 | (slot << 22) | (evnum & 0x3fffff);
+      *dp++ = 0x98000000 | (tstamp & 0xffffff);
+      *dp++ = (tstamp >> 24) & 0xffffff;
+
+      for(ichan = 0; ichan < 16; ichan++)
+	{
+	  iw = simRand() % SIM_NWAVE;
+	  if(simConfig.mode == 1)
+	    {
+	      *dp++ = 0xA0000000 | (ichan << 23) | (simConfig.ptw & 0xfff);
+	      memcpy(dp, &simWave[iw * simWaveWords], simWaveWords * sizeof(unsigned int));
+	      dp += simWaveWords;
+	    }
+	  else if(simWavePulse[iw] > 0)
+	    {
+	      /* Pulse parameters: pedestal, integral, time and peak */
+	      *dp++ = 0xC8000000 | ((iev & 0xff) << 19) | (ichan << 15)
+		| ((simWavePed[iw] * 4) & 0x3fff);
+	      *dp++ = ((simWavePulse[iw] * 6) & 0x7ffff) << 12 | (simConfig.nsa + simConfig.nsb);
+	      *dp++ = (((simConfig.nsb + 10) & 0x3ff) << 21) | (simWavePulse[iw] & 0xfff);
+	    }
+	}
+    }
+
+  /* Data the readout list does not expect (event buffer overflow test) */
+  for(iw = 0; iw < simConfig.faExtraWords; iw++)
+    *dp++ = iw & 0x3fff3fff;
+
+  nwords = (dp - data) + 1;
+  *dp++ = 0x88000000 | (slot << 22) | (nwords & 0x3fffff);
+
+  /* Filler to keep the block an integral number of 64 bit words */
+  if(nwords & 1)
+    *dp++ = 0xF8000000 | (slot << 22);
+
+  return dp - data;
+}
+
+/* Break the structure of the module block of n words at data, in one of
+   the ways the readout list checks for.  Returns the new number of words */
+static int
+simFaCorrupt(unsigned int *data, int n)
+{
+  int trailer = n - 1;
+
+  if((data[trailer] & 0xf8000000) == 0xF8000000)
+    trailer--;			/* Filler */
+
+  faCorrupted++;
+  switch(simRand() % 5)
+    {
+    case 0:			/* No trailer */
+      return trailer;
+    case 1:			/* Trailer word count */
+      data[trailer] += 1;
+      break;
+    case 2:			/* Trailer slot */
+      data[trailer] ^= (1 << 22);
+      break;
+    case 3:			/* Event number jump */
+      data[1] ^= 0x100;
+      break;
+    default:			/* Events in block */
+      data[0] ^= 0x2;
+      break;
+    }
+
+  return n;
+}
+
+int
+faReadBlock(int id, volatile UINT32 *data, int nwrds, int rflag)
+{
+  static unsigned int *blk = NULL;
+  static int blkSize = 0;
+  unsigned long long iblk = ++faBlocksRead;
+  int ifa, islot, nmax, nwords = 0, n;
+
+  if(simReplay.nrec)
+    {
+      simReplaySelect(iblk, 1);
+      nwords = simReplay.faWords;
+      if(nwords > nwrds)
+	{
+	  printf("faReadBlock: WARN: DMA transfer terminated by word count (%d)\n", nwrds);
+	  faBlockError = 1;
+	  nwords = nwrds;
+	}
+      memcpy((void *) data, simReplay.faData, nwords * sizeof(unsigned int));
+      goto done;
+    }
+
+  if(simWave == NULL || simWavePtw != simConfig.ptw)
+    simWaveInit();
+
+  /* Largest possible module block */
+  nmax = 4 + faBlockLevel * (3 + 16 * (1 + simWaveWords)) + simConfig.faExtraWords;
+  if(blkSize < nmax)
+    {
+      free(blk);
+      blk = malloc(nmax * sizeof(unsigned int));
+      blkSize = nmax;
+    }
+
+  for(ifa = 0; ifa < nfadc; ifa++)
+    {
+      islot = faSlotList[ifa];
+      if((rflag != 2) && (id != 0) && (islot != id))
+	continue;
+
+      n = simFaBlock(islot, iblk, blk);
+      if((simConfig.faErrorFraction > 0) &&
+	 (((simRand() % 10000) / 10000.) < simConfig.faErrorFraction))
+	n = simFaCorrupt(blk, n);
+      if(nwords + n > nwrds)
+	{
+	  memcpy((void *) &data[nwords], blk, (nwrds - nwords) * sizeof(unsigned int));
+	  nwords = nwrds;
+	  printf("faReadBlock: WARN: DMA transfer terminated by word count (%d)\n", nwrds);
+	  faBlockError = 1;
+	  break;
+	}
+      memcpy((void *) &data[nwords], blk, n * sizeof(unsigned int));
+      nwords += n;
+
+      if(rflag != 2)
+	break;
+    }
+
+ done:
+  faWordsRead += nwords;
+  if(simConfig.dmaMBps > 0)
+    simDmaWait(nwords * 4 * 1e3 / simConfig.dmaMBps);
+
+  return nwords;
+}
+
+/*************************************************************************
+ *  FADC250 configuration file
+ */
+
+static int
+simConfigKey(char *line, char *key, unsigned int *val)
+{
+  int len = strlen(key);
+
+  if(strncmp(line, key, len) == 0 && (line[len] == ' ' || line[len] == '\t'))
+    {
+      *val = strtoul(&line[len], NULL, 0);
+      return 1;
+    }
+  return 0;
+}
+
+int
+fadc250Config(char *fname)
+{
+  FILE *fd;
+  char line[256];
+  unsigned int val;
+
+  if((fname == NULL) || (strlen(fname) == 0))
+    return OK;
+
+  fd = fopen(fname, "r");
+  if(fd == NULL)
+    {
+      printf("fadc250Config: ERROR: Unable to open %s\n", fname);
+      return ERROR;
+    }
+
+  while(fgets(line, sizeof(line), fd))
+    {
+      if(simConfigKey(line, "FADC250_MODE", &val))
+	simConfig.mode = val;
+      else if(simConfigKey(line, "FADC250_W_WIDTH", &val))
+	simConfig.ptw = val / 4;
+      else if(simConfigKey(line, "FADC250_W_OFFSET", &val))
+	simConfig.pl = val / 4;
+      else if(simConfigKey(line, "FADC250_NSA", &val))
+	simConfig.nsa = val / 4;
+      else if(simConfigKey(line, "FADC250_NSB", &val))
+	simConfig.nsb = val / 4;
+    }
+  fclose(fd);
+
+  return OK;
+}
+
+int
+fadc250UploadAll(char *string, int length)
+{
+  int ifa, ichan, len = 0;
+
+  if(length <= 0)
+    return 0;
+  string[0] = '\0';
+
+#define UPLOAD(...) {							\
+    if(len < length)							\
+      len += snprintf(&string[len], length - len, __VA_ARGS__);	\
+  }
+
+  for(ifa = 0; ifa < nfadc; ifa++)
+    {
+      UPLOAD("FADC250_SLOT %d\n", faSlotList[ifa]);
+      UPLOAD("FADC250_MODE %d\n", simConfig.mode);
+      UPLOAD("FADC250_W_OFFSET %d\n", simConfig.pl * 4);
+      UPLOAD("FADC250_W_WIDTH %d\n", simConfig.ptw * 4);
+      UPLOAD("FADC250_NSB %d\n", simConfig.nsb * 4);
+      UPLOAD("FADC250_NSA %d\n", simConfig.nsa * 4);
+      UPLOAD("FADC250_NPEAK %d\n", simConfig.np);
+      UPLOAD("FADC250_ADC_MASK");
+      for(ichan = 0; ichan < 16; ichan++)
+	UPLOAD(" 1");
+      UPLOAD("\nFADC250_TET");
+      for(ichan = 0; ichan < 16; ichan++)
+	UPLOAD(" %d", 10);
+      UPLOAD("\nFADC250_DAC");
+      for(ichan = 0; ichan < 16; ichan++)
+	UPLOAD(" %d", 3200 + ichan);
+      UPLOAD("\nFADC250_PED");
+      for(ichan = 0; ichan < 16; ichan++)
+	UPLOAD(" %.3f", 100.0 + ichan);
+      UPLOAD("\nFADC250_GAIN");
+      for(ichan = 0; ichan < 16; ichan++)
+	UPLOAD(" %.3f", 1.0);
+      UPLOAD("\n\n");
+    }
+#undef UPLOAD
+
+  if(len >= length)
+    len = length - 1;
+
+  return len;
+}
+
+/*************************************************************************
+ *  SD
+ */
+
+int sdInit(int flag) { return OK; }
+int sdStatus(int pflag) { return OK; }
+int sdSetActiveVmeSlots(unsigned int vmemask) { return OK; }
+
+/*************************************************************************
+ *  VLD
+ */
+
+int
+vldInit(unsigned int addr, unsigned int addr_inc, int nfind, int iFlag)
+{
+  printf("vldInit: Found %d simulated VLD\n", simConfig.nvld);
+  return simConfig.nvld;
+}
+
+int
+vldGetNVLD()
+{
+  return simConfig.nvld;
+}
+
+void
+vldGStatus(int pflag)
+{
+}
+
+int
+vldShmResetCounts(int clear_trig, int clear_pulse)
+{
+  return OK;
+}
+
+int
+vldShmReadBlock(volatile unsigned int *data, int nwords)
+{
+  unsigned int vld[4];
+  int n = 4;
+
+  if(simReplay.nrec)
+    {
+      n = (simReplay.vldWords < nwords) ? simReplay.vldWords : nwords;
+      memcpy((void *) data, simReplay.vldData, n * sizeof(unsigned int));
+      return n;
+    }
+
+  vld[0] = 0x80000000 | (simBlockNumber & 0xffff);
+  vld[1] = (unsigned int) simFirstEvent;
+  vld[2] = 0;
+  vld[3] = 0x88000000 | 4;
+
+  if(n > nwords)
+    n = nwords;
+  memcpy((void *) data, vld, n * sizeof(unsigned int));
+
+  return n;
+}
+
+/*************************************************************************
+ *  Scaler server interface
+ */
+
+static unsigned int simScalerCount = 0;
+
+int
+fadcscaler_init_crl()
+{
+  return 1;
+}
+
+void set_runstatus(int status) { }
+void enable_scalers() { }
+void disable_scalers() { }
+void read_clock_channels() { }
+
+int
+read_fadc_scalers(unsigned int **dabufp, int flag)
+{
+  int ifa, ichan;
+  unsigned int *dp;
+
+  simScalerCount++;
+  simSpin((double) simConfig.vmeCycleNs * nfadc * 17);
+
+  if((dabufp == NULL) || (*dabufp == NULL))
+    return OK;
+
+  dp = *dabufp;
+  for(ifa = 0; ifa < nfadc; ifa++)
+    {
+      *dp++ = 0xDA000000 | (faSlotList[ifa] << 16) | 16;
+      for(ichan = 0; ichan < 16; ichan++)
+	*dp++ = simScalerCount * 1000 + ichan;
+      *dp++ = 0xDA0000FF;
+    }
+  *dabufp = dp;
+
+  return OK;
+}
+
+int
+read_ti_scalers(unsigned int **dabufp, int flag)
+{
+  int ii;
+  unsigned int *dp;
+
+  simSpin((double) simConfig.vmeCycleNs * 8);
+
+  if((dabufp == NULL) || (*dabufp == NULL))
+    return OK;
+
+  dp = *dabufp;
+  *dp++ = 0xDA000011;
+  for(ii = 0; ii < 6; ii++)
+    *dp++ = (unsigned int) ti.accepted;
+  *dp++ = 0xDA0000FF;
+  *dabufp = dp;
+
+  return OK;
+}
+
+/*************************************************************************
+ *  Statistics
+ */
+
+void
+simGetStats(SIM_STATS *stats)
+{
+  pthread_mutex_lock(&ti.lock);
+  stats->offered = ti.offered;
+  stats->accepted = ti.accepted;
+  stats->blocks = ti.blocksRead;
+  stats->syncBlocks = ti.syncBlocks;
+  stats->pending = ti.accepted / ti.blockLevel - ti.blocksRead;
+  pthread_mutex_unlock(&ti.lock);
+  stats->faWords = faWordsRead;
+  stats->pollCpu = tiPollCpu;
+  stats->replayRecords = simReplay.nrec;
+  stats->faCorrupted = faCorrupted;
+  stats->logErrors = logErrors;
+}
@@ -0,0 +1,51 @@
+/*************************************************************************
+ *
+ *  simLib.h - Configuration and statistics of the simulated TI, FADC250,
+ *             SD and VLD backend (hardware stand-in for the readout lists)
+ *
+ */
+
+#ifndef __SIMLIB_H__
+#define __SIMLIB_H__
+
+typedef struct
+{
+  double trigRate;		/* L1A rate (Hz), 0 = as fast as the readout allows */
+  int nfadc;			/* Number of FADC250 in the crate */
+  int mode;			/* FADC250 processing mode */
+  unsigned int pl, ptw, nsb, nsa, np;	/* FADC250 window settings */
+  int nvld;			/* Number of VLD (0 or 1) */
+  double pulseFraction;		/* Fraction of channels with a pulse */
+  unsigned int faLatencyNs;	/* Time from trigger readout to FADC block ready */
+  unsigned int vmeCycleNs;	/* Cost of a single cycle VME access */
+  double dmaMBps;		/* Emulated block transfer rate, 0 = memcpy speed */
+  int syncInterval;		/* Override of tiSetSyncEventInterval (blocks), -1 = list value */
+  unsigned int seed;		/* Random seed for the waveform generator */
+  char *replayFile;		/* Capture file (rocCapture.h) to replay, NULL = generate */
+  double faErrorFraction;	/* Fraction of FADC250 blocks with a broken structure */
+  int faExtraWords;		/* Words added to each FADC250 block, beyond its expected size */
+  int hugePages;		/* Event buffer memory (dmaPCreate) in 2 MB huge pages */
+  int tiStuckBReady;		/* Fault: tiBReady / tiBlockStatus report a block that never comes */
+  double tiLongFraction;	/* Fraction of TI blocks with a trigger bits word in each event */
+} SIM_CONFIG;
+
+extern SIM_CONFIG simConfig;
+
+typedef struct
+{
+  unsigned long long offered;	/* L1A offered by the trigger source */
+  unsigned long long accepted;	/* L1A accepted (not lost to busy) */
+  unsigned long long blocks;	/* Blocks read out */
+  unsigned long long syncBlocks;	/* Sync event blocks read out */
+  unsigned long long faWords;	/* FADC250 words transferred */
+  double pollCpu;		/* CPU seconds used by the TI polling thread */
+  unsigned long long replayRecords;	/* Records in the replayed capture file */
+  unsigned long long faCorrupted;	/* FADC250 blocks with a broken structure */
+  unsigned long long pending;	/* Blocks held in the TI, not read out */
+  unsigned long long logErrors;	/* daLogMsg with severity ERROR */
+} SIM_STATS;
+
+void simGetStats(SIM_STATS *stats);
+double simTime();
+
+#endif /* __SIMLIB_H__ */
@@ -167,6 +167,30 @@ readUserFlags()
   else
     printf("\tDISABLED\n");
 
+  /* Readout (asyncTrigger) and CODA (usrtrig) threads, CPU list as 2:3 or 2-3:
+       'readoutcpu=<CPU list>', 'readoutprio=<SCHED_FIFO priority>',
+       'codacpu=<CPU list>', 'codaprio=<SCHED_FIFO priority>' */
+  rocSchedConfig(ROC_SCHED_READOUT,
+		 (getflag("readoutcpu") == 2) ? getvalue("readoutcpu") : NULL,
+		 (getflag("readoutprio") == 2) ? getint("readoutprio") : 0);
+  rocSchedConfig(ROC_SCHED_CODA,
+		 (getflag("codacpu") == 2) ? getvalue("codacpu") : NULL,
+		 (getflag("codaprio") == 2) ? getint("codaprio") : 0);
+
+  /* Events copied out by each call of usrtrig: 'outbatch=<N>',
+     up to 'outbatchkb=<KB>' of data (default one event buffer).
+     Only with -DROC_OUTPUT_BATCH, see rocSetOutputBatch */
+  rocSetOutputBatch((getflag("outbatch") == 2) ? getint("outbatch") : 1,
+		    (getflag("outbatchkb") == 2) ? getint("outbatchkb") : 0);
+
+  /* CODA thread sleeps on the event ring instead of polling it: 'codawait',
+     after spinning up to 'codawait=<us>' (default 20 us) */
+  flag = getflag("codawait");
+  rocSetCodaWait((flag == 2) ? getint("codawait") : (flag ? 20 : -1));
+
+  /* Longest wait of End for the TI to be read out: 'endtimeout=<ms>' */
+  rocSetEndTimeout((getflag("endtimeout") == 2) ? getint("endtimeout") : 0);
+
 }
 
 /*
@@ -418,7 +442,7 @@ rocTrigger(int arg)
     }
   else
     { /* TI Data is already in a bank structure.  Bump the pointer */
-      dma_dabufp += dCnt;
+      rocEventCommit(dCnt);
     }
 
   /* EXAMPLE: How to open a bank (name=5, type=ui4) and add data words by hand */
@@ -38,7 +38,6 @@
 #include "tiLib.h"
 extern int bigendian_out;
 
-extern int tiNeedAck; /* Request for acknowledge, declared in tiLib */
 extern DMANODE *the_event; /* node pointer for event buffer obtained from GETEVENT, declared in dmaPList */
 extern unsigned int *dma_dabufp; /* event buffer pointer obtained from GETEVENT, declared in dmaPList */
 extern void daLogMsg(char *severity, char *fmt,...);
@@ -52,12 +51,12 @@ static int tsCrate=1;
 #endif
 
 int emptyCount = 0;   /* Count the number of times event buffers are empty */
-int errCount = 0;     /* Count the number of times no buffer available from vmeIN */
+int errCount = 0;     /* Count the number of times no buffer available from the ring */
 
 #define ISR_INTLOCK INTLOCK
 #define ISR_INTUNLOCK INTUNLOCK
 
-/* Readout Acknowledge condition variable and mutex */
+/* End of run mutex */
 pthread_mutex_t ack_mutex=PTHREAD_MUTEX_INITIALIZER;
 #define ACKLOCK {				\
     if(pthread_mutex_lock(&ack_mutex)<0)	\
@@ -67,28 +66,32 @@ pthread_mutex_t ack_mutex=PTHREAD_MUTEX_INITIALIZER;
     if(pthread_mutex_unlock(&ack_mutex)<0)	\
       perror("pthread_mutex_unlock");		\
   }
-pthread_cond_t ack_cv = PTHREAD_COND_INITIALIZER;
-#define ACKWAIT {					\
-    if(pthread_cond_wait(&ack_cv, &ack_mutex)<0)	\
-      perror("pthread_cond_wait");			\
-  }
-#define ACKSIGNAL {					\
-    if(pthread_cond_signal(&ack_cv)<0)			\
-      perror("pthread_cond_signal");			\
-  }
-int ack_runend=0;
+volatile int ack_runend=0;
 
 /* End of run condition variable */
 pthread_cond_t endrun_cv = PTHREAD_COND_INITIALIZER;
 struct timespec endrun_waittime;
 int endrun_timedwait_ret=0;
-#define ENDRUN_TIMEDWAIT(__x) {						\
+int endrun_timeout_ms=30000;	/* Wait of End for the TI to be read out (rocSetEndTimeout) */
+#define ENDRUN_DEADLINE(__ms) {						\
     clock_gettime(CLOCK_REALTIME, &endrun_waittime);			\
-    endrun_waittime.tv_sec += __x;					\
+    endrun_waittime.tv_sec += (__ms) / 1000;				\
+    endrun_waittime.tv_nsec += ((__ms) % 1000) * 1000000L;		\
+    if(endrun_waittime.tv_nsec >= 1000000000L)				\
+      {									\
+	endrun_waittime.tv_sec++;					\
+	endrun_waittime.tv_nsec -= 1000000000L;				\
+      }									\
+    endrun_timedwait_ret = 0;						\
+  }
+#define ENDRUN_TIMEDWAIT {						\
     endrun_timedwait_ret = pthread_cond_timedwait(&endrun_cv, &ack_mutex, &endrun_waittime); \
-    if(endrun_timedwait_ret<0)						\
+    if((endrun_timedwait_ret != 0) && (endrun_timedwait_ret != ETIMEDOUT)) \
       perror("pthread_cond_timedwait");					\
   }
+/* End waits (ENDRUN_TIMEDWAIT) until usrtrig has all of the data: blocks
+   left in the TI, or events in the ring */
+#define ENDRUN_PENDING ((tiBlockStatus(0,0) != 0) || (rocRingCount(&eventRing) != 0))
 #define ENDRUN_SIGNAL {					\
     if(pthread_cond_signal(&endrun_cv)<0)		\
       perror("pthread_cond_signal");			\
@@ -107,12 +110,98 @@ void rocCleanup();
 int  getOutQueueCount();
 int  getInQueueCount();
 
+/* Resize the event buffers (vmeIN), from rocPrestart or rocGo */
+int  rocSetEventPool(int eventBytes, int depth);
+
+/* Events copied out by each call of usrtrig, from rocPrestart */
+void rocSetOutputBatch(int maxEvents, int maxKB);
+
+/* CODA thread sleeps while the event ring is empty, from rocPrestart */
+void rocSetCodaWait(int spinUs);
+
+/* Longest wait of End for the TI to be read out, from rocPrestart */
+void rocSetEndTimeout(int ms);
+
 /* Asynchronous (to tiprimary rol) trigger routine, connects to rocTrigger */
 void asyncTrigger();
 
 /* Input and Output Partitions for VME Readout */
 DMA_MEM_ID vmeIN, vmeOUT;
 
+/* Event buffers handed from asyncTrigger to usrtrig.  Takes all of the
+   nodes of vmeIN at Prestart. */
+#include "rocRing.c"
+ROC_RING eventRing;
+
+/* Guard pages and room left in the event buffers */
+#include "rocEvent.c"
+
+/* CPU affinity and priority of the readout and CODA threads */
+#include "rocSched.c"
+
+/* Live run status, for rocmon */
+#include "rocStatus.c"
+
+/* Bulk copy of event data to the ROC output buffer */
+#include "rocCopy.c"
+
+/* Capture of the event buffers to file, for replay */
+#include "rocCapture.c"
+
+/* Events copied out by each call of usrtrig (rocSetOutputBatch) */
+static struct
+{
+  unsigned int maxEvents;
+  long maxWords;		/* Of output, 0 = one event buffer */
+} outBatch = { 1, 0 };
+
+/*
+  CODA thread wait for an event (rocSetCodaWait): spin up to spinNs, then
+  sleep until asyncTrigger hands over an event.  The window follows the
+  gaps between events: an event that came soon after the spin gave up
+  doubles it (up to maxSpinNs), a longer gap halves it.
+*/
+#define CODA_WAIT_SLEEP_NS  10000000L	/* Back to the CODA poll loop after */
+
+static struct
+{
+  int on;
+  long maxSpinNs;
+  long spinNs;			/* Current window */
+} codaWait = { 0, 0, 0 };
+
+/* Trigger source test: an event is waiting in the ring */
+static int
+tiprimaryRingTest()
+{
+  unsigned long long t0, dt;
+  unsigned int n;
+
+  if(rocRingPeek(&eventRing) != NULL)
+    return 1;
+
+  if(!codaWait.on)
+    return 0;
+
+  t0 = rocRingClock();
+  n = rocRingWaitFilled(&eventRing, codaWait.spinNs, CODA_WAIT_SLEEP_NS);
+  dt = rocRingClock() - t0;
+
+  if(dt > codaWait.spinNs)
+    {
+      if(n && (dt < codaWait.spinNs + codaWait.maxSpinNs))
+	codaWait.spinNs = 2 * codaWait.spinNs + 1000;
+      else
+	codaWait.spinNs /= 2;
+      if(codaWait.spinNs > codaWait.maxSpinNs)
+	codaWait.spinNs = codaWait.maxSpinNs;
+    }
+
+  return (n != 0);
+}
+#undef TIPRIMARY_TEST
+#define TIPRIMARY_TEST tiprimaryRingTest
+
 /**
  *  DOWNLOAD
  */
@@ -129,15 +218,16 @@ static void __download()
   bigendian_out=1;
 
   pthread_mutex_init(&ack_mutex, NULL);
-  pthread_cond_init(&ack_cv,NULL);
   pthread_cond_init(&endrun_cv,NULL);
 
   /* Initialize memory partition library */
   dmaPartInit();
 
-  /* Setup Buffer memory to store events */
+  /* Setup Buffer memory to store events, each with a guard page */
+  rocEventGuard(&eventRing, 0);
+  rocRingClose(&eventRing);
   dmaPFreeAll();
-  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH,MAX_EVENT_POOL,0);
+  vmeIN  = dmaPCreate("vmeIN",MAX_EVENT_LENGTH + ROC_EVENT_EXTRA_BYTES,MAX_EVENT_POOL,0);
   vmeOUT = dmaPCreate("vmeOUT",0,0,0);
 
   if(vmeIN == 0) {
@@ -148,6 +238,8 @@ static void __download()
   dmaPReInitAll();
   dmaPStatsAll();
 
+  rocStatusInit(ROCID);
+
   /* Initialize Fiber Latency offset */
   tiSetFiberLatencyOffset_preInit(FIBER_LATENCY_OFFSET);
 
@@ -177,6 +269,7 @@ static void __download()
   /* Execute User defined download */
   rocDownload();
 
+  rocStatusState(ROC_STATE_DOWNLOADED);
   daLogMsg("INFO","Download Executed");
 
   /* If the TI Master, send a Clock and Trig Link Reset */
@@ -225,10 +318,16 @@ static void __prestart()
 
   /* Clean up events in event buffers */
   if(getOutQueueCount() != 0)
+    daLogMsg("INFO","Cleaning up %d buffers from the event ring", getOutQueueCount());
+
+  /* Return all buffers to vmeIN, then hand them to the event ring */
+  dmaPReInitAll();
+  if(rocRingInit(&eventRing, vmeIN) == 0)
     {
-      daLogMsg("INFO","Cleaning up %d buffers from vmeOUT", getOutQueueCount());
-      dmaPReInitAll();
+      daLogMsg("ERROR","No event buffers available for the event ring");
+      ROL_SET_ERROR;
     }
+  rocEventGuard(&eventRing, 1);
 
   /* Execute User defined prestart */
   rocPrestart();
@@ -246,6 +345,7 @@ static void __prestart()
   /* Connect User Trigger Routine */
   tiIntConnect(TI_INT_VEC,asyncTrigger,0);
 
+  rocStatusState(ROC_STATE_PRESTARTED);
   daLogMsg("INFO","Prestart Executed");
 
   if (__the_event__) WRITE_EVENT_;
@@ -267,25 +367,47 @@ static void __end()
     }
 
   blockstatus = tiBlockStatus(0,0);
-  printf("__end: blockstatus=%d\n",blockstatus);
+  printf("__end: blockstatus=%d  events in the ring=%d\n",blockstatus,rocRingCount(&eventRing));
 
+  /* Until usrtrig copied out the last event, or the timeout.  The
+     condition is checked again after each wakeup: usrtrig may have
+     signalled before ack_runend was set */
   ACKLOCK;
   ack_runend=1;
-  if(blockstatus)
-    {
-      printf("%s: Clearing data from TI (blockstatus = 0x%x)\n",__FUNCTION__, blockstatus);
-      ENDRUN_TIMEDWAIT(30);
-      printf("%s: endrun_timedwait_ret = %d   blockstatus = 0x%x\n",
-	     __FUNCTION__,endrun_timedwait_ret,tiBlockStatus(0,0));
-    }
+  ENDRUN_DEADLINE(endrun_timeout_ms);
+  if(ENDRUN_PENDING)
+    printf("%s: Clearing data from TI (blockstatus = 0x%x)\n",__FUNCTION__, blockstatus);
+  while(ENDRUN_PENDING && (endrun_timedwait_ret == 0))
+    ENDRUN_TIMEDWAIT;
   ACKUNLOCK;
 
+  /* The readout thread does not wait for usrtrig from here */
+  rocRingRelease(&eventRing);
+
+  /* The last asyncTrigger is done: its event, if any, is in the ring */
   INTLOCK;
   INTUNLOCK;
 
+  ACKLOCK;
+  while(ENDRUN_PENDING && (endrun_timedwait_ret == 0))
+    ENDRUN_TIMEDWAIT;
+  ACKUNLOCK;
+
+  if(endrun_timedwait_ret == ETIMEDOUT)
+    daLogMsg("WARN","End timed out after %d ms: blockstatus = 0x%x, %d events in the ring",
+	     endrun_timeout_ms, tiBlockStatus(0,0), rocRingCount(&eventRing));
+
+  /* Back to the CPUs and policy they had, while the threads are alive */
+  rocSchedRestore();
+
   tiIntDisable();
   tiIntDisconnect();
 
+  rocCaptureClose();
+
+  if(rocEvt.ntruncated)
+    daLogMsg("WARN","%llu events cut to the event buffer size", rocEvt.ntruncated);
+
   /* Execute User defined end */
   rocEnd();
 
@@ -293,6 +415,8 @@ static void __end()
 
   dmaPStatsAll();
 
+  rocStatusState(ROC_STATE_ENDED);
+  rocStatusPrintStats();
   daLogMsg("INFO","End Executed");
 
   if (__the_event__) WRITE_EVENT_;
@@ -321,10 +445,20 @@ static void __go()
 
   emptyCount=0;
   errCount=0;
+  rocEvt.ntruncated=0;
 
   CDOENABLE(TIPRIMARY,1,1);
   rocGo();
 
+  /* CODA thread polls, or sleeps on the event ring */
+  rocRingWakeConsumer(&eventRing, codaWait.on);
+  codaWait.spinNs = codaWait.maxSpinNs;
+
+  /* Readout and CODA threads: settings and counters from their first call */
+  rocSchedArm();
+
+  rocStatusState(ROC_STATE_ACTIVE);
+
   tiIntEnable(1);
 
   if (__the_event__) WRITE_EVENT_;
@@ -332,58 +466,82 @@ static void __go()
 
 void usrtrig(unsigned long EVTYPE,unsigned long EVSOURCE)
 {
-  int ii, len;
+  int len;
   int syncFlag = 0;
   unsigned int event_number=0;
   DMANODE *outEvent;
-  unsigned int blockstatus = 0;
-  int bready = 0;
+  unsigned int nout, iout;
+  unsigned long long now = 0;
+  long budget;
 
-  outEvent = dmaPGetItem(vmeOUT);
-  if(outEvent != NULL)
-    {
-      len = outEvent->length;
-      syncFlag = outEvent->type;
-      event_number = outEvent->nevent;
+  rocSchedThread(ROC_SCHED_CODA);
 
-      CEOPEN(ROCID, BT_BANK, blockLevel);
+  /* Events waiting, up to the batch (one event without rocSetOutputBatch) */
+  nout = rocRingCount(&eventRing);
+  if(nout > outBatch.maxEvents)
+    nout = outBatch.maxEvents;
 
-      if(rol->dabufp != NULL)
+  if(nout > 0)
+    {
+      budget = outBatch.maxWords;
+      if(budget == 0)		/* One event buffer */
 	{
-	  for(ii=0;ii<len;ii++)
-	    {
-	      *rol->dabufp++ = outEvent->data[ii];
-	    }
+	  outEvent = rocRingPeekAt(&eventRing, 0);
+	  budget = rocEventNodeEnd(outEvent) - rocEventData(outEvent) + 2;
 	}
-      else
+
+      /* Handoff latency, of the CODA thread wait only (nodes stamped) */
+      if(codaWait.on)
+	now = rocRingClock();
+
+      for(iout = 0; iout < nout; iout++)
 	{
-	  printf("tiprimary_list: ERROR rol->dabufp is NULL -- Event lost\n");
-	}
+	  outEvent = rocRingPeekAt(&eventRing, iout);
+	  len = outEvent->length;
+	  syncFlag = outEvent->type;
+	  event_number = outEvent->nevent;
+
+	  /* The first event always, the next ones while they fit */
+	  if((iout > 0) && (len + 2 > budget))
+	    break;
+	  budget -= len + 2;
 
-      CECLOSE;
+	  CEOPEN(ROCID, BT_BANK, blockLevel);
+
+	  if(rol->dabufp != NULL)
+	    {
+	      rol->dabufp = rocCopyWords(rol->dabufp, rocEventData(outEvent), len);
+	    }
+	  else
+	    {
+	      printf("tiprimary_list: ERROR rol->dabufp is NULL -- Event lost\n");
+	    }
 
-      ACKLOCK;
+	  CECLOSE;
 
-      outEvent->type = 0;
-      dmaPFreeItem(outEvent);
+	  outEvent->type = 0;
+	  outEvent->length = 0;
 
-      if(tiNeedAck>0)
-	{
-	  tiNeedAck=0;
-	  ACKSIGNAL;
+	  /* From the handoff by asyncTrigger */
+	  if(codaWait.on)
+	    rocStatusHandoff(now - rocRingStampAt(&eventRing, iout));
 	}
 
+      /* Give the buffers back to asyncTrigger (wakes it if the ring was full) */
+      rocRingFreeN(&eventRing, iout);
+      rocStatusBatch(iout);
+
       if(ack_runend)
 	{
-	  if(tiBlockStatus(0,0)==0)
+	  ACKLOCK;
+	  if(!ENDRUN_PENDING)
 	    ENDRUN_SIGNAL;
+	  ACKUNLOCK;
 	}
-
-      ACKUNLOCK;
     }
   else
     {
-      logMsg("Error: no Event in vmeOUT queue\n",0,0,0,0,0,0);
+      logMsg("Error: no Event in the event ring\n",0,0,0,0,0,0);
     }
 
 } /*end trigger */
@@ -393,28 +551,44 @@ void asyncTrigger()
   int intCount=0;
   int length,size;
   int tiSyncFlag = 0;
+  int cancelState;
+
+  /* The TI poll thread is cancelled by tiIntDisable, and holds INTLOCK
+     here: not until it leaves */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+
+  rocSchedThread(ROC_SCHED_READOUT);
+  rocStatusTrigger();
 
   intCount = tiGetIntCount();
 
-  /* grap a buffer from the queue */
-  GETEVENT(vmeIN,intCount);
+  /* grab a buffer from the ring */
+  the_event = rocRingGet(&eventRing);
   if(the_event == NULL)
     {
       if(errCount == 0)
 	daLogMsg("ERROR","asyncTrigger: No DMA Buffer Available. Events could be out of sync!");
       printf("asyncTrigger:ERROR: No buffer available!\n");
       errCount++;
+      rocStatusTick();
+      pthread_setcancelstate(cancelState, NULL);
       return;
     }
   if(the_event->length!=0)
     {
       printf("asyncTrigger: ERROR: Interrupt Count = %d the_event->length = %ld\t",intCount, the_event->length);
     }
+  the_event->nevent = intCount;
   the_event->type = 0;
+  dma_dabufp = rocEventData(the_event);
+  rocEventBegin(the_event);
 
   /* Execute user defined Trigger Routine */
   rocTrigger(intCount);
 
+  /* Mark the event if a readout did not fit */
+  rocEventEnd(the_event);
+
   /* Store Sync Flag status for this event */
   /* Sync Flag is obtained from tiReadTriggerBlock in rocTrigger */
 
@@ -422,13 +596,18 @@ void asyncTrigger()
   the_event->type = tiSyncFlag;
 
 
-  /* Put this event's buffer into the OUT queue. */
-  ACKLOCK;
-  PUTEVENT(vmeOUT);
+  /* Hand this event's buffer to usrtrig. */
+  the_event->length = dma_dabufp - rocEventData(the_event);
+  if(the_event->length == 0)
+    printf("asyncTrigger: Empty event length\n");
+  rocCaptureEvent(the_event);
+  rocRingPut(&eventRing);
+  rocStatusEvent(intCount, dma_dabufp - rocEventData(the_event));
 
-  /* Check if the event length is larger than expected */
-  length = (((long)(dma_dabufp) - (long)(&the_event->length))) - 4;
-  size = the_event->part->size - sizeof(DMANODE);
+  /* Check if the event length is larger than expected (should not
+     happen: writes past the guard page fault) */
+  length = (char *) dma_dabufp - (char *) rocEventData(the_event);
+  size = (char *) rocEventNodeEnd(the_event) - (char *) rocEventData(the_event);
 
   if(length>size)
     {
@@ -437,24 +616,22 @@ void asyncTrigger()
       daLogMsg("WARN", "Event buffer overflow");
     }
 
-  if(dmaPEmpty(vmeIN))
+  if(rocRingFull(&eventRing))
     {
       emptyCount++;
-      /*printf("WARN: vmeIN out of event buffers (intCount = %d).\n",intCount);*/
+      /*printf("WARN: event ring out of buffers (intCount = %d).\n",intCount);*/
 
       if((ack_runend == 0) || (tiBReady() > 0))
 	{
-	  /* Set the NeedAck for Ack after a buffer is freed */
-	  tiNeedAck = 1;
-
-	  /* Wait for the signal indicating that a buffer has been freed */
-	  ACKWAIT;
+	  /* Wait for usrtrig to free a buffer */
+	  uint64_t t0 = rocStatusClock(CLOCK_MONOTONIC);
+	  rocRingWaitFree(&eventRing);
+	  rocStatusWait(rocStatusClock(CLOCK_MONOTONIC) - t0);
 	}
 
     }
 
-  ACKUNLOCK;
-
+  pthread_setcancelstate(cancelState, NULL);
 }
 
 void usrtrig_done()
@@ -468,19 +645,20 @@ void __done()
 
 static void __reset()
 {
-  int iemp=0;
+  /* Readout thread out of its wait for a free buffer, before it is stopped */
+  rocRingRelease(&eventRing);
+
+  rocSchedRestore();
 
   tiIntDisable();
   tiIntDisconnect();
 
-  /* Empty the vmeOUT queue */
-  while(!dmaPEmpty(vmeOUT))
-    {
-      iemp++;
-      dmaPFreeItem(dmaPGetItem(vmeOUT));
-      if(iemp>=MAX_EVENT_POOL) break;
-    }
+  /* Empty the event ring */
+  rocRingFlush(&eventRing);
 
+  rocCaptureClose();
+
+  rocStatusState(ROC_STATE_RESET);
   printf(" **Reset Called** \n");
 
 } /* end reset */
@@ -488,19 +666,159 @@ static void __reset()
 int
 getOutQueueCount()
 {
-  if(vmeOUT)
-    return(dmaPNodeCount(vmeOUT));
-  else
-    return(0);
+  return(rocRingCount(&eventRing));
 }
 
 int
 getInQueueCount()
 {
-  if(vmeIN)
-    return(dmaPNodeCount(vmeIN));
-  else
-    return(0);
+  return(eventRing.nnode - rocRingCount(&eventRing));
+}
+
+/*
+  The CODA thread sleeps while the event ring is empty, after spinning up
+  to spinUs, instead of polling it.  spinUs < 0 to poll.
+*/
+void
+rocSetCodaWait(int spinUs)
+{
+  codaWait.on = (spinUs >= 0);
+  codaWait.maxSpinNs = (spinUs > 0) ? 1000L * spinUs : 0;
+  codaWait.spinNs = codaWait.maxSpinNs;
+
+  if(codaWait.on)
+    printf("%s: CODA thread sleeps on the event ring, after up to %d us of spinning\n",
+	   __func__, spinUs);
+}
+
+/*
+  Longest wait of End, in ms, for the blocks left in the TI to be read
+  out and handed to usrtrig (default 30 s).
+*/
+void
+rocSetEndTimeout(int ms)
+{
+  if(ms <= 0)
+    ms = 30000;
+
+  endrun_timeout_ms = ms;
+}
+
+/*
+  Copy out up to maxEvents events (1 = one per call) in each call of
+  usrtrig, back to back in the output buffer, with up to maxKB of data.
+  maxKB = 0 for the size of one event buffer: what the output buffer
+  must already take for a single event.
+
+  With maxEvents > 1, one call of usrtrig opens and closes several
+  events (CEOPEN/CECLOSE) in one output buffer.  This is only checked
+  against the sim rol.h, not against the CODA ROC and event builder,
+  so it is compiled in only with -DROC_OUTPUT_BATCH (the sim build):
+  without it, maxEvents is always 1.
+*/
+void
+rocSetOutputBatch(int maxEvents, int maxKB)
+{
+#ifndef ROC_OUTPUT_BATCH
+  if(maxEvents > 1)
+    printf("%s: %d events per usrtrig call not compiled in (-DROC_OUTPUT_BATCH), one event\n",
+	   __func__, maxEvents);
+  maxEvents = 1;
+#endif
+  if(maxEvents < 1)
+    maxEvents = 1;
+  if(maxEvents > ROC_RING_MAX)
+    maxEvents = ROC_RING_MAX;
+  if(maxKB < 0)
+    maxKB = 0;
+
+  outBatch.maxEvents = maxEvents;
+  outBatch.maxWords = maxKB * 256;
+
+  if((maxEvents > 1) && maxKB)
+    printf("%s: Up to %d events, %d KB per usrtrig call\n", __func__, maxEvents, maxKB);
+  else if(maxEvents > 1)
+    printf("%s: Up to %d events, one event buffer per usrtrig call\n", __func__, maxEvents);
+}
+
+/*
+  Replace the event buffers (vmeIN) with depth buffers of eventBytes each
+  (depth = 0 for MAX_EVENT_POOL).  Only possible with no events in the
+  ring, i.e. in rocPrestart or rocGo.  If the new buffers cannot be
+  allocated, buffers of the previous size are restored.
+*/
+int
+rocSetEventPool(int eventBytes, int depth)
+{
+  static unsigned long poolAlign = ROC_EVENT_ALIGN;	/* Of the current buffers */
+  long page = sysconf(_SC_PAGESIZE);
+  DMA_MEM_ID newIN;
+  int oldBytes, oldDepth;
+
+  if(depth <= 0)
+    depth = MAX_EVENT_POOL;
+  if(depth > ROC_RING_MAX)
+    depth = ROC_RING_MAX;
+
+  if(vmeIN == 0)
+    return ERROR;
+
+  /* Room for the guard page, the alignment and the slack (rocEvent.c) */
+  eventBytes += ROC_EVENT_EXTRA_BYTES;
+
+  /* Huge page layout: buffers of a whole number of pages */
+  if(rocEvt.align > ROC_EVENT_ALIGN)
+    eventBytes = ((eventBytes + sizeof(DMANODE) + page - 1) & ~(page - 1))
+      - sizeof(DMANODE);
+
+  oldBytes = vmeIN->size - sizeof(DMANODE);
+  oldDepth = eventRing.nnode;
+
+  /* Nothing to do if the buffers are big enough and deep enough */
+  if((eventBytes <= oldBytes) && (eventBytes > oldBytes / 2) && (depth == oldDepth)
+     && (rocEvt.align == poolAlign))
+    return OK;
+
+  if(rocRingCount(&eventRing) != 0)
+    {
+      daLogMsg("WARN","Event buffers in use.  Not resized to %d x %d bytes",
+	       depth, eventBytes);
+      return ERROR;
+    }
+
+  rocEventGuard(&eventRing, 0);
+  rocRingClose(&eventRing);
+  dmaPFree(vmeIN);
+
+  newIN = dmaPCreate("vmeIN",eventBytes,depth,0);
+  if(newIN == 0)
+    {
+      daLogMsg("ERROR","Unable to allocate %d x %d bytes for event buffers",
+	       depth, eventBytes);
+      vmeIN = dmaPCreate("vmeIN",oldBytes,oldDepth,0);
+      if(vmeIN == 0)
+	{
+	  daLogMsg("ERROR","Unable to allocate memory for event buffers");
+	  ROL_SET_ERROR;
+	  return ERROR;
+	}
+      rocRingInit(&eventRing, vmeIN);
+      rocEventGuard(&eventRing, 1);
+      return ERROR;
+    }
+
+  vmeIN = newIN;
+  poolAlign = rocEvt.align;
+  rocRingInit(&eventRing, vmeIN);
+  rocEventGuard(&eventRing, 1);
+
+  daLogMsg("INFO","Event buffers: %d x %d bytes%s%s", eventRing.nnode,
+	   (int) (eventBytes - ROC_EVENT_EXTRA_BYTES),
+	   rocEvt.guarded ? " (with guard page)" : "",
+	   (rocEvt.align > ROC_EVENT_ALIGN) ? " (page aligned)" : "");
+  dmaPStatsAll();
+
+  return OK;
 }
 
 __attribute__((constructor)) void start (void)
@@ -534,6 +852,7 @@ __attribute__((destructor)) void end (void)
 
       TIp = NULL;
 
+      rocEventGuard(&eventRing, 0);
       dmaPFreeAll();
 
       ended=1;
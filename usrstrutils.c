@@ -28,6 +28,16 @@
    return null string if keyword has no value.
    Caller must free the string.
 
+   const char *getvalue(char *s) - Same as getstr, without the copy.
+   The string is valid until the next init_strings().  Before
+   init_strings(), the value is copied to a static buffer that is
+   valid until the next getvalue().
+
+   init_strings() parses the three config sources into one keyword
+   table (usrstr_table), so that lookups are a hash probe instead of a
+   scan of every string.  Before init_strings(), the strings are
+   scanned.
+
 */
 /* Define some common keywords as symbols, so we have just one place to
    change them*/
@@ -44,23 +54,194 @@
 char *internal_configusrstr=0;
 char *file_configusrstr=0;
 
+/* Keyword table: open addressing (linear probing) on the keyword hash.
+   Keywords and values point into usrstr_table.text. */
+typedef struct {
+  const char *key;
+  const char *val;		/* 0 if keyword has no value */
+  unsigned int hash;
+} USRSTR_ENTRY;
+
+struct {
+  USRSTR_ENTRY *entry;
+  int size;			/* Power of 2, 0 = not built */
+  int count;
+  char *text;			/* Copy of the three sources, split in place */
+} usrstr_table = {0, 0, 0, 0};
+
+static unsigned int usrstr_hash(const char *s, int len)
+{
+  unsigned int h = 2166136261u;	/* FNV-1a */
+  int i;
+  for(i=0;i<len;i++) {
+    h ^= (unsigned char) s[i];
+    h *= 16777619u;
+  }
+  return(h);
+}
+
+/* Slot of keyword s (len characters), or the empty slot where it goes */
+static int usrstr_slot(const char *s, int len, unsigned int h)
+{
+  int i = h & (usrstr_table.size - 1);
+  while(usrstr_table.entry[i].key) {
+    if(usrstr_table.entry[i].hash == h &&
+       strncmp(usrstr_table.entry[i].key,s,len) == 0 &&
+       usrstr_table.entry[i].key[len] == '\0')
+      break;
+    i = (i + 1) & (usrstr_table.size - 1);
+  }
+  return(i);
+}
+
+/* Entry for keyword s, or 0 if not present */
+static USRSTR_ENTRY *usrstr_lookup(const char *s)
+{
+  int len = strlen(s);
+  unsigned int h = usrstr_hash(s,len);
+  int i = usrstr_slot(s,len,h);
+  if(!usrstr_table.entry[i].key) return(0);
+  return(&usrstr_table.entry[i]);
+}
+
+/* Copy src to dst, split it into keyword[=value] and add the keywords
+   not already in the table.  Returns the end of the copy. */
+static char *usrstr_add(char *dst, const char *src)
+{
+  char *tok, *end, *eq, *comma;
+  int i, len;
+  unsigned int h;
+
+  if(!src) return(dst);
+  strcpy(dst,src);
+  tok = dst;
+  end = dst + strlen(dst);
+  /* Trailing newline (flag file line) */
+  while(end > dst && isspace(end[-1])) *--end = '\0';
+
+  while(tok < end) {
+    comma = strchr(tok,',');
+    if(!comma) comma = end;
+    *comma = '\0';
+    eq = strchr(tok,'=');
+    if(eq) *eq = '\0';
+    len = strlen(tok);
+    if(len > 0) {
+      h = usrstr_hash(tok,len);
+      i = usrstr_slot(tok,len,h);
+      if(!usrstr_table.entry[i].key) { /* First occurrence wins */
+	usrstr_table.entry[i].key = tok;
+	usrstr_table.entry[i].val = eq ? eq + 1 : 0;
+	usrstr_table.entry[i].hash = h;
+	usrstr_table.count++;
+      }
+    }
+    tok = comma + 1;
+  }
+  return(end + 1);
+}
+
+/* Build the keyword table from file_configusrstr, rol->usrString and
+   internal_configusrstr, in that order of precedence */
+static void usrstr_build()
+{
+  const char *src[3];
+  int i, len = 0, nkey = 0, size = 16;
+  const char *p;
+  char *dst;
+
+  src[0] = file_configusrstr;
+  src[1] = rol->usrString;
+  src[2] = internal_configusrstr;
+
+  for(i=0;i<3;i++) {
+    if(!src[i]) continue;
+    len += strlen(src[i]) + 1;
+    for(p=src[i];*p;p++)
+      if(*p == ',') nkey++;
+    nkey++;
+  }
+  while(size < 2*nkey) size *= 2;
+
+  if(usrstr_table.entry) free(usrstr_table.entry);
+  if(usrstr_table.text) free(usrstr_table.text);
+  usrstr_table.entry = (USRSTR_ENTRY *) calloc(size,sizeof(USRSTR_ENTRY));
+  usrstr_table.text = (char *) malloc(len+1);
+  usrstr_table.count = 0;
+  usrstr_table.size = 0;
+  if(!usrstr_table.entry || !usrstr_table.text) {
+    printf("usrstrutils: ERROR: Out of memory for the keyword table\n");
+    return;
+  }
+  usrstr_table.size = size;
+
+  dst = usrstr_table.text;
+  for(i=0;i<3;i++)
+    dst = usrstr_add(dst,src[i]);
+}
+
 /* For internal use. Returns ptr to keyword and ptr to value */
 void getflagpos(char *s,char **pos_ret,char **val_ret);
 int getflag(char *s)
 {
   char *pos,*val;
+  USRSTR_ENTRY *e;
+
+  if(usrstr_table.size) {
+    e = usrstr_lookup(s);
+    if(!e) return(0);
+    if(!e->val) return(1);
+    return(2);
+  }
 
   getflagpos(s,&pos,&val);
   if(!pos) return(0);
   if(!val) return(1);
   return(2);
 }
+const char *getvalue(char *s)
+{
+  static char *copy = 0;	/* Value found by a scan, until the next one */
+  char *pos,*val;
+  char *end;
+  int slen;
+  USRSTR_ENTRY *e;
+
+  if(usrstr_table.size) {
+    e = usrstr_lookup(s);
+    return(e ? e->val : 0);
+  }
+
+  getflagpos(s,&pos,&val);
+  if(!val){
+    return(0);
+  }
+  end = strchr(val,',');	/* value string ends at next keyword */
+  if(end)
+    slen = end - val;
+  else				/* No more keywords, value is rest of string */
+    slen = strlen(val);
+
+  if(copy) free(copy);
+  copy = (char *) malloc(slen+1);
+  strncpy(copy,val,slen);
+  copy[slen] = '\0';
+  return(copy);
+}
 char *getstr(char *s){
   char *pos,*val;
   char *end;
   char *ret;
   int slen;
 
+  if(usrstr_table.size) {
+    const char *v = getvalue(s);
+    if(!v) return(0);
+    ret = (char *) malloc(strlen(v)+1);
+    strcpy(ret,v);
+    return(ret);
+  }
+
   getflagpos(s,&pos,&val);
   if(!val){
     return(0);
@@ -79,7 +260,17 @@ char *getstr(char *s){
 unsigned int getint(char *s)
 {
   char *sval;
+  const char *cval;
   int retval;
+  if(usrstr_table.size) {	/* No copy needed */
+    cval = getvalue(s);
+    if(!cval) return(0);
+    retval = strtol(cval,0,0);
+    if(retval == LONG_MAX && (cval[1]=='x' || cval[1]=='X')) {/* Probably hex */
+      sscanf(cval,"%x",&retval);
+    }
+    return(retval);
+  }
   sval = getstr(s);
   if(!sval) return(0);		/* Just return zero if no value string */
   retval = strtol(sval,0,0);
@@ -142,6 +333,8 @@ void init_strings()
   FILE *fd;
   char s[256], *flag_line;
 
+  usrstr_table.size = 0;	/* Scan the strings until rebuilt */
+
   if(!internal_configusrstr) {	/* Internal flags not loaded */
     internal_configusrstr = (char *) malloc(strlen(INTERNAL_FLAGS)+1);
     strcpy(internal_configusrstr,INTERNAL_FLAGS);
@@ -186,6 +379,8 @@ void init_strings()
     free(ffile_name);
   }
   /*  daLogMsg("Run time Config: %s\n",file_configusrstr); */
+
+  usrstr_build();
 }
 
 #endif /* _USRSTRUTILS_INCLUDED */